@@ -0,0 +1,473 @@
+/**
+* hotchbench measures how the Hotch post-processing pipeline scales. It generates
+* a synthetic profiling run and times event storage, analysis, the table
+* generators and the report output.
+**/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+#include "analysis.hpp"
+#include "helpers.hpp"
+#include "profilemap.hpp"
+#include "report.hpp"
+#include "trace.hpp"
+
+struct Options
+{
+	unsigned long long events;
+	unsigned int blocks;
+	unsigned int blocksPerFunction;
+	unsigned int threads;
+	unsigned int threadSwitchInterval;
+	double skew;
+	unsigned int eventRows;
+	unsigned int seed;
+	std::string templateFile;
+	std::string outputFile;
+	std::string traceFile;
+
+	Options() : events(1000000), blocks(10000), blocksPerFunction(8), threads(1), threadSwitchInterval(256), skew(1.0), eventRows(10000), seed(1), templateFile("../../template.htm"), outputFile("bench.html") { }
+};
+
+/**
+* Wall clock time in seconds.
+**/
+double now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return 1.0 * counter.QuadPart / frequency.QuadPart;
+#else
+	timeval tv;
+
+	gettimeofday(&tv, 0);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+/**
+* Peak memory usage of the process in bytes.
+**/
+unsigned long long peakMemory()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return static_cast<unsigned long long>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/**
+* Small and fast xorshift generator so that runs are reproducible on all platforms.
+**/
+class Random
+{
+private:
+	unsigned long long state;
+
+public:
+	Random(unsigned int seed) : state(0x9E3779B97F4A7C15ULL ^ seed) { }
+
+	unsigned long long next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		return state;
+	}
+
+	double nextDouble()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+
+/**
+* Draws block indices so that the hits follow a Zipf distribution with the given skew.
+* The ranks are shuffled so that hot blocks are spread over the whole file.
+**/
+class BlockGenerator
+{
+private:
+	std::vector<double> cumulative;
+	std::vector<unsigned int> blocks;
+
+public:
+	BlockGenerator(unsigned int count, double skew, Random& random) : cumulative(count), blocks(count)
+	{
+		double sum = 0;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			sum += 1.0 / std::pow(i + 1.0, skew);
+			cumulative[i] = sum;
+			blocks[i] = i;
+		}
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			cumulative[i] /= sum;
+		}
+
+		for (unsigned int i = count - 1; i > 0; i--)
+		{
+			std::swap(blocks[i], blocks[random.next() % (i + 1)]);
+		}
+	}
+
+	unsigned int next(Random& random) const
+	{
+		double value = random.nextDouble();
+
+		unsigned int rank = std::lower_bound(cumulative.begin(), cumulative.end(), value) - cumulative.begin();
+
+		return blocks[rank < blocks.size() ? rank : blocks.size() - 1];
+	}
+};
+
+/**
+* Opens the trace from the trace file if there is one or from memory.
+**/
+TraceDecoder* openTrace(std::ifstream& traceFile, const TraceEncoder& trace)
+{
+	if (traceFile.is_open())
+	{
+		traceFile.clear();
+		traceFile.seekg(0);
+
+		return new TraceDecoder(traceFile);
+	}
+
+	return new TraceDecoder(trace.getData());
+}
+
+void printUsage()
+{
+	fprintf(stderr, "Usage: hotchbench [options]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -n <count>  Number of events (default: 1000000)\n");
+	fprintf(stderr, "  -b <count>  Number of blocks (default: 10000)\n");
+	fprintf(stderr, "  -f <count>  Blocks per function (default: 8)\n");
+	fprintf(stderr, "  -s <skew>   Zipf exponent of the block hits (default: 1.0)\n");
+	fprintf(stderr, "  -j <count>  Number of threads (default: 1)\n");
+	fprintf(stderr, "  -r <count>  Rows of the events table (default: 10000)\n");
+	fprintf(stderr, "  -S <seed>   Random seed (default: 1)\n");
+	fprintf(stderr, "  -t <file>   Report template (default: ../../template.htm)\n");
+	fprintf(stderr, "  -o <file>   Report output (default: bench.html)\n");
+	fprintf(stderr, "  -w <file>   Stream the trace to a file instead of memory (for 100M+ events)\n");
+}
+
+bool parseArguments(int argc, char* argv[], Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+
+		const char* value = argv[++i];
+
+		if (argument == "-n")
+		{
+			std::istringstream(value) >> options.events;
+		}
+		else if (argument == "-b")
+		{
+			options.blocks = std::strtoul(value, 0, 10);
+		}
+		else if (argument == "-f")
+		{
+			options.blocksPerFunction = std::strtoul(value, 0, 10);
+		}
+		else if (argument == "-s")
+		{
+			options.skew = std::strtod(value, 0);
+		}
+		else if (argument == "-j")
+		{
+			options.threads = std::strtoul(value, 0, 10);
+		}
+		else if (argument == "-r")
+		{
+			options.eventRows = std::strtoul(value, 0, 10);
+		}
+		else if (argument == "-S")
+		{
+			options.seed = std::strtoul(value, 0, 10);
+		}
+		else if (argument == "-t")
+		{
+			options.templateFile = value;
+		}
+		else if (argument == "-o")
+		{
+			options.outputFile = value;
+		}
+		else if (argument == "-w")
+		{
+			options.traceFile = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return options.blocks != 0 && options.blocksPerFunction != 0 && options.threads != 0;
+}
+
+/**
+* Prints the time a phase took and its throughput.
+**/
+void printPhase(const char* phase, double seconds, unsigned long long events)
+{
+	printf("%-28s %10.3f s", phase, seconds);
+
+	if (events != 0 && seconds > 0)
+	{
+		printf(" %14.0f events/s", events / seconds);
+	}
+
+	printf("\n");
+}
+
+/**
+* Creates the profile map of the synthetic file.
+**/
+void generateProfileMap(const Options& options, ProfileMap& map)
+{
+	map.setInputFile("synthetic.exe");
+
+	for (unsigned int i = 0; i < options.blocks; i++)
+	{
+		address_t address = 0x401000 + 0x10ULL * i;
+
+		if (i % options.blocksPerFunction == 0)
+		{
+			std::ostringstream name;
+
+			name << "sub_" << std::uppercase << std::hex << address;
+
+			map.addFunction(address, name.str());
+		}
+
+		map.addBlock(address, i / options.blocksPerFunction);
+	}
+}
+
+/**
+* Returns the size of the written report.
+**/
+unsigned int reportSize(const std::string& filename)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+
+	return file ? getFileSize(file) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	if (!parseArguments(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	printf("%llu events, %u blocks, %u blocks per function, skew %.2f, %u threads\n\n", options.events, options.blocks, options.blocksPerFunction, options.skew, options.threads);
+
+	Random random(options.seed);
+
+	ProfileMap map;
+
+	generateProfileMap(options, map);
+
+	BlockGenerator blockGenerator(options.blocks, options.skew, random);
+
+	// Event storage: the events are generated in batches so that the generator
+	// does not count towards the encoding time.
+	const unsigned int BATCH_SIZE = 64 * 1024;
+
+	std::vector<TraceEvent> batch(BATCH_SIZE);
+
+	TraceEncoder trace;
+	TraceEncoder eventRows;
+
+	std::ofstream traceFile;
+
+	if (!options.traceFile.empty())
+	{
+		traceFile.open(options.traceFile.c_str(), std::ios::binary);
+	}
+
+	double generationTime = 0;
+	double storageTime = 0;
+
+	unsigned long long time = 1000000000000ULL;
+	unsigned int thread = 0;
+
+	for (unsigned long long generated = 0; generated < options.events; )
+	{
+		double start = now();
+
+		unsigned int count = static_cast<unsigned int>(std::min<unsigned long long>(BATCH_SIZE, options.events - generated));
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if ((generated + i) % options.threadSwitchInterval == 0)
+			{
+				thread = static_cast<unsigned int>(random.next() % options.threads);
+			}
+
+			unsigned long long value = random.next();
+
+			// Most breakpoint hits are less than a millisecond apart
+			time += (value & 3) == 0 ? (value >> 2) % 3 : 0;
+
+			batch[i].block = blockGenerator.next(random);
+			batch[i].thread = 1000 + thread;
+			batch[i].time = time;
+		}
+
+		double middle = now();
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			trace.addEvent(batch[i].block, batch[i].thread, batch[i].time);
+		}
+
+		if (traceFile.is_open() && trace.getData().size() > 1024 * 1024)
+		{
+			trace.drain(traceFile);
+		}
+
+		storageTime += now() - middle;
+		generationTime += middle - start;
+
+		for (unsigned int i = 0; i < count && generated + i < options.eventRows; i++)
+		{
+			eventRows.addEvent(batch[i].block, batch[i].thread, batch[i].time);
+		}
+
+		generated += count;
+	}
+
+	trace.finish();
+	eventRows.finish();
+
+	unsigned long long traceSize = trace.getData().size();
+
+	if (traceFile.is_open())
+	{
+		double start = now();
+
+		traceSize = static_cast<unsigned long long>(traceFile.tellp()) + trace.getData().size();
+
+		trace.drain(traceFile);
+		traceFile.close();
+
+		storageTime += now() - start;
+	}
+
+	printPhase("Event generation", generationTime, options.events);
+	printPhase("Event storage", storageTime, options.events);
+
+	std::ifstream traceInput;
+
+	if (!options.traceFile.empty())
+	{
+		traceInput.open(options.traceFile.c_str(), std::ios::binary);
+	}
+
+	double start = now();
+
+	{
+		std::auto_ptr<TraceDecoder> decoder(openTrace(traceInput, trace));
+		TraceEvent event;
+
+		while (decoder->next(event))
+		{
+		}
+	}
+
+	printPhase("Trace decoding", now() - start, options.events);
+
+	Profile profile(map);
+
+	start = now();
+
+	{
+		std::auto_ptr<TraceDecoder> decoder(openTrace(traceInput, trace));
+
+		analyzeEventList(*decoder, map, profile);
+	}
+
+	printPhase("analyzeEventList", now() - start, options.events);
+
+	start = now();
+
+	{
+		TraceDecoder events(eventRows.getData());
+		std::ostringstream reportData;
+
+		writeReportData(reportData, map, profile, events);
+	}
+
+	printPhase("Report data", now() - start, eventRows.getNumberOfEvents());
+
+	start = now();
+
+	{
+		TraceDecoder events(eventRows.getData());
+
+		if (!writeOutput(options.templateFile, options.outputFile, map, profile, events))
+		{
+			fprintf(stderr, "Could not read template file %s\n", options.templateFile.c_str());
+			return 1;
+		}
+	}
+
+	printPhase("writeOutput", now() - start, 0);
+
+	printf("\n");
+	printf("Trace size: %llu bytes (%.2f bytes/event)\n", traceSize, options.events ? 1.0 * traceSize / options.events : 0.0);
+	printf("Report size: %u bytes\n", reportSize(options.outputFile));
+	printf("Peak memory: %.1f MB\n", peakMemory() / (1024.0 * 1024.0));
+
+	return 0;
+}
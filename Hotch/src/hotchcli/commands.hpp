@@ -0,0 +1,11 @@
+#ifndef COMMANDS_HPP
+#define COMMANDS_HPP
+
+/**
+* Commands of hotchcli besides the default report command. Each command gets the
+* command line without the program name, starting at the command name.
+**/
+
+int runCoverageCommand(int argc, char* argv[]);
+
+#endif
@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "commands.hpp"
+#include "coverage.hpp"
+#include "profilemap.hpp"
+
+namespace
+{
+	struct CoverageOptions
+	{
+		std::string mapFile;
+		std::string outputFile;
+		std::vector<std::string> runFiles;
+		std::vector<std::string> baselineFiles;
+		bool intersect;
+
+		CoverageOptions() : intersect(false) { }
+	};
+
+	void printCoverageUsage()
+	{
+		fprintf(stderr, "Usage: hotchcli coverage [options] <map file> <coverage file>...\n");
+		fprintf(stderr, "\n");
+		fprintf(stderr, "Lists the blocks that the given runs hit and the baseline runs did not (new)\n");
+		fprintf(stderr, "and the blocks that the baseline runs hit and the given runs did not (lost).\n");
+		fprintf(stderr, "\n");
+		fprintf(stderr, "  -b <file>   Baseline coverage; can be repeated, the union is used\n");
+		fprintf(stderr, "  -i          Use the blocks hit by all runs instead of by any run\n");
+		fprintf(stderr, "  -o <file>   Write the block list to a file instead of stdout\n");
+	}
+
+	bool parseCoverageArguments(int argc, char* argv[], CoverageOptions& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string argument = argv[i];
+
+			if (argument == "-b" && i + 1 < argc)
+			{
+				options.baselineFiles.push_back(argv[++i]);
+			}
+			else if (argument == "-o" && i + 1 < argc)
+			{
+				options.outputFile = argv[++i];
+			}
+			else if (argument == "-i")
+			{
+				options.intersect = true;
+			}
+			else if (argument[0] == '-')
+			{
+				return false;
+			}
+			else if (options.mapFile.empty())
+			{
+				options.mapFile = argument;
+			}
+			else
+			{
+				options.runFiles.push_back(argument);
+			}
+		}
+
+		return !options.mapFile.empty() && !options.runFiles.empty();
+	}
+
+	/**
+	* Combines the coverage of several runs.
+	* @return False if a file could not be read or does not belong to the layout
+	**/
+	bool combineCoverage(const std::vector<std::string>& files, const CoverageLayout& layout, bool intersect, CoverageBitmap& result)
+	{
+		result = CoverageBitmap(layout.size(), layout.getFingerprint());
+
+		for (std::vector<std::string>::const_iterator Iter = files.begin(); Iter != files.end(); ++Iter)
+		{
+			CoverageBitmap bitmap;
+
+			if (!readCoverage(*Iter, bitmap))
+			{
+				fprintf(stderr, "Could not read coverage file %s\n", Iter->c_str());
+				return false;
+			}
+
+			if (!bitmap.isCompatible(result))
+			{
+				fprintf(stderr, "Coverage file %s belongs to a different profile map\n", Iter->c_str());
+				return false;
+			}
+
+			if (intersect && Iter != files.begin())
+			{
+				result.intersect(bitmap);
+			}
+			else
+			{
+				result.unite(bitmap);
+			}
+		}
+
+		return true;
+	}
+
+	void writeBlocks(std::ostream& stream, const char* type, const CoverageBitmap& bitmap, const CoverageLayout& layout, const ProfileMap& map)
+	{
+		std::vector<unsigned int> bits = bitmap.getBlocks();
+
+		for (std::vector<unsigned int>::const_iterator Iter = bits.begin(); Iter != bits.end(); ++Iter)
+		{
+			const ProfileBlock& block = map.getBlock(layout.getBlock(*Iter));
+
+			stream << type << "\t0x" << std::hex << block.getAddress() << std::dec << "\t" << map.getFunctionName(block.getFunction()) << "\n";
+		}
+	}
+}
+
+int runCoverageCommand(int argc, char* argv[])
+{
+	CoverageOptions options;
+
+	if (!parseCoverageArguments(argc, argv, options))
+	{
+		printCoverageUsage();
+		return 1;
+	}
+
+	ProfileMap map;
+
+	if (!readProfileMap(options.mapFile, map))
+	{
+		fprintf(stderr, "Could not read profile map %s\n", options.mapFile.c_str());
+		return 1;
+	}
+
+	CoverageLayout layout(map);
+
+	CoverageBitmap runs;
+	CoverageBitmap baseline;
+
+	if (!combineCoverage(options.runFiles, layout, options.intersect, runs) || !combineCoverage(options.baselineFiles, layout, false, baseline))
+	{
+		return 1;
+	}
+
+	CoverageBitmap newBlocks = runs;
+	newBlocks.subtract(baseline);
+
+	CoverageBitmap lostBlocks = baseline;
+	lostBlocks.subtract(runs);
+
+	std::ofstream file;
+
+	if (!options.outputFile.empty())
+	{
+		file.open(options.outputFile.c_str());
+	}
+
+	std::ostream& stream = options.outputFile.empty() ? std::cout : file;
+
+	stream << "# blocks: " << layout.size() << ", runs: " << runs.count() << ", baseline: " << baseline.count();
+	stream << ", new: " << newBlocks.count() << ", lost: " << lostBlocks.count() << "\n";
+
+	writeBlocks(stream, "new", newBlocks, layout, map);
+	writeBlocks(stream, "lost", lostBlocks, layout, map);
+
+	return stream.good() ? 0 : 1;
+}
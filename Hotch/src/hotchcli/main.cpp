@@ -0,0 +1,490 @@
+/**
+* hotchcli analyzes the profile map and trace that Hotch exports at the end of a
+* profiling run and creates the same report as the plugin, without IDA.
+**/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "analysis.hpp"
+#include "chrometrace.hpp"
+#include "commands.hpp"
+#include "contexts.hpp"
+#include "counters.hpp"
+#include "coverage.hpp"
+#include "helpers.hpp"
+#include "layout.hpp"
+#include "paths.hpp"
+#include "profilemap.hpp"
+#include "report.hpp"
+#include "rollup.hpp"
+#include "sampling.hpp"
+#include "trace.hpp"
+#include "traceindex.hpp"
+
+struct Options
+{
+	std::string mapFile;
+	std::string traceFile;
+	std::string templateFile;
+	std::string outputFile;
+	std::string timelineFile;
+	std::string coverageFile;
+	std::string statisticsFile;
+	std::string contextsFile;
+	std::string rollupsFile;
+	std::string symbolOrderFile;
+	std::string layoutFile;
+	std::string pathsFile;
+	std::string indexFile;
+
+	unsigned int contextDepth;
+	double contextThreshold;
+
+	// Time window relative to the first event in milliseconds
+	bool hasWindow;
+	unsigned long long windowStart;
+	unsigned long long windowEnd;
+
+	Options() : templateFile("template.htm"), outputFile("results.html"), contextDepth(64), contextThreshold(0.1), hasWindow(false), windowStart(0), windowEnd(~0ULL) { }
+};
+
+void printUsage()
+{
+	fprintf(stderr, "Usage: hotchcli [options] <map file> <trace file>\n");
+	fprintf(stderr, "       hotchcli coverage [options] <map file> <coverage file>...\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -t <file>   Report template (default: template.htm)\n");
+	fprintf(stderr, "  -o <file>   Output file (default: results.html)\n");
+	fprintf(stderr, "  -c <file>   Also export the function timeline as trace-event JSON\n");
+	fprintf(stderr, "  -u <file>   Also write the block coverage of the run\n");
+	fprintf(stderr, "  -s <file>   Also write the block and function statistics as CSV\n");
+	fprintf(stderr, "  -f <file>   Also write the calling contexts as folded stacks\n");
+	fprintf(stderr, "  -r <file>   Also write the time by segment, module and namespace as CSV\n");
+	fprintf(stderr, "  -l <file>   Also write a linker symbol order file of the hot functions\n");
+	fprintf(stderr, "  -L <file>   Also write the expected effect of the suggested code layout\n");
+	fprintf(stderr, "  -p <file>   Also write the most frequently executed paths of the functions\n");
+	fprintf(stderr, "  -D <depth>  Maximum depth of the written calling contexts (default: 64)\n");
+	fprintf(stderr, "  -P <pct>    Merge calling contexts below this share of the time into\n");
+	fprintf(stderr, "              their caller (default: 0.1)\n");
+	fprintf(stderr, "  -w <from>:<to>  Only analyze the events between these times in ms after\n");
+	fprintf(stderr, "              the first event (either time can be left out)\n");
+	fprintf(stderr, "  -i <file>   Time index of the trace; it is created if it does not exist\n");
+}
+
+/**
+* Parses a time window of the form from:to. Either time can be left out.
+**/
+bool parseWindow(const std::string& argument, Options& options)
+{
+	std::string::size_type separator = argument.find(':');
+
+	if (separator == std::string::npos)
+	{
+		return false;
+	}
+
+	std::string start = argument.substr(0, separator);
+	std::string end = argument.substr(separator + 1);
+
+	options.hasWindow = true;
+	options.windowStart = start.empty() ? 0 : std::strtoull(start.c_str(), 0, 10);
+	options.windowEnd = end.empty() ? ~0ULL : std::strtoull(end.c_str(), 0, 10);
+
+	return options.windowStart <= options.windowEnd;
+}
+
+/**
+* Reads the time index of a trace or creates it if it does not exist or belongs
+* to another version of the trace.
+**/
+bool loadTraceIndex(const Options& options, TraceIndex& index)
+{
+	std::ifstream traceFile(options.traceFile.c_str(), std::ios::binary);
+
+	if (!options.indexFile.empty() && readTraceIndex(options.indexFile, index))
+	{
+		if (index.matches(traceFile))
+		{
+			return true;
+		}
+
+		printf("The trace index %s does not match the trace\n", options.indexFile.c_str());
+	}
+
+	printf("Indexing the trace...\n");
+
+	TraceDecoder decoder(traceFile);
+
+	index.build(decoder);
+
+	return options.indexFile.empty() || writeTraceIndex(options.indexFile, index);
+}
+
+/**
+* Limits a decoder to the time window of the options.
+**/
+bool applyWindow(const Options& options, const TraceIndex& index, TraceDecoder& decoder)
+{
+	if (!options.hasWindow)
+	{
+		return true;
+	}
+
+	unsigned long long end = index.getStartTime() + options.windowEnd;
+
+	// Open windows reach to the end of the trace
+	if (end < index.getStartTime())
+	{
+		end = ~0ULL;
+	}
+
+	return index.seek(decoder, index.getStartTime() + options.windowStart, end);
+}
+
+/**
+* Parses the command line.
+* @return False if the command line is invalid
+**/
+bool parseArguments(int argc, char* argv[], Options& options)
+{
+	unsigned int positional = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "-t" && i + 1 < argc)
+		{
+			options.templateFile = argv[++i];
+		}
+		else if (argument == "-o" && i + 1 < argc)
+		{
+			options.outputFile = argv[++i];
+		}
+		else if (argument == "-c" && i + 1 < argc)
+		{
+			options.timelineFile = argv[++i];
+		}
+		else if (argument == "-u" && i + 1 < argc)
+		{
+			options.coverageFile = argv[++i];
+		}
+		else if (argument == "-s" && i + 1 < argc)
+		{
+			options.statisticsFile = argv[++i];
+		}
+		else if (argument == "-f" && i + 1 < argc)
+		{
+			options.contextsFile = argv[++i];
+		}
+		else if (argument == "-r" && i + 1 < argc)
+		{
+			options.rollupsFile = argv[++i];
+		}
+		else if (argument == "-l" && i + 1 < argc)
+		{
+			options.symbolOrderFile = argv[++i];
+		}
+		else if (argument == "-L" && i + 1 < argc)
+		{
+			options.layoutFile = argv[++i];
+		}
+		else if (argument == "-p" && i + 1 < argc)
+		{
+			options.pathsFile = argv[++i];
+		}
+		else if (argument == "-D" && i + 1 < argc)
+		{
+			options.contextDepth = std::strtoul(argv[++i], 0, 10);
+		}
+		else if (argument == "-P" && i + 1 < argc)
+		{
+			options.contextThreshold = std::strtod(argv[++i], 0);
+		}
+		else if (argument == "-w" && i + 1 < argc)
+		{
+			if (!parseWindow(argv[++i], options))
+			{
+				return false;
+			}
+		}
+		else if (argument == "-i" && i + 1 < argc)
+		{
+			options.indexFile = argv[++i];
+		}
+		else if (argument[0] == '-')
+		{
+			return false;
+		}
+		else if (positional == 0)
+		{
+			options.mapFile = argument;
+			++positional;
+		}
+		else if (positional == 1)
+		{
+			options.traceFile = argument;
+			++positional;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return positional == 2;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::strcmp(argv[1], "coverage") == 0)
+	{
+		return runCoverageCommand(argc - 1, argv + 1);
+	}
+
+	Options options;
+
+	if (!parseArguments(argc, argv, options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	ProfileMap map;
+
+	if (!readProfileMap(options.mapFile, map))
+	{
+		fprintf(stderr, "Could not read profile map %s\n", options.mapFile.c_str());
+		return 1;
+	}
+
+	std::ifstream traceFile(options.traceFile.c_str(), std::ios::binary);
+
+	SampleCounter samples;
+	unsigned long long samplingInterval = 0;
+	bool sampling;
+
+	// Sampling traces hold the samples instead of events
+	{
+		TraceDecoder sampleDecoder(traceFile);
+
+		sampling = readSamples(sampleDecoder, samples, samplingInterval);
+	}
+
+	traceFile.clear();
+	traceFile.seekg(0);
+
+	TraceDecoder decoder(traceFile);
+
+	if (!decoder.isValid())
+	{
+		fprintf(stderr, "Could not read trace %s\n", options.traceFile.c_str());
+		return 1;
+	}
+
+	TraceIndex index;
+
+	if ((options.hasWindow || !options.indexFile.empty()) && !loadTraceIndex(options, index))
+	{
+		fprintf(stderr, "Could not write trace index %s\n", options.indexFile.c_str());
+		return 1;
+	}
+
+	if (!applyWindow(options, index, decoder))
+	{
+		fprintf(stderr, "Could not find the time window in trace %s\n", options.traceFile.c_str());
+		return 1;
+	}
+
+	printf("Analyzing the profiler event list...\n");
+
+	Profile profile(map);
+
+	if (sampling)
+	{
+		printf("Took %s samples, %s of them outside of the profiled blocks\n", toString(samples.getNumberOfSamples()).c_str(), toString(samples.getNumberOfUnknownSamples()).c_str());
+
+		analyzeSamples(samples, map, profile, samplingInterval);
+	}
+	else if (map.isCounting())
+	{
+		unsigned int unresolved = analyzeCounts(decoder, map, profile);
+
+		printf("Inferred the hits of %u blocks from %u measured blocks", map.getNumberOfBlocks() - map.getNumberOfMeasuredBlocks() - unresolved, map.getNumberOfMeasuredBlocks());
+		printf(unresolved == 0 ? "\n" : ", %u blocks could not be inferred\n", unresolved);
+	}
+	else
+	{
+		analyzeEventList(decoder, map, profile);
+	}
+
+	// Counting traces only hold the measured blocks, so their transitions are not the real ones
+	bool hasTransitions = !map.isCounting() && !sampling;
+
+	if (!hasTransitions && (!options.symbolOrderFile.empty() || !options.layoutFile.empty() || !options.pathsFile.empty() || !options.timelineFile.empty()))
+	{
+		fprintf(stderr, "The trace of a %s session has no block transitions, the code layout, paths and timeline are not written\n", sampling ? "sampling" : "counting");
+	}
+
+	printf("Generating the output file...\n");
+
+	// The events table needs a second pass over the trace
+	traceFile.clear();
+	traceFile.seekg(0);
+
+	TraceDecoder events(traceFile);
+
+	applyWindow(options, index, events);
+
+	if (!writeOutput(options.templateFile, options.outputFile, map, profile, events))
+	{
+		fprintf(stderr, "Could not read template file %s\n", options.templateFile.c_str());
+		return 1;
+	}
+
+	if (!options.coverageFile.empty() && !writeCoverage(options.coverageFile, CoverageLayout(map).getCoverage(profile)))
+	{
+		fprintf(stderr, "Could not write coverage %s\n", options.coverageFile.c_str());
+		return 1;
+	}
+
+	if (!options.statisticsFile.empty())
+	{
+		std::ofstream statistics(options.statisticsFile.c_str());
+
+		writeStatistics(statistics, map, profile);
+
+		if (!statistics)
+		{
+			fprintf(stderr, "Could not write statistics %s\n", options.statisticsFile.c_str());
+			return 1;
+		}
+	}
+
+	if (!options.contextsFile.empty())
+	{
+		std::ofstream contexts(options.contextsFile.c_str());
+
+		writeFoldedContexts(contexts, map, profile.getContexts(), options.contextDepth, options.contextThreshold / 100.0);
+
+		if (!contexts)
+		{
+			fprintf(stderr, "Could not write calling contexts %s\n", options.contextsFile.c_str());
+			return 1;
+		}
+	}
+
+	if (!options.rollupsFile.empty())
+	{
+		RollupTree tree;
+
+		createRollups(map, profile, tree);
+
+		std::ofstream rollups(options.rollupsFile.c_str());
+
+		writeRollups(rollups, tree);
+
+		if (!rollups)
+		{
+			fprintf(stderr, "Could not write rollups %s\n", options.rollupsFile.c_str());
+			return 1;
+		}
+	}
+
+	if (hasTransitions && (!options.symbolOrderFile.empty() || !options.layoutFile.empty()))
+	{
+		printf("Computing the code layout...\n");
+
+		traceFile.clear();
+		traceFile.seekg(0);
+
+		TraceDecoder layoutEvents(traceFile);
+
+		applyWindow(options, index, layoutEvents);
+
+		LayoutProfiler profiler(map);
+
+		profileLayout(layoutEvents, profiler);
+
+		CodeLayout layout(map, profiler);
+
+		if (!options.symbolOrderFile.empty())
+		{
+			std::ofstream symbolOrder(options.symbolOrderFile.c_str());
+
+			writeSymbolOrder(symbolOrder, map, layout);
+
+			if (!symbolOrder)
+			{
+				fprintf(stderr, "Could not write symbol order %s\n", options.symbolOrderFile.c_str());
+				return 1;
+			}
+		}
+
+		if (!options.layoutFile.empty())
+		{
+			std::ofstream layoutReport(options.layoutFile.c_str());
+
+			writeLayoutReport(layoutReport, map, layout);
+
+			if (!layoutReport)
+			{
+				fprintf(stderr, "Could not write layout report %s\n", options.layoutFile.c_str());
+				return 1;
+			}
+		}
+	}
+
+	if (hasTransitions && !options.pathsFile.empty())
+	{
+		printf("Counting the paths...\n");
+
+		traceFile.clear();
+		traceFile.seekg(0);
+
+		TraceDecoder pathEvents(traceFile);
+
+		applyWindow(options, index, pathEvents);
+
+		PathProfiler profiler(map);
+
+		profilePaths(pathEvents, profiler);
+
+		std::ofstream paths(options.pathsFile.c_str());
+
+		writePathReport(paths, map, profiler);
+
+		if (!paths)
+		{
+			fprintf(stderr, "Could not write paths %s\n", options.pathsFile.c_str());
+			return 1;
+		}
+	}
+
+	if (hasTransitions && !options.timelineFile.empty())
+	{
+		printf("Exporting the timeline...\n");
+
+		traceFile.clear();
+		traceFile.seekg(0);
+
+		TraceDecoder timelineEvents(traceFile);
+
+		applyWindow(options, index, timelineEvents);
+		std::ofstream timeline(options.timelineFile.c_str());
+
+		exportChromeTrace(timelineEvents, map, timeline);
+
+		if (!timeline)
+		{
+			fprintf(stderr, "Could not write timeline %s\n", options.timelineFile.c_str());
+			return 1;
+		}
+	}
+
+	return 0;
+}
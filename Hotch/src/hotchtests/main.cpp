@@ -0,0 +1,535 @@
+/**
+* hotchtests checks the parts of the Hotch analysis that the reports rely on but
+* that are hard to see in a report: the placement and inference of block counters,
+* the numbering of paths, the loop forest and the trace encoding.
+**/
+
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cppunit/BriefTestProgressListener.h>
+#include <cppunit/CompilerOutputter.h>
+#include <cppunit/TestCaller.h>
+#include <cppunit/TestResult.h>
+#include <cppunit/TestResultCollector.h>
+#include <cppunit/TestSuite.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "counters.hpp"
+#include "loops.hpp"
+#include "paths.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+namespace
+{
+	/**
+	* Adds a function with the given number of blocks to an empty map. The first
+	* block starts the function, so block i is node i + 1 of the function.
+	**/
+	void createFunction(ProfileMap& map, unsigned int blocks)
+	{
+		unsigned int function = map.addFunction(0x1000, "function");
+
+		for (unsigned int i = 0; i < blocks; i++)
+		{
+			map.addBlock(0x1000 + i * 0x10, function);
+		}
+	}
+
+	/**
+	* Creates a function whose first block branches to two blocks that both
+	* continue at the returning block 3.
+	**/
+	void createDiamond(ProfileMap& map)
+	{
+		createFunction(map, 4);
+
+		map.addEdge(0, 1);
+		map.addEdge(0, 2);
+		map.addEdge(1, 3);
+		map.addEdge(2, 3);
+	}
+
+	/**
+	* Creates a function whose first block enters a loop with the header 1 and
+	* the body 2. The loop is left to the returning block 3.
+	**/
+	void createLoop(ProfileMap& map)
+	{
+		createFunction(map, 4);
+
+		map.addEdge(0, 1);
+		map.addEdge(1, 2);
+		map.addEdge(2, 1);
+		map.addEdge(1, 3);
+	}
+
+	/**
+	* Creates a function with an outer loop with the header 1 around an inner loop
+	* with the header 2 and the body 3. Block 4 ends an iteration of the outer loop
+	* and block 5 returns.
+	**/
+	void createNestedLoops(ProfileMap& map)
+	{
+		createFunction(map, 6);
+
+		map.addEdge(0, 1);
+		map.addEdge(1, 2);
+		map.addEdge(2, 3);
+		map.addEdge(3, 2);
+		map.addEdge(2, 4);
+		map.addEdge(4, 1);
+		map.addEdge(1, 5);
+	}
+
+	/**
+	* Places the counters of a map and infers the hits of all blocks from the hits
+	* of the measured blocks of a run.
+	* @param hits The hits of all blocks in the run
+	* @param inferred Receives the inferred hits of all blocks
+	* @param calls Receives the inferred calls of each function
+	* @return The number of blocks whose hits could not be inferred
+	**/
+	unsigned int inferRun(ProfileMap& map, const std::vector<bool>& unmeasurable, const std::vector<unsigned long long>& hits, std::vector<unsigned long long>& inferred, std::vector<unsigned long long>& calls)
+	{
+		placeCounters(map, unmeasurable);
+
+		inferred.assign(hits.size(), 0);
+
+		for (unsigned int i = 0; i < hits.size(); i++)
+		{
+			if (map.getBlock(i).isMeasured())
+			{
+				inferred[i] = hits[i];
+			}
+		}
+
+		return inferCounts(map, inferred, calls);
+	}
+
+	/**
+	* Collects the types of the extended records of a trace.
+	**/
+	class RecordCollector : public TraceRecordListener
+	{
+	private:
+		std::vector<unsigned int> types;
+
+		// Number of events decoded before each record
+		std::vector<unsigned int> positions;
+
+		const std::vector<TraceEvent>& events;
+
+	public:
+		RecordCollector(const std::vector<TraceEvent>& events) : events(events) { }
+
+		void addRecord(unsigned int type, const std::vector<unsigned char>&)
+		{
+			types.push_back(type);
+			positions.push_back(events.size());
+		}
+
+		const std::vector<unsigned int>& getTypes() const { return types; }
+
+		const std::vector<unsigned int>& getPositions() const { return positions; }
+	};
+
+	void decodeTrace(const std::string& data, std::vector<TraceEvent>& events, TraceRecordListener* listener)
+	{
+		std::istringstream stream(data);
+		TraceDecoder decoder(stream);
+
+		CPPUNIT_ASSERT(decoder.isValid());
+
+		decoder.setRecordListener(listener);
+
+		TraceEvent event;
+
+		while (decoder.next(event))
+		{
+			events.push_back(event);
+		}
+	}
+
+	void checkEvent(const TraceEvent& event, unsigned int block, unsigned int thread, unsigned long long time)
+	{
+		CPPUNIT_ASSERT_EQUAL(block, event.block);
+		CPPUNIT_ASSERT_EQUAL(thread, event.thread);
+		CPPUNIT_ASSERT_EQUAL(time, event.time);
+	}
+}
+
+class CounterTest : public CppUnit::TestFixture
+{
+public:
+	void setUp() { }
+	void tearDown() { }
+
+	void testDiamond()
+	{
+		ProfileMap map;
+
+		createDiamond(map);
+
+		unsigned long long runHits[] = { 10, 7, 3, 10 };
+
+		std::vector<unsigned long long> hits(runHits, runHits + 4);
+		std::vector<unsigned long long> inferred;
+		std::vector<unsigned long long> calls;
+
+		CPPUNIT_ASSERT_EQUAL(0u, inferRun(map, std::vector<bool>(4), hits, inferred, calls));
+
+		// One branch and the function entry determine the rest
+		CPPUNIT_ASSERT_EQUAL(2u, map.getNumberOfMeasuredBlocks());
+		CPPUNIT_ASSERT(inferred == hits);
+		CPPUNIT_ASSERT_EQUAL(10ULL, calls[0]);
+	}
+
+	void testLoop()
+	{
+		ProfileMap map;
+
+		createLoop(map);
+
+		// Two calls of 5 iterations each
+		unsigned long long runHits[] = { 2, 12, 10, 2 };
+
+		std::vector<unsigned long long> hits(runHits, runHits + 4);
+		std::vector<unsigned long long> inferred;
+		std::vector<unsigned long long> calls;
+
+		CPPUNIT_ASSERT_EQUAL(0u, inferRun(map, std::vector<bool>(4), hits, inferred, calls));
+
+		CPPUNIT_ASSERT_EQUAL(2u, map.getNumberOfMeasuredBlocks());
+		CPPUNIT_ASSERT(inferred == hits);
+		CPPUNIT_ASSERT_EQUAL(2ULL, calls[0]);
+	}
+
+	void testUnmeasurableBlock()
+	{
+		ProfileMap map;
+
+		createDiamond(map);
+
+		std::vector<bool> unmeasurable(4);
+
+		unmeasurable[1] = true;
+
+		unsigned long long runHits[] = { 10, 7, 3, 10 };
+
+		std::vector<unsigned long long> hits(runHits, runHits + 4);
+		std::vector<unsigned long long> inferred;
+		std::vector<unsigned long long> calls;
+
+		CPPUNIT_ASSERT_EQUAL(0u, inferRun(map, unmeasurable, hits, inferred, calls));
+
+		CPPUNIT_ASSERT(!map.getBlock(1).isMeasured());
+		CPPUNIT_ASSERT(inferred == hits);
+	}
+
+	void testUninferableBlocks()
+	{
+		ProfileMap map;
+
+		createDiamond(map);
+
+		// Only the sum of both branches is known
+		std::vector<bool> unmeasurable(4);
+
+		unmeasurable[1] = true;
+		unmeasurable[2] = true;
+
+		unsigned long long runHits[] = { 10, 7, 3, 10 };
+
+		std::vector<unsigned long long> hits(runHits, runHits + 4);
+		std::vector<unsigned long long> inferred;
+		std::vector<unsigned long long> calls;
+
+		CPPUNIT_ASSERT_EQUAL(2u, inferRun(map, unmeasurable, hits, inferred, calls));
+
+		CPPUNIT_ASSERT(!map.getBlock(1).isMeasured());
+		CPPUNIT_ASSERT(!map.getBlock(2).isMeasured());
+		CPPUNIT_ASSERT_EQUAL(10ULL, inferred[0]);
+		CPPUNIT_ASSERT_EQUAL(10ULL, inferred[3]);
+		CPPUNIT_ASSERT_EQUAL(10ULL, calls[0]);
+	}
+};
+
+class PathTest : public CppUnit::TestFixture
+{
+private:
+	/**
+	* Checks that the values of the edges along each path add up to the number of
+	* the path and that no two numbers stand for the same path.
+	**/
+	void checkRoundTrips(const PathNumbering& numbering)
+	{
+		CPPUNIT_ASSERT(numbering.isValid());
+
+		std::set<std::vector<unsigned int> > paths;
+
+		for (unsigned long long path = 0; path < numbering.getNumberOfPaths(); path++)
+		{
+			std::vector<unsigned int> blocks = numbering.getPath(path);
+
+			CPPUNIT_ASSERT(!blocks.empty());
+			CPPUNIT_ASSERT(paths.insert(blocks).second);
+
+			unsigned int node = PathNumbering::ENTRY;
+			unsigned long long sum = 0;
+			unsigned long long value;
+
+			for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+			{
+				CPPUNIT_ASSERT(numbering.getValue(node, *Iter + 1, value));
+
+				sum += value;
+				node = *Iter + 1;
+			}
+
+			CPPUNIT_ASSERT(numbering.getValue(node, numbering.getExit(), value));
+
+			CPPUNIT_ASSERT_EQUAL(path, sum + value);
+		}
+	}
+
+public:
+	void setUp() { }
+	void tearDown() { }
+
+	void testDiamond()
+	{
+		ProfileMap map;
+
+		createDiamond(map);
+
+		PathProfiler profiler(map);
+
+		CPPUNIT_ASSERT_EQUAL(2ULL, profiler.getNumbering(0).getNumberOfPaths());
+
+		checkRoundTrips(profiler.getNumbering(0));
+	}
+
+	void testLoop()
+	{
+		ProfileMap map;
+
+		createLoop(map);
+
+		PathProfiler profiler(map);
+
+		// Paths start at the first block or the header and end at the back edge or the return
+		CPPUNIT_ASSERT_EQUAL(4ULL, profiler.getNumbering(0).getNumberOfPaths());
+
+		checkRoundTrips(profiler.getNumbering(0));
+	}
+
+	void testNestedLoops()
+	{
+		ProfileMap map;
+
+		createNestedLoops(map);
+
+		PathProfiler profiler(map);
+
+		checkRoundTrips(profiler.getNumbering(0));
+	}
+};
+
+class LoopTest : public CppUnit::TestFixture
+{
+public:
+	void setUp() { }
+	void tearDown() { }
+
+	void testNesting()
+	{
+		ProfileMap map;
+
+		createNestedLoops(map);
+
+		LoopForest forest(map);
+
+		CPPUNIT_ASSERT_EQUAL(2u, forest.getNumberOfLoops());
+
+		unsigned int outer = forest.getInnermostLoop(1);
+		unsigned int inner = forest.getInnermostLoop(3);
+
+		CPPUNIT_ASSERT(outer != LoopForest::NO_LOOP);
+		CPPUNIT_ASSERT(inner != LoopForest::NO_LOOP);
+		CPPUNIT_ASSERT(outer != inner);
+
+		CPPUNIT_ASSERT_EQUAL(1u, forest.getLoop(outer).getHeader());
+		CPPUNIT_ASSERT_EQUAL(2u, forest.getLoop(inner).getHeader());
+
+		CPPUNIT_ASSERT_EQUAL(1u, forest.getLoop(outer).getDepth());
+		CPPUNIT_ASSERT_EQUAL(2u, forest.getLoop(inner).getDepth());
+		CPPUNIT_ASSERT_EQUAL(outer, forest.getLoop(inner).getParent());
+		CPPUNIT_ASSERT(forest.getLoop(outer).getParent() == LoopForest::NO_LOOP);
+
+		CPPUNIT_ASSERT_EQUAL(outer, forest.getInnermostLoop(4));
+		CPPUNIT_ASSERT(forest.getInnermostLoop(0) == LoopForest::NO_LOOP);
+		CPPUNIT_ASSERT(forest.getInnermostLoop(5) == LoopForest::NO_LOOP);
+
+		CPPUNIT_ASSERT(forest.contains(outer, 3));
+		CPPUNIT_ASSERT(!forest.contains(inner, 4));
+	}
+
+	void testNoLoops()
+	{
+		ProfileMap map;
+
+		createDiamond(map);
+
+		LoopForest forest(map);
+
+		CPPUNIT_ASSERT_EQUAL(0u, forest.getNumberOfLoops());
+	}
+};
+
+class TraceTest : public CppUnit::TestFixture
+{
+public:
+	void setUp() { }
+	void tearDown() { }
+
+	void testVarints()
+	{
+		unsigned long long values[] = { 0, 1, 127, 128, 300, 0xFFFFFFFFULL, 0x100000000ULL, ~0ULL };
+
+		std::vector<unsigned char> data;
+
+		for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		{
+			Trace::appendVarint(data, values[i]);
+		}
+
+		unsigned int position = 0;
+		unsigned long long value;
+
+		for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		{
+			CPPUNIT_ASSERT(Trace::readVarint(data, position, value));
+			CPPUNIT_ASSERT_EQUAL(values[i], value);
+		}
+
+		CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(data.size()), position);
+		CPPUNIT_ASSERT(!Trace::readVarint(data, position, value));
+	}
+
+	void testRepeats()
+	{
+		TraceEncoder encoder;
+
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			encoder.addEvent(3, 1, 100);
+		}
+
+		// Other threads and earlier times end the repeats
+		encoder.addEvent(3, 2, 100);
+		encoder.addEvent(4, 2, 90);
+		encoder.addEvent(4, 2, 90);
+		encoder.finish();
+
+		std::string data(encoder.getData().begin(), encoder.getData().end());
+		std::vector<TraceEvent> events;
+
+		decodeTrace(data, events, 0);
+
+		CPPUNIT_ASSERT_EQUAL(8u, static_cast<unsigned int>(events.size()));
+
+		for (unsigned int i = 0; i < 5; i++)
+		{
+			checkEvent(events[i], 3, 1, 100);
+		}
+
+		checkEvent(events[5], 3, 2, 100);
+		checkEvent(events[6], 4, 2, 90);
+		checkEvent(events[7], 4, 2, 90);
+	}
+
+	void testResume()
+	{
+		TraceEncoder encoder;
+
+		encoder.addEvent(1, 1, 100);
+		encoder.addEvent(2, 1, 110);
+		encoder.finish();
+
+		TraceEncoderState state = encoder.getState();
+
+		std::ostringstream stream;
+
+		encoder.drain(stream);
+
+		// A continued session starts with a new encoder
+		TraceEncoder continued;
+
+		continued.resume(state);
+		continued.addEvent(2, 1, 110);
+		continued.addEvent(3, 1, 500);
+		continued.finish();
+		continued.drain(stream);
+
+		CPPUNIT_ASSERT_EQUAL(4ULL, continued.getNumberOfEvents());
+
+		std::vector<TraceEvent> events;
+		RecordCollector records(events);
+
+		decodeTrace(stream.str(), events, &records);
+
+		CPPUNIT_ASSERT_EQUAL(4u, static_cast<unsigned int>(events.size()));
+
+		checkEvent(events[0], 1, 1, 100);
+		checkEvent(events[1], 2, 1, 110);
+		checkEvent(events[2], 2, 1, 110);
+		checkEvent(events[3], 3, 1, 500);
+
+		CPPUNIT_ASSERT_EQUAL(1u, static_cast<unsigned int>(records.getTypes().size()));
+		CPPUNIT_ASSERT_EQUAL(Trace::EXTENDED_RESUME, records.getTypes()[0]);
+		CPPUNIT_ASSERT_EQUAL(2u, records.getPositions()[0]);
+
+		unsigned long long time = 110;
+
+		CPPUNIT_ASSERT(Trace::isBreak(Trace::EXTENDED_RESUME, std::vector<unsigned char>(), time));
+		CPPUNIT_ASSERT_EQUAL(110ULL, time);
+	}
+};
+
+int main()
+{
+	CppUnit::TestSuite suite;
+
+	suite.addTest(new CppUnit::TestCaller<CounterTest>("Counters of a diamond", &CounterTest::testDiamond));
+	suite.addTest(new CppUnit::TestCaller<CounterTest>("Counters of a loop", &CounterTest::testLoop));
+	suite.addTest(new CppUnit::TestCaller<CounterTest>("Counters around an unmeasurable block", &CounterTest::testUnmeasurableBlock));
+	suite.addTest(new CppUnit::TestCaller<CounterTest>("Counters of uninferable blocks", &CounterTest::testUninferableBlocks));
+	suite.addTest(new CppUnit::TestCaller<PathTest>("Paths of a diamond", &PathTest::testDiamond));
+	suite.addTest(new CppUnit::TestCaller<PathTest>("Paths of a loop", &PathTest::testLoop));
+	suite.addTest(new CppUnit::TestCaller<PathTest>("Paths of nested loops", &PathTest::testNestedLoops));
+	suite.addTest(new CppUnit::TestCaller<LoopTest>("Nested loops", &LoopTest::testNesting));
+	suite.addTest(new CppUnit::TestCaller<LoopTest>("Function without loops", &LoopTest::testNoLoops));
+	suite.addTest(new CppUnit::TestCaller<TraceTest>("Varints", &TraceTest::testVarints));
+	suite.addTest(new CppUnit::TestCaller<TraceTest>("Repeated hits", &TraceTest::testRepeats));
+	suite.addTest(new CppUnit::TestCaller<TraceTest>("Resumed trace", &TraceTest::testResume));
+
+	CppUnit::TestResult controller;
+	CppUnit::TestResultCollector result;
+	CppUnit::BriefTestProgressListener progress;
+
+	controller.addListener(&result);
+	controller.addListener(&progress);
+
+	suite.run(&controller);
+
+	CppUnit::CompilerOutputter outputter(&result, std::cerr);
+
+	outputter.write();
+
+	return result.wasSuccessful() ? 0 : 1;
+}
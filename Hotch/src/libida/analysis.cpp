@@ -0,0 +1,216 @@
+#include "analysis.hpp"
+
+#include <algorithm>
+
+Profile::Profile(const ProfileMap& map) : loopForest(map), loops(loopForest.getNumberOfLoops())
+{
+	blocks.reserve(map.getNumberOfBlocks());
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		blocks.push_back(TimedBlock(map.getBlock(i).getAddress(), map.getBlock(i).getFunction()));
+	}
+
+	functions.reserve(map.getNumberOfFunctions());
+
+	for (unsigned int i = 0; i < map.getNumberOfFunctions(); i++)
+	{
+		functions.push_back(TimedBlock(map.getFunction(i).getAddress(), i));
+	}
+}
+
+std::list<TimedBlock*> Profile::getBlockResults()
+{
+	std::list<TimedBlock*> results;
+
+	for (std::vector<TimedBlock>::iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+	{
+		results.push_back(&*Iter);
+	}
+
+	return results;
+}
+
+std::list<TimedBlock*> Profile::getFunctionResults()
+{
+	std::list<TimedBlock*> results;
+
+	for (std::vector<TimedBlock>::iterator Iter = functions.begin(); Iter != functions.end(); ++Iter)
+	{
+		results.push_back(&*Iter);
+	}
+
+	return results;
+}
+
+void Analyzer::addEvent(const TraceEvent& event)
+{
+	unsigned int currentBlock = event.block;
+	unsigned long long currentTime = event.time;
+
+	// Traces that do not belong to the profile map can reference unknown blocks.
+	if (currentBlock >= profile.getNumberOfBlocks())
+	{
+		return;
+	}
+
+	tracker.addEvent(event);
+	loopProfiler.addEvent(event);
+	contextProfiler.addEvent(event);
+
+	// Increase the hit counter at the basic block defined by the breakpoint.
+	profile.getBlock(currentBlock).hit();
+
+	// If the start of a function is hit, the hit counter of the function increases.
+	if (map.isFunctionStart(currentBlock))
+	{
+		profile.getFunction(map.getBlock(currentBlock).getFunction()).hit();
+	}
+
+	// Skip the time calculation of the first event because we don't know how much time was spent
+	// on this block.
+	if (hasLastEvent)
+	{
+		addElapsedTime(currentTime);
+	}
+
+	hasLastEvent = true;
+
+	lastTime = currentTime;
+	lastBlock = currentBlock;
+	lastThread = event.thread;
+
+	// The CPU time record of the thread comes before its hit
+	std::map<unsigned int, unsigned long long>::const_iterator cpuTime = cpuTimes.find(event.thread);
+
+	hasLastCpuTime = cpuTime != cpuTimes.end();
+	lastCpuTime = hasLastCpuTime ? cpuTime->second : 0;
+}
+
+/**
+* Adds the time from the last event to the given time to the block of the last
+* event and to its function.
+**/
+void Analyzer::addElapsedTime(unsigned long long time)
+{
+	unsigned long long difference = time - lastTime;
+
+	// The time spent between the last breakpoint and the current breakpoint
+	// is added to the block that was hit previously.
+	profile.getBlock(lastBlock).addTime(difference);
+	profile.getBlock(lastBlock).addLatency(difference);
+
+	// The time spent in a function is increased whenever a breakpoint inside a function is followed
+	// by another breakpoint hit (either inside or outside the function).
+	unsigned int lastFunction = map.getBlock(lastBlock).getFunction();
+
+	if (lastFunction != ProfileMap::NO_FUNCTION)
+	{
+		profile.getFunction(lastFunction).addTime(difference);
+	}
+
+	// The same time is split by the CPU time the thread of the last event used up to the given time
+	std::map<unsigned int, unsigned long long>::const_iterator cpuTime = cpuTimes.find(lastThread);
+
+	if (!hasLastCpuTime || cpuTime == cpuTimes.end() || cpuTime->second < lastCpuTime)
+	{
+		return;
+	}
+
+	// Both times are rounded to milliseconds, so the CPU time can run ahead of the wall time
+	unsigned long long onCpu = std::min(cpuTime->second - lastCpuTime, difference);
+
+	profile.getBlock(lastBlock).addCpuTime(onCpu, difference - onCpu);
+
+	if (lastFunction != ProfileMap::NO_FUNCTION)
+	{
+		profile.getFunction(lastFunction).addCpuTime(onCpu, difference - onCpu);
+	}
+}
+
+/**
+* Ends the calls and loops of all threads where the recorded execution was
+* interrupted. The hits behind it start without a last event.
+* @param time The end of the execution before the interruption
+**/
+void Analyzer::interrupt(unsigned long long time)
+{
+	if (hasLastEvent && time > lastTime)
+	{
+		addElapsedTime(time);
+	}
+
+	tracker.finish(time);
+	loopProfiler.reset(time);
+	contextProfiler.reset(time);
+
+	hasLastEvent = false;
+	hasLastCpuTime = false;
+}
+
+void Analyzer::addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+{
+	unsigned long long endTime = lastTime;
+
+	if (Trace::isBreak(type, payload, endTime))
+	{
+		interrupt(endTime);
+
+		return;
+	}
+
+	if (type != Trace::EXTENDED_CPU_TIME)
+	{
+		return;
+	}
+
+	unsigned int position = 0;
+	unsigned long long thread;
+	unsigned long long time;
+
+	if (Trace::readVarint(payload, position, thread) && Trace::readVarint(payload, position, time))
+	{
+		cpuTimes[static_cast<unsigned int>(thread)] = time;
+	}
+}
+
+void Analyzer::finish()
+{
+	tracker.finish();
+}
+
+void Analyzer::enterFunction(unsigned int thread, unsigned int function, unsigned long long)
+{
+	loopProfiler.enterFunction(thread);
+	contextProfiler.enterFunction(thread, function);
+}
+
+void Analyzer::exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time)
+{
+	profile.getFunction(function).addLatency(time - enterTime);
+
+	loopProfiler.exitFunction(thread, time);
+	contextProfiler.exitFunction(thread);
+}
+
+/**
+* Calculates the block/function hits and the time spent in each block/function using the data
+* from the event list.
+**/
+void analyzeEventList(TraceDecoder& decoder, const ProfileMap& map, Profile& profile)
+{
+	Analyzer analyzer(map, profile);
+
+	decoder.setRecordListener(&analyzer);
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		analyzer.addEvent(event);
+	}
+
+	decoder.setRecordListener(0);
+
+	analyzer.finish();
+}
@@ -0,0 +1,180 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "types.hpp"
+#include "callstack.hpp"
+#include "contexts.hpp"
+#include "loops.hpp"
+#include "profilemap.hpp"
+#include "sketch.hpp"
+#include "trace.hpp"
+
+/**
+* Accumulates the hits and the time spent in a block or function.
+**/
+class TimedBlock
+{
+private:
+	address_t address;
+	unsigned int function;
+	unsigned long long accumulatedTime;
+	unsigned long long hits;
+
+	unsigned long long onCpuTime;
+	unsigned long long offCpuTime;
+
+	LatencySketch latency;
+
+public:
+	TimedBlock(address_t address, unsigned int function) : address(address), function(function), accumulatedTime(0), hits(0), onCpuTime(0), offCpuTime(0) { }
+
+	unsigned long long getHits() const
+	{
+		return hits;
+	}
+
+	unsigned long long getTime() const { return accumulatedTime; }
+
+	void hit() { ++hits; }
+
+	void addHits(unsigned long long count) { hits += count; }
+
+	void addTime(unsigned long long time) { accumulatedTime += time; }
+
+	/**
+	* Splits time that was added to the block into the time the thread of the hit
+	* spent on the CPU and the time it waited.
+	**/
+	void addCpuTime(unsigned long long onCpu, unsigned long long offCpu)
+	{
+		onCpuTime += onCpu;
+		offCpuTime += offCpu;
+	}
+
+	unsigned long long getOnCpuTime() const { return onCpuTime; }
+
+	unsigned long long getOffCpuTime() const { return offCpuTime; }
+
+	/**
+	* Adds the duration of a single visit of a block or call of a function.
+	**/
+	void addLatency(unsigned long long time) { latency.add(time); }
+
+	const LatencySketch& getLatency() const { return latency; }
+
+	address_t getAddress() const { return address; }
+
+	/**
+	* Returns the index of the parent function in the profile map.
+	**/
+	unsigned int getFunction() const { return function; }
+};
+
+/**
+* The accumulated results of a profiling run. Blocks and functions have the same
+* indices as in the profile map the results were created for.
+**/
+class Profile
+{
+private:
+	std::vector<TimedBlock> blocks;
+	std::vector<TimedBlock> functions;
+
+	LoopForest loopForest;
+	std::vector<LoopStatistics> loops;
+
+	CallingContextTree contexts;
+
+public:
+	Profile(const ProfileMap& map);
+
+	TimedBlock& getBlock(unsigned int index) { return blocks[index]; }
+
+	TimedBlock& getFunction(unsigned int index) { return functions[index]; }
+
+	unsigned int getNumberOfBlocks() const { return blocks.size(); }
+
+	unsigned int getNumberOfFunctions() const { return functions.size(); }
+
+	const LoopForest& getLoopForest() const { return loopForest; }
+
+	/**
+	* Returns the statistics of each loop of the loop forest.
+	**/
+	std::vector<LoopStatistics>& getLoops() { return loops; }
+
+	CallingContextTree& getContexts() { return contexts; }
+
+	std::list<TimedBlock*> getBlockResults();
+
+	std::list<TimedBlock*> getFunctionResults();
+};
+
+/**
+* Calculates the block/function hits and the time spent in each block/function
+* one event at a time.
+*
+* The latency of a block is the time from one of its hits to the next event. The
+* latency of a function is the time from its entry to its exit, including callees.
+*
+* If the trace has the CPU times of the threads, the time from a hit to the next
+* event is split into the time the thread of the hit ran on the CPU and the time
+* it waited, for example for I/O, a lock or the debugger. The trace has the CPU
+* time of that thread before the next event, so both parts add up to the time of
+* the block. Times whose CPU time is not known are not split.
+*
+* Where an interrupted trace was continued, the calls and loops end at the last
+* event before the interruption. Where a triggered session left its scope, they
+* end at the return of the trigger function. The time up to the next event is
+* not counted in either case.
+**/
+class Analyzer : public CallStackListener, public TraceRecordListener
+{
+private:
+	const ProfileMap& map;
+	Profile& profile;
+
+	CallStackTracker tracker;
+	LoopProfiler loopProfiler;
+	ContextProfiler contextProfiler;
+
+	bool hasLastEvent;
+	unsigned int lastBlock;
+	unsigned long long lastTime;
+	unsigned int lastThread;
+
+	// CPU time of the thread of the last event at that event
+	bool hasLastCpuTime;
+	unsigned long long lastCpuTime;
+
+	// CPU time of each thread from the last CPU time record
+	std::map<unsigned int, unsigned long long> cpuTimes;
+
+	void addElapsedTime(unsigned long long time);
+
+	void interrupt(unsigned long long time);
+
+public:
+	Analyzer(const ProfileMap& map, Profile& profile) : map(map), profile(profile), tracker(map, *this), loopProfiler(profile.getLoopForest(), profile.getLoops()), contextProfiler(profile.getContexts()), hasLastEvent(false), lastBlock(0), lastTime(0), lastThread(0), hasLastCpuTime(false), lastCpuTime(0) { }
+
+	void addEvent(const TraceEvent& event);
+
+	void addRecord(unsigned int type, const std::vector<unsigned char>& payload);
+
+	/**
+	* Completes the calls that are still running at the end of the trace.
+	**/
+	void finish();
+
+	void enterFunction(unsigned int thread, unsigned int function, unsigned long long time);
+
+	void exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time);
+};
+
+void analyzeEventList(TraceDecoder& decoder, const ProfileMap& map, Profile& profile);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BLOCKINDEX_HPP
+#define BLOCKINDEX_HPP
+
+#include <map>
+#include <vector>
+
+#include "types.hpp"
+
+/**
+* Assigns dense indices to the addresses of profiled blocks. Indices are handed out
+* in the order the blocks are added and never change afterwards.
+**/
+class BlockIndex
+{
+private:
+	std::vector<address_t> addresses;
+	std::map<address_t, unsigned int> indices;
+
+public:
+	static const unsigned int INVALID_INDEX = 0xFFFFFFFF;
+
+	/**
+	* Adds a block to the index and returns its index. Adding a block twice returns
+	* the index it got the first time.
+	**/
+	unsigned int addBlock(address_t address)
+	{
+		std::map<address_t, unsigned int>::const_iterator Iter = indices.find(address);
+
+		if (Iter != indices.end())
+		{
+			return Iter->second;
+		}
+
+		unsigned int index = addresses.size();
+
+		addresses.push_back(address);
+		indices[address] = index;
+
+		return index;
+	}
+
+	/**
+	* Returns the index of the block at the given address or INVALID_INDEX.
+	**/
+	unsigned int getIndex(address_t address) const
+	{
+		std::map<address_t, unsigned int>::const_iterator Iter = indices.find(address);
+
+		if (Iter == indices.end())
+		{
+			return INVALID_INDEX;
+		}
+
+		return Iter->second;
+	}
+
+	address_t getAddress(unsigned int index) const { return addresses[index]; }
+
+	unsigned int size() const { return addresses.size(); }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef BREAKPOINTSET_HPP
+#define BREAKPOINTSET_HPP
+
+#include <vector>
+
+#include "types.hpp"
+
+/**
+* The breakpoints that Hotch sets in the target process, kept apart from the
+* breakpoints of the user. Every breakpoint event is checked against the set, so
+* the addresses are kept in an open addressing hash table that answers in
+* constant time without asking the debugger. The addresses are also kept in the
+* order they were added so all breakpoints can be installed and removed at once.
+**/
+class BreakpointSet
+{
+private:
+	enum { EMPTY = 0xFFFFFFFF };
+
+	std::vector<address_t> addresses;
+
+	// Indices into addresses, at most half of the slots are used
+	std::vector<unsigned int> slots;
+	unsigned int bits;
+
+	unsigned int findSlot(address_t address) const
+	{
+		unsigned int mask = slots.size() - 1;
+		unsigned int slot = static_cast<unsigned int>((address * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+
+		while (slots[slot] != EMPTY && addresses[slots[slot]] != address)
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		return slot;
+	}
+
+	void grow()
+	{
+		++bits;
+
+		slots.assign(1u << bits, EMPTY);
+
+		for (unsigned int i = 0; i < addresses.size(); i++)
+		{
+			slots[findSlot(addresses[i])] = i;
+		}
+	}
+
+public:
+	BreakpointSet() : slots(1024, EMPTY), bits(10) { }
+
+	/**
+	* Adds a breakpoint to the set. Returns false if it was already part of it.
+	**/
+	bool add(address_t address)
+	{
+		unsigned int slot = findSlot(address);
+
+		if (slots[slot] != EMPTY)
+		{
+			return false;
+		}
+
+		slots[slot] = addresses.size();
+		addresses.push_back(address);
+
+		if (addresses.size() * 2 > slots.size())
+		{
+			grow();
+		}
+
+		return true;
+	}
+
+	bool contains(address_t address) const { return slots[findSlot(address)] != EMPTY; }
+
+	/**
+	* Returns the breakpoint that was added to the set as the given one.
+	**/
+	address_t getAddress(unsigned int index) const { return addresses[index]; }
+
+	unsigned int size() const { return addresses.size(); }
+
+	void clear()
+	{
+		addresses.clear();
+		slots.assign(1024, EMPTY);
+		bits = 10;
+	}
+};
+
+#endif
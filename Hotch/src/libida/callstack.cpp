@@ -0,0 +1,106 @@
+#include "callstack.hpp"
+
+std::vector<CallFrame>& CallStackTracker::getStack(unsigned int thread)
+{
+	// Thread switches are rare compared to block hits
+	if (lastStack == 0 || thread != lastThread)
+	{
+		lastThread = thread;
+		lastStack = &stacks[thread];
+	}
+
+	return *lastStack;
+}
+
+void CallStackTracker::enter(std::vector<CallFrame>& stack, unsigned int thread, unsigned int function, unsigned long long time)
+{
+	CallFrame frame;
+
+	frame.function = function;
+	frame.enterTime = time;
+
+	stack.push_back(frame);
+
+	listener.enterFunction(thread, function, time);
+}
+
+void CallStackTracker::exit(std::vector<CallFrame>& stack, unsigned int thread, unsigned long long time)
+{
+	CallFrame frame = stack.back();
+
+	stack.pop_back();
+
+	listener.exitFunction(thread, frame.function, frame.enterTime, time);
+}
+
+void CallStackTracker::addEvent(const TraceEvent& event)
+{
+	if (event.block >= map.getNumberOfBlocks())
+	{
+		return;
+	}
+
+	unsigned int function = map.getBlock(event.block).getFunction();
+
+	if (function == ProfileMap::NO_FUNCTION)
+	{
+		return;
+	}
+
+	lastTime = event.time;
+
+	std::vector<CallFrame>& stack = getStack(event.thread);
+
+	if (stack.empty())
+	{
+		enter(stack, event.thread, function, event.time);
+
+		return;
+	}
+
+	if (stack.back().function == function)
+	{
+		return;
+	}
+
+	if (map.isFunctionStart(event.block))
+	{
+		enter(stack, event.thread, function, event.time);
+
+		return;
+	}
+
+	// Look for the function we are returning to
+	std::vector<CallFrame>::size_type frame = stack.size() - 1;
+
+	while (frame != 0 && stack[frame - 1].function != function)
+	{
+		--frame;
+	}
+
+	if (frame == 0)
+	{
+		exit(stack, event.thread, event.time);
+		enter(stack, event.thread, function, event.time);
+
+		return;
+	}
+
+	while (stack.size() > frame)
+	{
+		exit(stack, event.thread, event.time);
+	}
+}
+
+void CallStackTracker::finish(unsigned long long time)
+{
+	for (std::map<unsigned int, std::vector<CallFrame> >::iterator Iter = stacks.begin(); Iter != stacks.end(); ++Iter)
+	{
+		std::vector<CallFrame>& stack = Iter->second;
+
+		while (!stack.empty())
+		{
+			exit(stack, Iter->first, time);
+		}
+	}
+}
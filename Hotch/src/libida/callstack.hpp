@@ -0,0 +1,87 @@
+#ifndef CALLSTACK_HPP
+#define CALLSTACK_HPP
+
+#include <map>
+#include <vector>
+
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* Receives the function entries and exits that a CallStackTracker derives from
+* the block transitions of a trace.
+**/
+class CallStackListener
+{
+public:
+	virtual ~CallStackListener() { }
+
+	virtual void enterFunction(unsigned int thread, unsigned int function, unsigned long long time) = 0;
+
+	/**
+	* @param enterTime The time at which the function was entered
+	* @param time The time at which the function was left
+	**/
+	virtual void exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time) = 0;
+};
+
+/**
+* A function on the call stack of a thread.
+**/
+struct CallFrame
+{
+	unsigned int function;
+	unsigned long long enterTime;
+};
+
+/**
+* Reconstructs the call stack of each thread from the sequence of hit blocks.
+*
+* Hitting the first block of another function is a call. Hitting any other block
+* of a function further down the stack returns to that function. Hitting a block
+* in the middle of a function that is not on the stack replaces the top frame;
+* this happens for tail jumps and for returns to callers that were entered before
+* profiling started. Recursive calls of the current function can not be told apart
+* from jumps back to its first block and are folded into a single frame.
+**/
+class CallStackTracker
+{
+private:
+	const ProfileMap& map;
+	CallStackListener& listener;
+
+	std::map<unsigned int, std::vector<CallFrame> > stacks;
+
+	unsigned int lastThread;
+	std::vector<CallFrame>* lastStack;
+
+	unsigned long long lastTime;
+
+	std::vector<CallFrame>& getStack(unsigned int thread);
+
+	void enter(std::vector<CallFrame>& stack, unsigned int thread, unsigned int function, unsigned long long time);
+	void exit(std::vector<CallFrame>& stack, unsigned int thread, unsigned long long time);
+
+public:
+	CallStackTracker(const ProfileMap& map, CallStackListener& listener) : map(map), listener(listener), lastThread(0), lastStack(0), lastTime(0) { }
+
+	void addEvent(const TraceEvent& event);
+
+	/**
+	* Exits all functions that are still on a stack at the time of the last event.
+	* The tracker starts with empty stacks again afterwards.
+	**/
+	void finish() { finish(lastTime); }
+
+	/**
+	* Exits all functions that are still on a stack at the given time.
+	**/
+	void finish(unsigned long long time);
+
+	/**
+	* Returns the time of the last event of a function.
+	**/
+	unsigned long long getLastTime() const { return lastTime; }
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "checkpoint.hpp"
+
+#include <cstdio>
+#include <sstream>
+
+#include "helpers.hpp"
+
+/**
+* Checkpoints are stored as text files with one record per line. The first
+* word of a line is the record type:
+*
+* HOTCHCHECKPOINT <version>
+* M <mode>                            (the rest of the line)
+* T <trace length> <events> <last block> <last thread> <last time> <has last event>
+* B <address>                         (blocks, in index order)
+* P <address>                         (profiled blocks of a counting session)
+* C <address>                         (measured blocks of a counting session)
+*
+* Lines of unknown record types are ignored.
+**/
+namespace
+{
+	const char* MAGIC = "HOTCHCHECKPOINT";
+	const unsigned int VERSION = 2;
+
+	/**
+	* Reads the header of a checkpoint file.
+	**/
+	bool readHeader(std::istream& file)
+	{
+		std::string line;
+
+		if (!std::getline(file, line))
+		{
+			return false;
+		}
+
+		std::istringstream header(line);
+		std::string magic;
+		unsigned int version = 0;
+
+		return (header >> magic >> version) && magic == MAGIC && version == VERSION;
+	}
+
+	/**
+	* Reads the mode of an M record, which is the rest of the line.
+	**/
+	std::string readModeRecord(std::istream& ss)
+	{
+		std::string mode;
+
+		std::getline(ss >> std::ws, mode);
+
+		return mode;
+	}
+}
+
+bool Checkpointer::hasCheckpoint() const
+{
+	std::ifstream file(checkpointFilename.c_str());
+
+	return file.is_open();
+}
+
+std::string Checkpointer::readMode() const
+{
+	std::ifstream file(checkpointFilename.c_str());
+
+	if (!readHeader(file))
+	{
+		return "";
+	}
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream ss(line);
+		std::string type;
+
+		if ((ss >> type) && type == "M")
+		{
+			return readModeRecord(ss);
+		}
+	}
+
+	return "";
+}
+
+bool Checkpointer::start(TraceEncoder& trace)
+{
+	std::remove(checkpointFilename.c_str());
+
+	traceFile.open(traceFilename.c_str(), std::ios::binary | std::ios::trunc);
+
+	lastCheckpoint = 0;
+
+	return drain(trace);
+}
+
+bool Checkpointer::resume(BlockIndex& blockIndex, TraceEncoder& trace)
+{
+	std::ifstream file(checkpointFilename.c_str());
+
+	if (!readHeader(file))
+	{
+		return false;
+	}
+
+	std::string line;
+
+	bool hasState = false;
+	unsigned long long traceLength = 0;
+	TraceEncoderState state;
+
+	// The session only changes once the whole checkpoint was read
+	BlockIndex restoredIndex;
+	std::string restoredMode;
+	std::vector<address_t> restoredProfiled;
+	std::vector<address_t> restoredMeasured;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream ss(line);
+		std::string type;
+
+		if (!(ss >> type))
+		{
+			continue;
+		}
+
+		if (type == "M")
+		{
+			restoredMode = readModeRecord(ss);
+		}
+		else if (type == "T")
+		{
+			if (!(ss >> traceLength >> state.events >> state.lastBlock >> state.lastThread >> state.lastTime >> state.hasLastEvent))
+			{
+				return false;
+			}
+
+			hasState = true;
+		}
+		else if (type == "B" || type == "P" || type == "C")
+		{
+			address_t address;
+
+			if (!(ss >> std::hex >> address))
+			{
+				return false;
+			}
+
+			if (type == "B")
+			{
+				restoredIndex.addBlock(address);
+			}
+			else
+			{
+				(type == "P" ? restoredProfiled : restoredMeasured).push_back(address);
+			}
+		}
+	}
+
+	if (!hasState || !truncateFile(traceFilename, traceLength))
+	{
+		return false;
+	}
+
+	blockIndex = restoredIndex;
+	mode = restoredMode;
+	profiledBlocks = restoredProfiled;
+	measuredBlocks = restoredMeasured;
+
+	traceFile.open(traceFilename.c_str(), std::ios::binary | std::ios::app);
+
+	trace.resume(state);
+
+	lastCheckpoint = 0;
+
+	return traceFile.good();
+}
+
+/**
+* Appends the data encoded since the last call to the trace file.
+**/
+bool Checkpointer::drain(TraceEncoder& trace)
+{
+	trace.drain(traceFile);
+
+	traceFile.flush();
+
+	return traceFile.good();
+}
+
+bool Checkpointer::write(const BlockIndex& blockIndex, TraceEncoder& trace, unsigned long long time)
+{
+	// Failed checkpoints are not retried before the next interval either
+	lastCheckpoint = time;
+
+	trace.finish();
+
+	if (!drain(trace))
+	{
+		return false;
+	}
+
+	TraceEncoderState state = trace.getState();
+
+	std::string temporaryFilename = checkpointFilename + ".tmp";
+
+	{
+		std::ofstream file(temporaryFilename.c_str());
+
+		file << MAGIC << " " << VERSION << "\n";
+		file << "M " << mode << "\n";
+		file << "T " << static_cast<unsigned long long>(traceFile.tellp()) << " " << state.events << " " << state.lastBlock << " ";
+		file << state.lastThread << " " << state.lastTime << " " << state.hasLastEvent << "\n";
+
+		for (unsigned int i = 0; i < blockIndex.size(); i++)
+		{
+			file << "B " << std::hex << blockIndex.getAddress(i) << std::dec << "\n";
+		}
+
+		for (unsigned int i = 0; i < profiledBlocks.size(); i++)
+		{
+			file << "P " << std::hex << profiledBlocks[i] << std::dec << "\n";
+		}
+
+		for (unsigned int i = 0; i < measuredBlocks.size(); i++)
+		{
+			file << "C " << std::hex << measuredBlocks[i] << std::dec << "\n";
+		}
+
+		file.close();
+
+		if (!file)
+		{
+			return false;
+		}
+	}
+
+	return replaceFile(temporaryFilename, checkpointFilename);
+}
+
+bool Checkpointer::close(TraceEncoder& trace)
+{
+	trace.finish();
+
+	bool written = drain(trace);
+
+	traceFile.close();
+
+	std::remove(checkpointFilename.c_str());
+
+	return written;
+}
@@ -0,0 +1,128 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "blockindex.hpp"
+#include "trace.hpp"
+
+/**
+* Keeps the state of a profiling session on disk so that the session survives
+* a crash of IDA or the debugger.
+*
+* At every checkpoint the events recorded since the last checkpoint are appended
+* to the trace file and the checkpoint file is replaced by one that holds the
+* block index, the state of the trace encoder and the length of the trace file.
+* The checkpoint file is replaced atomically, so after a crash it always matches
+* a complete prefix of the trace file. Events recorded after the last checkpoint
+* are lost.
+*
+* The checkpoint also holds the mode of the session and, for counting sessions,
+* the profiled and the measured blocks, because a trace can only be continued
+* by a session that records the same blocks.
+**/
+class Checkpointer
+{
+private:
+	std::string traceFilename;
+	std::string checkpointFilename;
+
+	std::ofstream traceFile;
+
+	unsigned long long interval;
+	unsigned long long lastCheckpoint;
+
+	std::string mode;
+
+	std::vector<address_t> profiledBlocks;
+	std::vector<address_t> measuredBlocks;
+
+	// Checkpointers own the open trace file
+	Checkpointer(const Checkpointer&);
+	Checkpointer& operator=(const Checkpointer&);
+
+	bool drain(TraceEncoder& trace);
+
+public:
+	/**
+	* @param traceFilename The file the trace is written to
+	* @param checkpointFilename The file the checkpoints are written to
+	* @param interval The minimum time between two checkpoints in milliseconds
+	**/
+	Checkpointer(const std::string& traceFilename, const std::string& checkpointFilename, unsigned long long interval) : traceFilename(traceFilename), checkpointFilename(checkpointFilename), interval(interval), lastCheckpoint(0) { }
+
+	/**
+	* Returns true if a checkpoint of an unfinished session exists.
+	**/
+	bool hasCheckpoint() const;
+
+	/**
+	* Returns the mode of the session of the last checkpoint or an empty string if
+	* the checkpoint can not be read.
+	**/
+	std::string readMode() const;
+
+	/**
+	* Sets the mode of the session, which is written to every checkpoint.
+	**/
+	void setMode(const std::string& mode) { this->mode = mode; }
+
+	const std::string& getMode() const { return mode; }
+
+	/**
+	* Sets the blocks of a counting session, which are written to every checkpoint.
+	* Must be called before the first checkpoint.
+	**/
+	void setCountedBlocks(const std::vector<address_t>& profiled, const std::vector<address_t>& measured)
+	{
+		profiledBlocks = profiled;
+		measuredBlocks = measured;
+	}
+
+	/**
+	* Returns the profiled blocks of a counting session that was set or resumed.
+	**/
+	const std::vector<address_t>& getProfiledBlocks() const { return profiledBlocks; }
+
+	/**
+	* Returns the measured blocks of a counting session that was set or resumed.
+	**/
+	const std::vector<address_t>& getMeasuredBlocks() const { return measuredBlocks; }
+
+	/**
+	* Starts a new session with an empty trace file. The checkpoint of an
+	* interrupted session is removed because its trace is gone.
+	**/
+	bool start(TraceEncoder& trace);
+
+	/**
+	* Continues the session of the last checkpoint. Restores the block index, the
+	* trace encoder, the mode and the blocks of a counting session and cuts off the
+	* events that were written after the checkpoint. Nothing is changed if the
+	* checkpoint can not be read.
+	**/
+	bool resume(BlockIndex& blockIndex, TraceEncoder& trace);
+
+	/**
+	* Returns true if the last checkpoint is older than the checkpoint interval.
+	**/
+	bool isDue(unsigned long long time) const { return time - lastCheckpoint >= interval; }
+
+	/**
+	* Writes a checkpoint.
+	* @param time The current time in milliseconds
+	**/
+	bool write(const BlockIndex& blockIndex, TraceEncoder& trace, unsigned long long time);
+
+	/**
+	* Writes the rest of the trace and ends the session. The checkpoint is removed
+	* because the trace file is complete.
+	**/
+	bool close(TraceEncoder& trace);
+
+	const std::string& getTraceFilename() const { return traceFilename; }
+};
+
+#endif
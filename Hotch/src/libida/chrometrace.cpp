@@ -0,0 +1,89 @@
+#include "chrometrace.hpp"
+
+#include "helpers.hpp"
+
+namespace
+{
+	/**
+	* Ends the spans that are open where an interrupted trace was continued or a
+	* triggered session left its scope, so that no span covers the time between.
+	**/
+	class BreakReader : public TraceRecordListener
+	{
+	private:
+		CallStackTracker& tracker;
+
+	public:
+		BreakReader(CallStackTracker& tracker) : tracker(tracker) { }
+
+		void addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+		{
+			unsigned long long time = tracker.getLastTime();
+
+			if (Trace::isBreak(type, payload, time))
+			{
+				tracker.finish(time);
+			}
+		}
+	};
+}
+
+ChromeTraceWriter::ChromeTraceWriter(const ProfileMap& map, std::ostream& stream) : map(map), stream(stream), spans(0), firstEvent(true)
+{
+	stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+}
+
+void ChromeTraceWriter::writeEvent(const char* phase, unsigned int thread, unsigned int function, unsigned long long time)
+{
+	stream << (firstEvent ? "\n" : ",\n");
+
+	firstEvent = false;
+
+	stream << "{\"name\":";
+	writeJsonString(stream, map.getFunctionName(function));
+	stream << ",\"ph\":\"" << phase << "\",\"ts\":" << time * 1000 << ",\"pid\":1,\"tid\":" << thread << "}";
+}
+
+void ChromeTraceWriter::enterFunction(unsigned int thread, unsigned int function, unsigned long long time)
+{
+	writeEvent("B", thread, function, time);
+
+	++spans;
+}
+
+void ChromeTraceWriter::exitFunction(unsigned int thread, unsigned int function, unsigned long long, unsigned long long time)
+{
+	writeEvent("E", thread, function, time);
+}
+
+void ChromeTraceWriter::finish()
+{
+	stream << "\n]}\n";
+}
+
+/**
+* Exports the function spans of a trace as trace-event JSON.
+* @return The number of exported spans
+**/
+unsigned long long exportChromeTrace(TraceDecoder& decoder, const ProfileMap& map, std::ostream& stream)
+{
+	ChromeTraceWriter writer(map, stream);
+	CallStackTracker tracker(map, writer);
+	BreakReader reader(tracker);
+
+	decoder.setRecordListener(&reader);
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		tracker.addEvent(event);
+	}
+
+	decoder.setRecordListener(0);
+
+	tracker.finish();
+	writer.finish();
+
+	return writer.getNumberOfSpans();
+}
@@ -0,0 +1,43 @@
+#ifndef CHROMETRACE_HPP
+#define CHROMETRACE_HPP
+
+#include <ostream>
+
+#include "callstack.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* Writes function entries and exits as trace-event JSON that timeline viewers like
+* chrome://tracing or Perfetto can open. Every span is written as soon as it
+* is known, so the size of the exported trace does not matter.
+**/
+class ChromeTraceWriter : public CallStackListener
+{
+private:
+	const ProfileMap& map;
+	std::ostream& stream;
+
+	unsigned long long spans;
+	bool firstEvent;
+
+	void writeEvent(const char* phase, unsigned int thread, unsigned int function, unsigned long long time);
+
+public:
+	ChromeTraceWriter(const ProfileMap& map, std::ostream& stream);
+
+	void enterFunction(unsigned int thread, unsigned int function, unsigned long long time);
+
+	void exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time);
+
+	/**
+	* Closes the JSON document.
+	**/
+	void finish();
+
+	unsigned long long getNumberOfSpans() const { return spans; }
+};
+
+unsigned long long exportChromeTrace(TraceDecoder& decoder, const ProfileMap& map, std::ostream& stream);
+
+#endif
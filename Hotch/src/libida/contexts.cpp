@@ -0,0 +1,237 @@
+#include "contexts.hpp"
+
+#include <algorithm>
+#include <string>
+
+// The constants are passed by reference to container functions
+const unsigned int CallingContextTree::ROOT;
+const unsigned int CallingContextTree::NO_NODE;
+
+CallingContextTree::CallingContextTree(unsigned int maximumDepth, unsigned int maximumNodes) : maximumDepth(maximumDepth), maximumNodes(maximumNodes), droppedContexts(0), children(1024, NO_NODE)
+{
+	ContextNode root;
+
+	root.function = ProfileMap::NO_FUNCTION;
+	root.parent = NO_NODE;
+	root.firstChild = NO_NODE;
+	root.nextSibling = NO_NODE;
+	root.depth = 0;
+	root.hits = 0;
+	root.time = 0;
+
+	nodes.push_back(root);
+}
+
+unsigned int CallingContextTree::enter(unsigned int node, unsigned int function)
+{
+	// Recursive calls return to the context of the earlier call
+	for (unsigned int ancestor = node; ancestor != ROOT; ancestor = nodes[ancestor].parent)
+	{
+		if (nodes[ancestor].function == function)
+		{
+			++nodes[ancestor].hits;
+
+			return ancestor;
+		}
+	}
+
+	unsigned int slot = findSlot(node, function);
+
+	if (children[slot] != NO_NODE)
+	{
+		++nodes[children[slot]].hits;
+
+		return children[slot];
+	}
+
+	if (nodes[node].depth >= maximumDepth || nodes.size() >= maximumNodes)
+	{
+		++droppedContexts;
+
+		return node;
+	}
+
+	ContextNode child;
+
+	child.function = function;
+	child.parent = node;
+	child.firstChild = NO_NODE;
+	child.nextSibling = nodes[node].firstChild;
+	child.depth = nodes[node].depth + 1;
+	child.hits = 1;
+	child.time = 0;
+
+	unsigned int index = nodes.size();
+
+	nodes.push_back(child);
+	nodes[node].firstChild = index;
+
+	children[slot] = index;
+
+	// Keep the table at most half full
+	if (nodes.size() * 2 > children.size())
+	{
+		growChildren();
+	}
+
+	return index;
+}
+
+/**
+* Returns the slot of the child table that holds the child of a node that belongs
+* to the given function, or the empty slot where it belongs.
+**/
+unsigned int CallingContextTree::findSlot(unsigned int parent, unsigned int function) const
+{
+	unsigned int mask = children.size() - 1;
+	unsigned int slot = ((parent * 0x9E3779B1u) ^ (function * 0x85EBCA6Bu)) & mask;
+
+	while (children[slot] != NO_NODE && (nodes[children[slot]].parent != parent || nodes[children[slot]].function != function))
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+/**
+* Doubles the size of the child table.
+**/
+void CallingContextTree::growChildren()
+{
+	children.assign(children.size() * 2, NO_NODE);
+
+	for (unsigned int i = ROOT + 1; i < nodes.size(); i++)
+	{
+		children[findSlot(nodes[i].parent, nodes[i].function)] = i;
+	}
+}
+
+std::vector<unsigned long long> CallingContextTree::getInclusiveTimes() const
+{
+	std::vector<unsigned long long> times(nodes.size());
+
+	// Children are always created after their parents
+	for (unsigned int i = nodes.size(); i-- != 0; )
+	{
+		times[i] += nodes[i].time;
+
+		if (i != ROOT)
+		{
+			times[nodes[i].parent] += times[i];
+		}
+	}
+
+	return times;
+}
+
+std::vector<unsigned int>& ContextProfiler::getStack(unsigned int thread)
+{
+	if (lastStack == 0 || thread != lastThread)
+	{
+		lastThread = thread;
+		lastStack = &stacks[thread];
+	}
+
+	return *lastStack;
+}
+
+void ContextProfiler::addEvent(const TraceEvent& event)
+{
+	if (hasLastEvent)
+	{
+		tree.addTime(lastNode, event.time - lastTime);
+	}
+
+	std::vector<unsigned int>& stack = getStack(event.thread);
+
+	hasLastEvent = true;
+	lastNode = stack.empty() ? CallingContextTree::ROOT : stack.back();
+	lastTime = event.time;
+}
+
+void ContextProfiler::enterFunction(unsigned int thread, unsigned int function)
+{
+	std::vector<unsigned int>& stack = getStack(thread);
+
+	stack.push_back(tree.enter(stack.empty() ? CallingContextTree::ROOT : stack.back(), function));
+}
+
+void ContextProfiler::exitFunction(unsigned int thread)
+{
+	getStack(thread).pop_back();
+}
+
+void ContextProfiler::reset(unsigned long long time)
+{
+	if (hasLastEvent && time > lastTime)
+	{
+		tree.addTime(lastNode, time - lastTime);
+	}
+
+	stacks.clear();
+	lastStack = 0;
+
+	hasLastEvent = false;
+}
+
+void writeFoldedContexts(std::ostream& stream, const ProfileMap& map, const CallingContextTree& tree, unsigned int maximumDepth, double minimumFraction)
+{
+	std::vector<unsigned long long> inclusiveTimes = tree.getInclusiveTimes();
+
+	unsigned long long minimumTime = static_cast<unsigned long long>(inclusiveTimes[CallingContextTree::ROOT] * minimumFraction);
+
+	std::vector<std::string> path;
+	std::vector<unsigned int> stack(1, CallingContextTree::ROOT);
+
+	while (!stack.empty())
+	{
+		unsigned int node = stack.back();
+
+		stack.pop_back();
+
+		const ContextNode& context = tree.getNode(node);
+
+		if (node != CallingContextTree::ROOT)
+		{
+			std::string name = map.getFunctionName(context.function);
+
+			std::replace(name.begin(), name.end(), ';', ':');
+
+			path.resize(context.depth - 1);
+			path.push_back(name);
+		}
+
+		// The time of pruned callees stays with this context
+		unsigned long long time = context.time;
+
+		for (unsigned int child = context.firstChild; child != CallingContextTree::NO_NODE; child = tree.getNode(child).nextSibling)
+		{
+			if (tree.getNode(child).depth > maximumDepth || inclusiveTimes[child] == 0 || inclusiveTimes[child] < minimumTime)
+			{
+				time += inclusiveTimes[child];
+			}
+			else
+			{
+				stack.push_back(child);
+			}
+		}
+
+		if (time == 0)
+		{
+			continue;
+		}
+
+		if (node == CallingContextTree::ROOT)
+		{
+			stream << "[other]";
+		}
+
+		for (std::vector<std::string>::const_iterator Iter = path.begin(); Iter != path.end(); ++Iter)
+		{
+			stream << (Iter == path.begin() ? "" : ";") << *Iter;
+		}
+
+		stream << " " << time << "\n";
+	}
+}
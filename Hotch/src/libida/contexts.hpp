@@ -0,0 +1,137 @@
+#ifndef CONTEXTS_HPP
+#define CONTEXTS_HPP
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* A calling context: a function together with the chain of calls that led to it.
+* The children of a node form a singly linked list through nextSibling.
+**/
+struct ContextNode
+{
+	unsigned int function;
+	unsigned int parent;
+	unsigned int firstChild;
+	unsigned int nextSibling;
+	unsigned int depth;
+
+	// Number of calls that entered the context
+	unsigned long long hits;
+
+	// Time spent in the context, excluding its callees
+	unsigned long long time;
+};
+
+/**
+* Tree of the call paths of a profiling run. All nodes live in a single arena and
+* refer to each other by index. The children of a node are found through a hash
+* table keyed by parent and function, so a node costs at most 48 bytes and calls
+* from a node with many callees are as fast as from any other node.
+*
+* The size of the tree is bounded. Calling a function that is already on the call
+* path returns to the context of its earlier call, so recursion of any kind does
+* not make the tree deeper. Calls beyond the maximum depth, and new contexts once
+* the arena is full, stay in the context of the caller.
+**/
+class CallingContextTree
+{
+private:
+	std::vector<ContextNode> nodes;
+
+	unsigned int maximumDepth;
+	unsigned int maximumNodes;
+
+	unsigned long long droppedContexts;
+
+	// Open addressing hash table of the nodes by parent and function
+	std::vector<unsigned int> children;
+
+	unsigned int findSlot(unsigned int parent, unsigned int function) const;
+	void growChildren();
+
+public:
+	static const unsigned int ROOT = 0;
+	static const unsigned int NO_NODE = 0xFFFFFFFF;
+
+	CallingContextTree(unsigned int maximumDepth = 256, unsigned int maximumNodes = 256 * 1024);
+
+	/**
+	* Returns the context that is entered by calling a function from a context and
+	* counts the call.
+	**/
+	unsigned int enter(unsigned int node, unsigned int function);
+
+	void addTime(unsigned int node, unsigned long long time) { nodes[node].time += time; }
+
+	const ContextNode& getNode(unsigned int node) const { return nodes[node]; }
+
+	unsigned int getNumberOfNodes() const { return nodes.size(); }
+
+	/**
+	* Returns the number of calls whose context was not created because of the
+	* depth or size limit.
+	**/
+	unsigned long long getNumberOfDroppedContexts() const { return droppedContexts; }
+
+	/**
+	* Returns the time spent in each context including its callees.
+	**/
+	std::vector<unsigned long long> getInclusiveTimes() const;
+};
+
+/**
+* Follows the calling context of each thread one event at a time. The time from
+* one event to the next is added to the context of the earlier event.
+*
+* The function entries and exits of a CallStackTracker must be passed on before
+* the event that caused them.
+**/
+class ContextProfiler
+{
+private:
+	CallingContextTree& tree;
+
+	std::map<unsigned int, std::vector<unsigned int> > stacks;
+
+	unsigned int lastThread;
+	std::vector<unsigned int>* lastStack;
+
+	bool hasLastEvent;
+	unsigned int lastNode;
+	unsigned long long lastTime;
+
+	std::vector<unsigned int>& getStack(unsigned int thread);
+
+public:
+	ContextProfiler(CallingContextTree& tree) : tree(tree), lastThread(0), lastStack(0), hasLastEvent(false), lastNode(CallingContextTree::ROOT), lastTime(0) { }
+
+	void addEvent(const TraceEvent& event);
+
+	void enterFunction(unsigned int thread, unsigned int function);
+
+	void exitFunction(unsigned int thread);
+
+	/**
+	* Adds the time up to the given time to the context of the last event. Then
+	* forgets the call stacks and the last event, so that the time up to the next
+	* event is not added to any context.
+	**/
+	void reset(unsigned long long time);
+};
+
+/**
+* Writes the calling contexts in the folded stack format of flame graph tools: one
+* line per context with the functions of the call path separated by semicolons,
+* followed by the time spent in the context.
+* @param maximumDepth Contexts deeper than this are merged into their ancestor
+* @param minimumFraction Contexts that take less than this fraction of the total
+* time, including their callees, are merged into their caller
+**/
+void writeFoldedContexts(std::ostream& stream, const ProfileMap& map, const CallingContextTree& tree, unsigned int maximumDepth = 64, double minimumFraction = 0.001);
+
+#endif
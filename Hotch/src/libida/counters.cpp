@@ -0,0 +1,528 @@
+#include "counters.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "loops.hpp"
+
+namespace
+{
+	// Node of the callers of a function in its flow graph
+	const unsigned int CALLERS = 0;
+
+	/**
+	* The control flow of a function as a flow network. Node i + 1 stands for the
+	* block blocks[i] and node CALLERS for the callers of the function.
+	**/
+	struct FlowGraph
+	{
+		std::vector<unsigned int> blocks;
+		std::vector<std::pair<unsigned int, unsigned int> > edges;
+
+		// The edge from the callers to the first block
+		unsigned int entryEdge;
+	};
+
+	/**
+	* Solves the flow equations of a flow graph. The unknowns are the counts of all
+	* edges and nodes; every node has one equation for the edges that enter it and
+	* one for the edges that leave it. Whenever an equation has a single unknown
+	* left, it is solved, which may leave other equations with a single unknown.
+	**/
+	class FlowSolver
+	{
+	private:
+		struct Equation
+		{
+			// Unknowns with their coefficients, all terms add up to 0
+			std::vector<std::pair<unsigned int, int> > terms;
+
+			unsigned int unknowns;
+			long long sum;
+		};
+
+		unsigned int edges;
+
+		std::vector<Equation> equations;
+
+		// The equations each unknown appears in
+		std::vector<std::vector<unsigned int> > uses;
+
+		std::vector<bool> known;
+		std::vector<long long> values;
+
+		std::vector<unsigned int> worklist;
+
+		void addTerm(unsigned int equation, unsigned int unknown, int coefficient)
+		{
+			equations[equation].terms.push_back(std::make_pair(unknown, coefficient));
+			++equations[equation].unknowns;
+
+			uses[unknown].push_back(equation);
+		}
+
+		void setValue(unsigned int unknown, long long value)
+		{
+			known[unknown] = true;
+			values[unknown] = value;
+
+			for (std::vector<unsigned int>::const_iterator Iter = uses[unknown].begin(); Iter != uses[unknown].end(); ++Iter)
+			{
+				Equation& equation = equations[*Iter];
+
+				for (std::vector<std::pair<unsigned int, int> >::const_iterator Term = equation.terms.begin(); Term != equation.terms.end(); ++Term)
+				{
+					if (Term->first == unknown)
+					{
+						equation.sum += value * Term->second;
+						--equation.unknowns;
+
+						break;
+					}
+				}
+
+				if (equation.unknowns == 1)
+				{
+					worklist.push_back(*Iter);
+				}
+			}
+		}
+
+	public:
+		FlowSolver(const FlowGraph& graph) : edges(graph.edges.size())
+		{
+			unsigned int nodes = graph.blocks.size() + 1;
+
+			Equation empty;
+
+			empty.unknowns = 0;
+			empty.sum = 0;
+
+			equations.assign(nodes * 2, empty);
+			uses.resize(edges + nodes);
+			known.resize(edges + nodes);
+			values.resize(edges + nodes);
+
+			for (unsigned int i = 0; i < edges; i++)
+			{
+				addTerm(graph.edges[i].second * 2, i, 1);
+				addTerm(graph.edges[i].first * 2 + 1, i, 1);
+			}
+
+			for (unsigned int node = 0; node < nodes; node++)
+			{
+				addTerm(node * 2, edges + node, -1);
+				addTerm(node * 2 + 1, edges + node, -1);
+			}
+		}
+
+		/**
+		* Sets the count of a node. The equations are solved by solve().
+		**/
+		void setNode(unsigned int node, long long count)
+		{
+			if (!known[edges + node])
+			{
+				setValue(edges + node, count);
+			}
+		}
+
+		/**
+		* Solves all equations that can be solved with the known counts.
+		**/
+		void solve()
+		{
+			while (!worklist.empty())
+			{
+				Equation& equation = equations[worklist.back()];
+
+				worklist.pop_back();
+
+				if (equation.unknowns != 1)
+				{
+					continue;
+				}
+
+				for (std::vector<std::pair<unsigned int, int> >::const_iterator Iter = equation.terms.begin(); Iter != equation.terms.end(); ++Iter)
+				{
+					if (!known[Iter->first])
+					{
+						setValue(Iter->first, -equation.sum * Iter->second);
+
+						break;
+					}
+				}
+			}
+		}
+
+		bool isNodeKnown(unsigned int node) const { return known[edges + node]; }
+
+		long long getNode(unsigned int node) const { return values[edges + node]; }
+
+		bool isEdgeKnown(unsigned int edge) const { return known[edge]; }
+
+		long long getEdge(unsigned int edge) const { return values[edge]; }
+	};
+
+	/**
+	* Returns the blocks of each function.
+	**/
+	std::vector<std::vector<unsigned int> > getFunctionBlocks(const ProfileMap& map)
+	{
+		std::vector<std::vector<unsigned int> > functionBlocks(map.getNumberOfFunctions());
+
+		for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+		{
+			if (map.getBlock(i).getFunction() != ProfileMap::NO_FUNCTION)
+			{
+				functionBlocks[map.getBlock(i).getFunction()].push_back(i);
+			}
+		}
+
+		return functionBlocks;
+	}
+
+	/**
+	* Creates the flow graph of a function. Blocks without successors return to the
+	* callers and blocks without predecessors are entered by them.
+	* @param nodes Receives the node of each block of the function
+	* @return False if the first block of the function is not part of the map
+	**/
+	bool createFlowGraph(const ProfileMap& map, unsigned int function, const std::vector<unsigned int>& blocks, std::vector<unsigned int>& nodes, FlowGraph& graph)
+	{
+		unsigned int entry = map.findBlock(map.getFunction(function).getAddress());
+
+		if (entry == BlockIndex::INVALID_INDEX || map.getBlock(entry).getFunction() != function)
+		{
+			return false;
+		}
+
+		graph.blocks = blocks;
+
+		for (unsigned int i = 0; i < blocks.size(); i++)
+		{
+			nodes[blocks[i]] = i + 1;
+		}
+
+		std::vector<bool> hasPredecessors(blocks.size() + 1);
+
+		graph.entryEdge = 0;
+		graph.edges.push_back(std::make_pair(CALLERS, nodes[entry]));
+
+		hasPredecessors[nodes[entry]] = true;
+
+		for (unsigned int i = 0; i < blocks.size(); i++)
+		{
+			const std::vector<unsigned int>& successors = map.getSuccessors(blocks[i]);
+
+			for (std::vector<unsigned int>::const_iterator Iter = successors.begin(); Iter != successors.end(); ++Iter)
+			{
+				if (map.getBlock(*Iter).getFunction() == function)
+				{
+					graph.edges.push_back(std::make_pair(i + 1, nodes[*Iter]));
+
+					hasPredecessors[nodes[*Iter]] = true;
+				}
+			}
+
+			if (successors.empty())
+			{
+				graph.edges.push_back(std::make_pair(i + 1, CALLERS));
+			}
+		}
+
+		for (unsigned int node = 1; node <= blocks.size(); node++)
+		{
+			if (!hasPredecessors[node])
+			{
+				graph.edges.push_back(std::make_pair(CALLERS, node));
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	* Checks whether all block counts of a flow graph that can be measured follow
+	* from the counts of the measured blocks.
+	* @param unmeasurable For each node, true if it can not be measured
+	**/
+	bool isComplete(const FlowGraph& graph, const std::vector<bool>& measured, const std::vector<bool>& unmeasurable)
+	{
+		FlowSolver solver(graph);
+
+		for (unsigned int node = 1; node <= graph.blocks.size(); node++)
+		{
+			if (measured[node])
+			{
+				solver.setNode(node, 0);
+			}
+		}
+
+		solver.solve();
+
+		for (unsigned int node = 1; node <= graph.blocks.size(); node++)
+		{
+			if (!unmeasurable[node] && !solver.isNodeKnown(node))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	* Sorts blocks by the estimated cost of a breakpoint on them, which grows with
+	* the depth of the loops they are in.
+	**/
+	class CostOrder
+	{
+	private:
+		const std::vector<unsigned int>& depths;
+
+	public:
+		CostOrder(const std::vector<unsigned int>& depths) : depths(depths) { }
+
+		bool operator()(unsigned int lhs, unsigned int rhs) const
+		{
+			return depths[lhs] < depths[rhs];
+		}
+	};
+
+	/**
+	* Returns the nodes of a flow graph that must be measured. Cheap blocks are
+	* measured until the counts of all blocks are known; then the measured blocks
+	* that are not needed are dropped again, the most expensive ones first.
+	* @param depths The loop depth of each node
+	* @param unmeasurable For each node, true if it can not be measured
+	**/
+	std::vector<bool> placeFunctionCounters(const FlowGraph& graph, const std::vector<unsigned int>& depths, const std::vector<bool>& unmeasurable)
+	{
+		std::vector<unsigned int> candidates;
+
+		for (unsigned int node = 1; node <= graph.blocks.size(); node++)
+		{
+			if (!unmeasurable[node])
+			{
+				candidates.push_back(node);
+			}
+		}
+
+		std::stable_sort(candidates.begin(), candidates.end(), CostOrder(depths));
+
+		std::vector<bool> measured(graph.blocks.size() + 1);
+		std::vector<unsigned int> measuredNodes;
+
+		FlowSolver solver(graph);
+
+		for (std::vector<unsigned int>::const_iterator Iter = candidates.begin(); Iter != candidates.end(); ++Iter)
+		{
+			if (!solver.isNodeKnown(*Iter))
+			{
+				solver.setNode(*Iter, 0);
+				solver.solve();
+
+				measured[*Iter] = true;
+				measuredNodes.push_back(*Iter);
+			}
+		}
+
+		for (std::vector<unsigned int>::const_reverse_iterator Iter = measuredNodes.rbegin(); Iter != measuredNodes.rend(); ++Iter)
+		{
+			measured[*Iter] = false;
+
+			if (!isComplete(graph, measured, unmeasurable))
+			{
+				measured[*Iter] = true;
+			}
+		}
+
+		return measured;
+	}
+
+	/**
+	* Infers the counts of the blocks of a function from its measured blocks.
+	* @return The number of blocks of the function whose counts could not be inferred
+	**/
+	unsigned int inferFunctionCounts(const ProfileMap& map, const FlowGraph& graph, std::vector<unsigned long long>& blockHits, unsigned long long& calls)
+	{
+		FlowSolver solver(graph);
+
+		for (unsigned int node = 1; node <= graph.blocks.size(); node++)
+		{
+			if (map.getBlock(graph.blocks[node - 1]).isMeasured())
+			{
+				solver.setNode(node, static_cast<long long>(blockHits[graph.blocks[node - 1]]));
+			}
+		}
+
+		solver.solve();
+
+		unsigned int unresolved = 0;
+
+		for (unsigned int node = 1; node <= graph.blocks.size(); node++)
+		{
+			if (!solver.isNodeKnown(node))
+			{
+				++unresolved;
+			}
+
+			// Counts that do not add up because control left a function unseen are cut off at 0
+			blockHits[graph.blocks[node - 1]] = solver.isNodeKnown(node) ? static_cast<unsigned long long>(std::max(solver.getNode(node), 0LL)) : 0;
+		}
+
+		calls = solver.isEdgeKnown(graph.entryEdge) ? static_cast<unsigned long long>(std::max(solver.getEdge(graph.entryEdge), 0LL)) : 0;
+
+		return unresolved;
+	}
+
+	/**
+	* Adds the block hits of the extended records of a trace to the hits of the events.
+	**/
+	class BlockHitReader : public TraceRecordListener
+	{
+	private:
+		std::vector<unsigned long long>& blockHits;
+
+	public:
+		BlockHitReader(std::vector<unsigned long long>& blockHits) : blockHits(blockHits) { }
+
+		void addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+		{
+			if (type != Trace::EXTENDED_BLOCK_HITS)
+			{
+				return;
+			}
+
+			unsigned int position = 0;
+			unsigned long long block;
+			unsigned long long hits;
+
+			while (Trace::readVarint(payload, position, block) && Trace::readVarint(payload, position, hits))
+			{
+				if (block < blockHits.size())
+				{
+					blockHits[static_cast<unsigned int>(block)] += hits;
+				}
+			}
+		}
+	};
+}
+
+unsigned int placeCounters(ProfileMap& map, const std::vector<bool>& unmeasurable)
+{
+	std::vector<std::vector<unsigned int> > functionBlocks = getFunctionBlocks(map);
+	std::vector<unsigned int> nodes(map.getNumberOfBlocks());
+
+	LoopForest forest(map);
+
+	for (unsigned int function = 0; function < map.getNumberOfFunctions(); function++)
+	{
+		const std::vector<unsigned int>& blocks = functionBlocks[function];
+
+		FlowGraph graph;
+
+		if (!createFlowGraph(map, function, blocks, nodes, graph))
+		{
+			for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+			{
+				if (!unmeasurable[*Iter])
+				{
+					map.setMeasured(*Iter);
+				}
+			}
+
+			continue;
+		}
+
+		std::vector<unsigned int> depths(blocks.size() + 1);
+		std::vector<bool> unmeasurableNodes(blocks.size() + 1);
+
+		for (unsigned int i = 0; i < blocks.size(); i++)
+		{
+			unsigned int loop = forest.getInnermostLoop(blocks[i]);
+
+			depths[i + 1] = loop == LoopForest::NO_LOOP ? 0 : forest.getLoop(loop).getDepth();
+			unmeasurableNodes[i + 1] = unmeasurable[blocks[i]];
+		}
+
+		std::vector<bool> measured = placeFunctionCounters(graph, depths, unmeasurableNodes);
+
+		for (unsigned int i = 0; i < blocks.size(); i++)
+		{
+			if (measured[i + 1])
+			{
+				map.setMeasured(blocks[i]);
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		if (map.getBlock(i).getFunction() == ProfileMap::NO_FUNCTION && !unmeasurable[i])
+		{
+			map.setMeasured(i);
+		}
+	}
+
+	return map.getNumberOfMeasuredBlocks();
+}
+
+unsigned int inferCounts(const ProfileMap& map, std::vector<unsigned long long>& blockHits, std::vector<unsigned long long>& calls)
+{
+	std::vector<std::vector<unsigned int> > functionBlocks = getFunctionBlocks(map);
+	std::vector<unsigned int> nodes(map.getNumberOfBlocks());
+
+	unsigned int unresolved = 0;
+
+	calls.assign(map.getNumberOfFunctions(), 0);
+
+	for (unsigned int function = 0; function < map.getNumberOfFunctions(); function++)
+	{
+		FlowGraph graph;
+
+		if (createFlowGraph(map, function, functionBlocks[function], nodes, graph))
+		{
+			unresolved += inferFunctionCounts(map, graph, blockHits, calls[function]);
+		}
+	}
+
+	return unresolved;
+}
+
+unsigned int analyzeCounts(TraceDecoder& decoder, const ProfileMap& map, Profile& profile)
+{
+	std::vector<unsigned long long> blockHits(map.getNumberOfBlocks());
+	std::vector<unsigned long long> calls;
+
+	BlockHitReader reader(blockHits);
+
+	decoder.setRecordListener(&reader);
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		if (event.block < blockHits.size())
+		{
+			++blockHits[event.block];
+		}
+	}
+
+	decoder.setRecordListener(0);
+
+	unsigned int unresolved = inferCounts(map, blockHits, calls);
+
+	for (unsigned int i = 0; i < profile.getNumberOfBlocks(); i++)
+	{
+		profile.getBlock(i).addHits(blockHits[i]);
+	}
+
+	for (unsigned int i = 0; i < profile.getNumberOfFunctions(); i++)
+	{
+		profile.getFunction(i).addHits(calls[i]);
+	}
+
+	return unresolved;
+}
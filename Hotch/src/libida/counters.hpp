@@ -0,0 +1,53 @@
+#ifndef COUNTERS_HPP
+#define COUNTERS_HPP
+
+#include <vector>
+
+#include "analysis.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* Marks the blocks of a profile map whose hits must be counted so that the hits of
+* all other blocks can be inferred from the control flow edges.
+*
+* Every block passes on as many executions as it receives. A virtual node for the
+* callers of a function enters its first block and the blocks without predecessors
+* and is returned to from the blocks without successors, so the blocks and edges
+* of a function form a system of flow equations. Blocks are measured in the order
+* of their loop depth, cheapest first, until the equations determine all blocks;
+* measured blocks that the others already determine are then dropped again, most
+* expensive first. Blocks outside of functions are always measured.
+*
+* Blocks that can not be measured stay nodes of the equations, so the edges into
+* and out of them still count, but they are never measured themselves. Their hits
+* are inferred where the other blocks determine them.
+*
+* The inferred counts are only exact if control enters and leaves functions as
+* the edges of the map say; exceptions and jumps into other functions are missed.
+*
+* @param unmeasurable For each block of the map, true if it can not be measured,
+* for example because the user already set a breakpoint on it
+* @return The number of measured blocks
+**/
+unsigned int placeCounters(ProfileMap& map, const std::vector<bool>& unmeasurable);
+
+/**
+* Infers the hits of all blocks and the calls of all functions of a counting session
+* from the hits of its measured blocks.
+* @param blockHits The hits of the measured blocks; receives the hits of all blocks
+* @param calls Receives the number of calls of each function
+* @return The number of blocks whose hits could not be inferred
+**/
+unsigned int inferCounts(const ProfileMap& map, std::vector<unsigned long long>& blockHits, std::vector<unsigned long long>& calls);
+
+/**
+* Fills a profile with the hits of the blocks and functions of a counting session.
+* The breakpoints of a counting session say nothing about time, so all times stay 0.
+* The hits of blocks that were counted inside the target process are taken from the
+* extended block hit records of the trace.
+* @return The number of blocks whose hits could not be inferred
+**/
+unsigned int analyzeCounts(TraceDecoder& decoder, const ProfileMap& map, Profile& profile);
+
+#endif
@@ -0,0 +1,226 @@
+#include "coverage.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+	const char MAGIC[4] = { 'H', 'C', 'O', 'V' };
+
+	/**
+	* Orders block indices by the addresses of their blocks.
+	**/
+	class BlockAddressLess
+	{
+	private:
+		const ProfileMap& map;
+
+	public:
+		BlockAddressLess(const ProfileMap& map) : map(map) { }
+
+		bool operator()(unsigned int lhs, unsigned int rhs) const
+		{
+			return map.getBlock(lhs).getAddress() < map.getBlock(rhs).getAddress();
+		}
+	};
+
+	void writeInteger(std::ostream& stream, unsigned long long value, unsigned int bytes)
+	{
+		for (unsigned int i = 0; i < bytes; i++)
+		{
+			stream.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	bool readInteger(std::istream& stream, unsigned long long& value, unsigned int bytes)
+	{
+		value = 0;
+
+		for (unsigned int i = 0; i < bytes; i++)
+		{
+			int byte = stream.get();
+
+			if (byte == EOF)
+			{
+				return false;
+			}
+
+			value |= static_cast<unsigned long long>(byte) << (8 * i);
+		}
+
+		return true;
+	}
+}
+
+/**
+* Counts the set bits of a word. The bitmaps are processed one 64-bit word at a time;
+* compilers that offer a population count builtin turn this into a single instruction.
+**/
+unsigned int popcount(unsigned long long value)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(value);
+#else
+	value = value - ((value >> 1) & 0x5555555555555555ULL);
+	value = (value & 0x3333333333333333ULL) + ((value >> 2) & 0x3333333333333333ULL);
+	value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+
+	return static_cast<unsigned int>((value * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+unsigned int CoverageBitmap::count() const
+{
+	unsigned int result = 0;
+
+	for (std::vector<unsigned long long>::size_type i = 0; i < words.size(); i++)
+	{
+		result += popcount(words[i]);
+	}
+
+	return result;
+}
+
+void CoverageBitmap::unite(const CoverageBitmap& other)
+{
+	for (std::vector<unsigned long long>::size_type i = 0; i < words.size(); i++)
+	{
+		words[i] |= other.words[i];
+	}
+}
+
+void CoverageBitmap::intersect(const CoverageBitmap& other)
+{
+	for (std::vector<unsigned long long>::size_type i = 0; i < words.size(); i++)
+	{
+		words[i] &= other.words[i];
+	}
+}
+
+void CoverageBitmap::subtract(const CoverageBitmap& other)
+{
+	for (std::vector<unsigned long long>::size_type i = 0; i < words.size(); i++)
+	{
+		words[i] &= ~other.words[i];
+	}
+}
+
+std::vector<unsigned int> CoverageBitmap::getBlocks() const
+{
+	std::vector<unsigned int> result;
+
+	for (std::vector<unsigned long long>::size_type i = 0; i < words.size(); i++)
+	{
+		unsigned long long word = words[i];
+
+		while (word != 0)
+		{
+			// Index of the lowest set bit
+			result.push_back(static_cast<unsigned int>(i * 64 + popcount((word & (0 - word)) - 1)));
+
+			word &= word - 1;
+		}
+	}
+
+	return result;
+}
+
+CoverageLayout::CoverageLayout(const ProfileMap& map) : blocksByAddress(map.getNumberOfBlocks()), bits(map.getNumberOfBlocks()), fingerprint(2166136261U)
+{
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		blocksByAddress[i] = i;
+	}
+
+	std::sort(blocksByAddress.begin(), blocksByAddress.end(), BlockAddressLess(map));
+
+	for (unsigned int i = 0; i < blocksByAddress.size(); i++)
+	{
+		bits[blocksByAddress[i]] = i;
+
+		// FNV-1a hash of the sorted block addresses
+		address_t address = map.getBlock(blocksByAddress[i]).getAddress();
+
+		for (unsigned int j = 0; j < sizeof(address); j++)
+		{
+			fingerprint = (fingerprint ^ static_cast<unsigned int>((address >> (8 * j)) & 0xFF)) * 16777619U;
+		}
+	}
+}
+
+CoverageBitmap CoverageLayout::getCoverage(Profile& profile) const
+{
+	CoverageBitmap bitmap(size(), fingerprint);
+
+	for (unsigned int i = 0; i < profile.getNumberOfBlocks() && i < bits.size(); i++)
+	{
+		if (profile.getBlock(i).getHits() != 0)
+		{
+			bitmap.set(bits[i]);
+		}
+	}
+
+	return bitmap;
+}
+
+/**
+* Reads a coverage bitmap from a file.
+* @param filename The name of the file
+* @param bitmap The bitmap that is filled by the function
+* @return True if the file was a valid coverage bitmap
+**/
+bool readCoverage(const std::string& filename, CoverageBitmap& bitmap)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+
+	char magic[sizeof(MAGIC)];
+
+	if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), MAGIC))
+	{
+		return false;
+	}
+
+	unsigned long long blocks;
+	unsigned long long fingerprint;
+
+	if (!readInteger(file, blocks, 4) || !readInteger(file, fingerprint, 4))
+	{
+		return false;
+	}
+
+	bitmap = CoverageBitmap(static_cast<unsigned int>(blocks), static_cast<unsigned int>(fingerprint));
+
+	for (std::vector<unsigned long long>::size_type i = 0; i < bitmap.words.size(); i++)
+	{
+		if (!readInteger(file, bitmap.words[i], 8))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+* Writes a coverage bitmap to a file.
+* @param filename The name of the file
+* @param bitmap The bitmap to write
+* @return True if the file was written successfully
+**/
+bool writeCoverage(const std::string& filename, const CoverageBitmap& bitmap)
+{
+	std::ofstream file(filename.c_str(), std::ios::binary);
+
+	file.write(MAGIC, sizeof(MAGIC));
+
+	writeInteger(file, bitmap.size(), 4);
+	writeInteger(file, bitmap.getFingerprint(), 4);
+
+	for (std::vector<unsigned long long>::size_type i = 0; i < bitmap.getWords().size(); i++)
+	{
+		writeInteger(file, bitmap.getWords()[i], 8);
+	}
+
+	return file.good();
+}
@@ -0,0 +1,96 @@
+#ifndef COVERAGE_HPP
+#define COVERAGE_HPP
+
+#include <string>
+#include <vector>
+
+#include "analysis.hpp"
+#include "profilemap.hpp"
+
+/**
+* Set of blocks that were hit in one or more profiling runs, stored as one bit per block.
+*
+* Bits are indexed by the rank of a block's address among all blocks of the profile
+* map, not by trace index, because trace indices depend on the order in which the
+* blocks were hit and differ between runs. The fingerprint identifies the block set
+* so that only bitmaps of the same blocks are combined.
+**/
+class CoverageBitmap
+{
+private:
+	unsigned int blocks;
+	unsigned int fingerprint;
+
+	std::vector<unsigned long long> words;
+
+	friend bool readCoverage(const std::string& filename, CoverageBitmap& bitmap);
+
+public:
+	CoverageBitmap(unsigned int blocks = 0, unsigned int fingerprint = 0) : blocks(blocks), fingerprint(fingerprint), words((blocks + 63) / 64) { }
+
+	unsigned int size() const { return blocks; }
+
+	unsigned int getFingerprint() const { return fingerprint; }
+
+	const std::vector<unsigned long long>& getWords() const { return words; }
+
+	void set(unsigned int block) { words[block / 64] |= 1ULL << (block % 64); }
+
+	bool test(unsigned int block) const { return (words[block / 64] >> (block % 64)) & 1; }
+
+	/**
+	* Checks whether two bitmaps describe the same blocks.
+	**/
+	bool isCompatible(const CoverageBitmap& other) const { return blocks == other.blocks && fingerprint == other.fingerprint; }
+
+	/**
+	* Returns the number of blocks in the set.
+	**/
+	unsigned int count() const;
+
+	void unite(const CoverageBitmap& other);
+
+	void intersect(const CoverageBitmap& other);
+
+	void subtract(const CoverageBitmap& other);
+
+	/**
+	* Returns the bit indices of all blocks in the set.
+	**/
+	std::vector<unsigned int> getBlocks() const;
+};
+
+/**
+* Translates between profile map block indices and coverage bit indices.
+**/
+class CoverageLayout
+{
+private:
+	std::vector<unsigned int> blocksByAddress;
+	std::vector<unsigned int> bits;
+
+	unsigned int fingerprint;
+
+public:
+	CoverageLayout(const ProfileMap& map);
+
+	unsigned int getFingerprint() const { return fingerprint; }
+
+	unsigned int getBit(unsigned int block) const { return bits[block]; }
+
+	unsigned int getBlock(unsigned int bit) const { return blocksByAddress[bit]; }
+
+	unsigned int size() const { return blocksByAddress.size(); }
+
+	/**
+	* Returns the blocks of a profile that were hit.
+	**/
+	CoverageBitmap getCoverage(Profile& profile) const;
+};
+
+unsigned int popcount(unsigned long long value);
+
+bool readCoverage(const std::string& filename, CoverageBitmap& bitmap);
+bool writeCoverage(const std::string& filename, const CoverageBitmap& bitmap);
+
+#endif
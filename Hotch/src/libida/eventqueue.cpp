@@ -0,0 +1,193 @@
+#include "eventqueue.hpp"
+
+namespace
+{
+	// The queue holds up to 64K events
+	const unsigned int QUEUE_BITS = 16;
+
+	// Longest time the worker sleeps while events may be waiting in milliseconds
+	const DWORD DRAIN_INTERVAL = 10;
+}
+
+EventWorker::EventWorker(BlockIndex& blockIndex, TraceEncoder& trace, Checkpointer& checkpointer) : blockIndex(blockIndex), trace(trace), checkpointer(checkpointer), queue(QUEUE_BITS), thread(0), wakeUp(0), stopping(0), storeSize(0), failedCheckpoints(0)
+{
+}
+
+EventWorker::~EventWorker()
+{
+	stop();
+}
+
+bool EventWorker::start()
+{
+	if (thread)
+	{
+		return true;
+	}
+
+	stopping = 0;
+
+	wakeUp = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (wakeUp)
+	{
+		thread = CreateThread(NULL, 0, run, this, 0, NULL);
+	}
+
+	return thread != 0;
+}
+
+void EventWorker::addEvent(address_t address, unsigned int threadId, unsigned long long time, unsigned long long cpuTime)
+{
+	PendingEvent event;
+
+	event.address = address;
+	event.thread = threadId;
+	event.time = time;
+	event.cpuTime = cpuTime;
+
+	push(event);
+}
+
+void EventWorker::addCpuTime(unsigned int threadId, unsigned long long cpuTime)
+{
+	PendingEvent event;
+
+	event.address = CPU_TIME_UPDATE;
+	event.thread = threadId;
+	event.time = 0;
+	event.cpuTime = cpuTime;
+
+	push(event);
+}
+
+void EventWorker::addScopeExit(unsigned long long time)
+{
+	PendingEvent event;
+
+	event.address = SCOPE_EXIT;
+	event.thread = 0;
+	event.time = time;
+	event.cpuTime = NO_CPU_TIME;
+
+	push(event);
+}
+
+/**
+* Queues an event. If the queue is full, the callback waits until the worker made
+* room.
+**/
+void EventWorker::push(const PendingEvent& event)
+{
+	if (!thread)
+	{
+		// Without a worker thread the events are stored right away
+		queue.push(event);
+
+		drain();
+
+		return;
+	}
+
+	bool wasEmpty = queue.getSize() == 0;
+
+	while (!queue.push(event))
+	{
+		SetEvent(wakeUp);
+		SwitchToThread();
+	}
+
+	// A busy worker drains the queue anyway
+	if (wasEmpty)
+	{
+		SetEvent(wakeUp);
+	}
+}
+
+void EventWorker::stop()
+{
+	if (thread)
+	{
+		InterlockedExchange(&stopping, 1);
+
+		SetEvent(wakeUp);
+		WaitForSingleObject(thread, INFINITE);
+
+		CloseHandle(thread);
+
+		thread = 0;
+	}
+
+	if (wakeUp)
+	{
+		CloseHandle(wakeUp);
+
+		wakeUp = 0;
+	}
+
+	drain();
+}
+
+DWORD WINAPI EventWorker::run(LPVOID parameter)
+{
+	EventWorker* worker = static_cast<EventWorker*>(parameter);
+
+	for (;;)
+	{
+		WaitForSingleObject(worker->wakeUp, DRAIN_INTERVAL);
+
+		// Events queued before the stop request are still stored
+		bool stop = worker->stopping != 0;
+
+		worker->drain();
+
+		if (stop)
+		{
+			return 0;
+		}
+	}
+}
+
+/**
+* Stores all queued events.
+**/
+void EventWorker::drain()
+{
+	PendingEvent event;
+
+	bool stored = false;
+
+	while (queue.pop(event))
+	{
+		if (event.cpuTime != NO_CPU_TIME)
+		{
+			trace.setCpuTime(event.thread, event.cpuTime);
+		}
+
+		if (event.address == CPU_TIME_UPDATE)
+		{
+			continue;
+		}
+
+		if (event.address == SCOPE_EXIT)
+		{
+			trace.addScopeExit(event.time);
+
+			continue;
+		}
+
+		trace.addEvent(blockIndex.addBlock(event.address), event.thread, event.time);
+
+		if (checkpointer.isDue(event.time) && !checkpointer.write(blockIndex, trace, event.time))
+		{
+			InterlockedIncrement(&failedCheckpoints);
+		}
+
+		stored = true;
+	}
+
+	if (stored)
+	{
+		InterlockedExchange(&storeSize, static_cast<LONG>(trace.getData().size()));
+	}
+}
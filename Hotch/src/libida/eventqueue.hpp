@@ -0,0 +1,185 @@
+#ifndef EVENTQUEUE_HPP
+#define EVENTQUEUE_HPP
+
+#include <windows.h>
+
+#include <vector>
+
+#include "types.hpp"
+#include "blockindex.hpp"
+#include "checkpoint.hpp"
+#include "trace.hpp"
+
+// CPU time of an event whose thread could not be read
+const unsigned long long NO_CPU_TIME = ~0ULL;
+
+// Address of the event that marks the end of a trigger scope
+const address_t SCOPE_EXIT = ~0ULL;
+
+// Address of an event that only carries the CPU time of its thread
+const address_t CPU_TIME_UPDATE = ~0ULL - 1;
+
+/**
+* A breakpoint hit as the debugger callback saw it, before it is stored. The
+* events of a session also mark where a triggered session left its scope and
+* carry the CPU times of threads between their hits, so that these are stored in
+* order with the hits.
+**/
+struct PendingEvent
+{
+	address_t address;
+	unsigned int thread;
+	unsigned long long time;
+
+	// CPU time the thread used so far or NO_CPU_TIME
+	unsigned long long cpuTime;
+};
+
+/**
+* A lock-free queue of breakpoint hits between the debugger callback, which is the
+* only producer, and the event worker, which is the only consumer. Each side only
+* writes its own position and publishes it after it wrote or read the slot, so
+* neither side ever waits for the other.
+**/
+class EventQueue
+{
+private:
+	std::vector<PendingEvent> slots;
+	LONG mask;
+
+	// Next slot to read, written by the consumer
+	volatile LONG head;
+
+	// Next slot to write, written by the producer
+	volatile LONG tail;
+
+public:
+	/**
+	* @param bits The queue holds 2^bits - 1 events
+	**/
+	EventQueue(unsigned int bits) : slots(1 << bits), mask((1 << bits) - 1), head(0), tail(0) { }
+
+	/**
+	* Adds an event to the queue. Must only be called by the producer.
+	* @return False if the queue is full
+	**/
+	bool push(const PendingEvent& event)
+	{
+		LONG next = (tail + 1) & mask;
+
+		if (next == head)
+		{
+			return false;
+		}
+
+		slots[tail] = event;
+
+		InterlockedExchange(&tail, next);
+
+		return true;
+	}
+
+	/**
+	* Takes the oldest event from the queue. Must only be called by the consumer.
+	* @return False if the queue is empty
+	**/
+	bool pop(PendingEvent& event)
+	{
+		if (head == tail)
+		{
+			return false;
+		}
+
+		event = slots[head];
+
+		InterlockedExchange(&head, (head + 1) & mask);
+
+		return true;
+	}
+
+	unsigned int getSize() const { return (tail - head) & mask; }
+};
+
+/**
+* Stores the breakpoint hits of a session on a thread of its own. The debugger
+* callback only queues each hit and resumes the target; the worker resolves the
+* block index, encodes the trace and writes the checkpoints. The block index, the
+* trace and the checkpointer belong to the worker while it runs.
+**/
+class EventWorker
+{
+private:
+	BlockIndex& blockIndex;
+	TraceEncoder& trace;
+	Checkpointer& checkpointer;
+
+	EventQueue queue;
+
+	HANDLE thread;
+	HANDLE wakeUp;
+
+	volatile LONG stopping;
+
+	// Size of the encoded trace and number of failed checkpoints, for the callback thread
+	volatile LONG storeSize;
+	volatile LONG failedCheckpoints;
+
+	static DWORD WINAPI run(LPVOID parameter);
+
+	void push(const PendingEvent& event);
+
+	void drain();
+
+public:
+	EventWorker(BlockIndex& blockIndex, TraceEncoder& trace, Checkpointer& checkpointer);
+
+	~EventWorker();
+
+	/**
+	* Starts the worker thread.
+	* @return False if the thread could not be created
+	**/
+	bool start();
+
+	/**
+	* Queues a breakpoint hit and the CPU time of its thread. If the queue is full, the callback waits until the
+	* worker made room, so no event is lost. Must only be called from the debugger
+	* callback.
+	**/
+	void addEvent(address_t address, unsigned int threadId, unsigned long long time, unsigned long long cpuTime);
+
+	/**
+	* Queues the CPU time of a thread at the time of the next event. Must only be
+	* called from the debugger callback.
+	**/
+	void addCpuTime(unsigned int threadId, unsigned long long cpuTime);
+
+	/**
+	* Queues the end of a trigger scope at the given time. Must only be called
+	* from the debugger callback.
+	**/
+	void addScopeExit(unsigned long long time);
+
+	/**
+	* Stores the events that are still queued and ends the worker thread.
+	**/
+	void stop();
+
+	/**
+	* Returns the size of the encoded trace after the last batch of events.
+	**/
+	unsigned int getEventStoreSize() const { return storeSize; }
+
+	/**
+	* Returns the number of events waiting in the queue.
+	**/
+	unsigned int getQueueSize() const { return queue.getSize(); }
+
+	/**
+	* Returns the number of checkpoints that could not be written since the last
+	* call and resets it.
+	**/
+	unsigned int takeFailedCheckpoints() { return InterlockedExchange(&failedCheckpoints, 0); }
+};
+
+#endif
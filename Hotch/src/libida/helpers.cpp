@@ -1,5 +1,13 @@
 #include "helpers.hpp"
 
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 /**
 * Returns the file size of a file
 * @param file Filestream
@@ -84,3 +92,81 @@ bool replaceString(std::string& output, const std::string& src, const std::strin
 	return ret;
 }
 
+/**
+* Writes a string as a JSON string literal. '<' is escaped as well so that the
+* literal can be embedded in a HTML script block.
+**/
+void writeJsonString(std::ostream& stream, const std::string& value)
+{
+	stream << '"';
+
+	for (std::string::const_iterator Iter = value.begin(); Iter != value.end(); ++Iter)
+	{
+		unsigned char c = *Iter;
+
+		if (c == '"' || c == '\\')
+		{
+			stream << '\\' << c;
+		}
+		else if (c < 0x20 || c == '<')
+		{
+			char buffer[8];
+
+			sprintf(buffer, "\\u%04X", c);
+
+			stream << buffer;
+		}
+		else
+		{
+			stream << c;
+		}
+	}
+
+	stream << '"';
+}
+
+/**
+* Moves a file over another file. Readers see either the old or the new
+* destination file, never a partially written one.
+* @param source The file to move
+* @param destination The file to replace
+* @return True if the file was moved
+**/
+bool replaceFile(const std::string& source, const std::string& destination)
+{
+#ifdef _WIN32
+	return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(source.c_str(), destination.c_str()) == 0;
+#endif
+}
+
+/**
+* Cuts a file off after the given number of bytes.
+* @param filename The name of the file
+* @param length The new length of the file
+* @return True if the file was truncated
+**/
+bool truncateFile(const std::string& filename, unsigned long long length)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER position;
+
+	position.QuadPart = length;
+
+	bool truncated = SetFilePointerEx(file, position, 0, FILE_BEGIN) && SetEndOfFile(file);
+
+	CloseHandle(file);
+
+	return truncated;
+#else
+	return truncate(filename.c_str(), static_cast<off_t>(length)) == 0;
+#endif
+}
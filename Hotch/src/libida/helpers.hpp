@@ -6,11 +6,16 @@
 #include <string>
 #include <list>
 #include <map>
+#include <iomanip>
+#include <algorithm>
 
 unsigned int getFileSize(std::ifstream& file);
 bool readTextFile(const std::string& filename, std::string& output);
 bool replaceString(std::string& output, const std::string& src, const std::string& dest);
 void writeOutput(const std::string& filename, const std::string& output);
+void writeJsonString(std::ostream& stream, const std::string& value);
+bool replaceFile(const std::string& source, const std::string& destination);
+bool truncateFile(const std::string& filename, unsigned long long length);
 
 template<typename T>
 std::string toString(const T& x)
@@ -2,546 +2,2265 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <windows.h>
+#include <tlhelp32.h>
+#include <sys/timeb.h>
 
 #include <map>
+#include <set>
 #include <sstream>
 #include <algorithm>
 #include <iomanip>
+#include <cmath>
 
 #include "hotch.hpp"
 #include "helpers.hpp"
+#include "analysis.hpp"
+#include "chrometrace.hpp"
+#include "counters.hpp"
+#include "contexts.hpp"
+#include "coverage.hpp"
+#include "layout.hpp"
+#include "paths.hpp"
+#include "profilemap.hpp"
+#include "report.hpp"
+#include "rollup.hpp"
+#include "traceindex.hpp"
 
-/**
-* Sets a breakpoint at the given offset.
-**/
-void setBreakpoint(const Offset& offset)
-{
-//	msg("Setting breakpoint on address %08X...\n", offset.getAddress());
+// Minimum time between two checkpoints of a profiling session in milliseconds
+const unsigned long long CHECKPOINT_INTERVAL = 60 * 1000;
 
-	IdaFile file;
+// Minimum time between two reports of the profiler overhead in milliseconds
+const unsigned long long OVERHEAD_INTERVAL = 10 * 1000;
 
-	file.getDebugger().setBreakpoint(offset.getAddress(), true);
-}
+// Time between two samples of a sampling session in milliseconds
+const unsigned int SAMPLING_INTERVAL = 10;
 
-/**
-* Sets breakpoints on all basic blocks.
-**/
-void setBreakpoints()
-{
-	msg("Setting breakpoints on all basic blocks...\n");
+// Time between two reads of the trampoline counters in milliseconds
+const unsigned int COUNTER_READ_INTERVAL = 1000;
 
-	iterateBasicBlocks(setBreakpoint);
-}
+// Time between two checks of the report job in milliseconds
+const unsigned int REPORT_POLL_INTERVAL = 250;
 
-/**
-* Removes a breakpoint from the given offset.
-**/
-void removeBreakpoint(const Offset& offset)
-{
-	IdaFile file;
+// Number of stages of the report job
+const unsigned int NUMBER_OF_REPORT_STAGES = 7;
 
-	file.getDebugger().removeBreakpoint(offset.getAddress());
-}
+// Instruction pointer register of the target process
+const std::string INSTRUCTION_POINTER = "EIP";
+
+// Register that points to the return address at the start of a function
+const std::string STACK_POINTER = "ESP";
+
+// Block colors from cold to hot (0xBBGGRR)
+const bgcolor_t HEAT_COLORS[] = { 0xCCFFFF, 0x99FFFF, 0x66FFFF, 0x33CCFF, 0x3399FF, 0x3366FF, 0x3333FF, 0x0000CC };
+const unsigned int NUMBER_OF_HEAT_COLORS = sizeof(HEAT_COLORS) / sizeof(HEAT_COLORS[0]);
+
+// Start of the function comment lines written by Hotch
+const std::string COMMENT_PREFIX = "Hotch: ";
+
+// The profiling session that is currently running or 0
+UserData* activeSession = 0;
+
+// Timer of the running sampling session or 0
+UINT_PTR samplingTimer = 0;
+
+// True while the process is suspended to take a sample
+bool samplePending = false;
+
+// The target process of a trampoline session or 0
+HANDLE targetProcess = 0;
+
+// Timer that reads the trampoline counters or 0
+UINT_PTR counterTimer = 0;
+
+// True while the trampolines wait for the target process to stop at a breakpoint
+bool trampolinesPending = false;
+
+class ReportJob;
+
+// The job that writes the results of the last session or 0
+ReportJob* reportJob = 0;
+
+// Timer that checks the report job or 0
+UINT_PTR reportTimer = 0;
 
 /**
-* Removes breakpoints from all basic blocks.
+* Returns the current time in milliseconds.
 **/
-void removeBreakpoints()
+unsigned long long getCurrentTime()
 {
-	iterateBasicBlocks(removeBreakpoint);
+	_timeb timebuffer;
+	_ftime64_s( &timebuffer );
 
-	run_requests();
+	return timebuffer.time * 1000ULL + timebuffer.millitm;
 }
 
 /**
-* Predicated function that is used to sort times blocks by their total hits.
+* Returns the value of a high resolution clock in microseconds. Only differences
+* between two values are meaningful.
 **/
-bool sortByHits(const TimedBlock* lhs, const TimedBlock* rhs)
+unsigned long long getMicroseconds()
 {
-	return lhs->getHits() > rhs->getHits();
+	static LARGE_INTEGER frequency = { 0 };
+
+	if (frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&frequency);
+	}
+
+	LARGE_INTEGER counter;
+
+	QueryPerformanceCounter(&counter);
+
+	return counter.QuadPart / frequency.QuadPart * 1000000ULL + counter.QuadPart % frequency.QuadPart * 1000000ULL / frequency.QuadPart;
 }
 
 /**
-* Predicated function that is used to sort times blocks by their total time.
+* Collects the first instructions of the basic blocks that are profiled.
 **/
-bool sortByTime(const TimedBlock* lhs, const TimedBlock* rhs)
+class BreakpointCollector
 {
-	return lhs->getTime() > rhs->getTime();
-}
+private:
+	BreakpointSet& breakpoints;
+	Debugger debugger;
+
+	bool skipUserBreakpoints;
+
+public:
+	/**
+	* @param skipUserBreakpoints True to leave blocks that already have a breakpoint
+	* of the user to the user
+	**/
+	BreakpointCollector(BreakpointSet& breakpoints, bool skipUserBreakpoints) : breakpoints(breakpoints), skipUserBreakpoints(skipUserBreakpoints) { }
+
+	void operator()(const Offset& offset)
+	{
+		if (!skipUserBreakpoints || !debugger.hasBreakpoint(offset.getAddress()))
+		{
+			breakpoints.add(offset.getAddress());
+		}
+	}
+};
 
 /**
-* Predicated function that is used to sort times blocks by their average time.
+* Returns the instruction pointers of all threads of the suspended target process.
 **/
-bool sortByAverageTime(const TimedBlock* lhs, const TimedBlock* rhs)
+std::vector<address_t> getInstructionPointers()
 {
-	if (lhs->getHits() == 0 || rhs->getHits() == 0)
+	Debugger debugger = IdaFile().getDebugger();
+
+	std::vector<address_t> addresses;
+
+	thread_id_t current = debugger.getCurrentThread();
+
+	for (unsigned int i=0;i<debugger.getNumberOfThreads();i++)
 	{
-		return false;
+		unsigned long long address;
+
+		if (debugger.selectThread(debugger.getThread(i)) && debugger.getRegister(INSTRUCTION_POINTER, address))
+		{
+			addresses.push_back(address);
+		}
 	}
 
-	return (lhs->getTime() / lhs->getHits()) > (rhs->getTime() / rhs->getHits());
+	debugger.selectThread(current);
+
+	return addresses;
 }
 
 /**
-* Calculates the total time spent on a list of blocks.
+* Opens the target process for the memory operations of the counter trampolines.
+* IDA does not tell the ID of the process, so it is taken from the owner of one
+* of its threads.
 **/
-time_t totalTime(const std::list<TimedBlock*>& blocks)
+HANDLE openTargetProcess()
 {
-	time_t tt = 0;
+	Debugger debugger;
+
+	if (!debugger.isActive() || debugger.getNumberOfThreads() == 0)
+	{
+		return 0;
+	}
+
+	DWORD thread = debugger.getThread(0);
+	DWORD process = 0;
 
-	for (std::list<TimedBlock*>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+
+	if (snapshot == INVALID_HANDLE_VALUE)
 	{
-		TimedBlock* bb = *Iter;
+		return 0;
+	}
 
-		tt += bb->getTime();
+	THREADENTRY32 entry;
+
+	entry.dwSize = sizeof(entry);
+
+	for (BOOL found = Thread32First(snapshot, &entry); found && process == 0; found = Thread32Next(snapshot, &entry))
+	{
+		if (entry.th32ThreadID == thread)
+		{
+			process = entry.th32OwnerProcessID;
+		}
 	}
 
-	return tt;
+	CloseHandle(snapshot);
+
+	return process ? OpenProcess(PROCESS_VM_OPERATION | PROCESS_VM_READ | PROCESS_VM_WRITE | PROCESS_QUERY_INFORMATION, FALSE, process) : 0;
 }
 
 /**
-* Calculates the total number of hits in a list of hits.
+* Returns the size of the instructions at the start of a block that a trampoline
+* can run instead: whole instructions that cover a jump, do not depend on their
+* address and are not the target of other jumps. Calls, including indirect ones,
+* may only be the last of them because the return addresses of threads inside the
+* callee point behind the call. Returns 0 if the block has no such instructions.
+* @param blocks The first instructions of all blocks
 **/
-unsigned int totalHits(const std::list<TimedBlock*>& blocks)
+unsigned int getRelocatableSize(ea_t address, const BreakpointSet& blocks)
 {
-	unsigned int th = 0;
+	Debugger debugger;
 
-	for (std::list<TimedBlock*>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+	ea_t current = address;
+
+	while (current - address < CounterTrampolines::JUMP_SIZE)
 	{
-		TimedBlock* bb = *Iter;
+		if (current != address && (!isFlow(getFlags(current)) || blocks.contains(current) || debugger.hasBreakpoint(current)))
+		{
+			return 0;
+		}
+
+		if (decode_insn(current) == 0)
+		{
+			return 0;
+		}
+
+		// Relative jumps and calls
+		for (unsigned int i=0;i<UA_MAXOP && cmd.Operands[i].type != o_void;i++)
+		{
+			if (cmd.Operands[i].type == o_near || cmd.Operands[i].type == o_far)
+			{
+				return 0;
+			}
+		}
+
+		ea_t next = current + cmd.size;
+
+		// A thread inside the callee of any other call would return into the jump
+		if (next - address < CounterTrampolines::JUMP_SIZE && is_call_insn(current))
+		{
+			return 0;
+		}
 
-		th += bb->getHits();
+		current = next;
 	}
 
-	return th;
+	return current - address;
 }
 
 /**
-* Creates a new <td> cell with the information given in the parameters.
+* Reads the counters of the trampolines in one go. The counts of the last
+* successful read stay when the target process is gone.
 **/
-template<typename T>
-void createCell(std::ostringstream& ss, T value, const std::string& alignment, const std::string& suffix = "")
+void readTrampolineCounters(UserData* userData)
 {
-	ss << "<td style=\"text-align:" << alignment << "\">";
-	ss << value << suffix;
-	ss << "</td>";
+	CounterTrampolines& trampolines = userData->getTrampolines();
+
+	if (!targetProcess || !trampolines.isCreated())
+	{
+		return;
+	}
+
+	std::vector<unsigned char> counters(trampolines.getCounterAreaSize());
+	SIZE_T read = 0;
+
+	if (ReadProcessMemory(targetProcess, reinterpret_cast<LPCVOID>(static_cast<ULONG_PTR>(trampolines.getCounterArea())), &counters[0], counters.size(), &read) && read == counters.size())
+	{
+		trampolines.setCounts(counters);
+	}
 }
 
 /**
-* Creates a new <tr> tag with the class determined by the counter.
+* Timer of trampoline sessions that keeps the counts up to date, so only the hits
+* of the last interval are lost when the target process exits.
 **/
-void createRow(std::ostringstream& ss, unsigned int counter)
+void CALLBACK readCounters(HWND, UINT, UINT_PTR, DWORD)
 {
-	ss << "<tr class=\"";
-	ss << (counter % 2 ? "evenLine" : "oddLine");
-	ss << "\">";
+	if (activeSession)
+	{
+		readTrampolineCounters(activeSession);
+	}
 }
 
 /**
-* Generates a HTML table that is used to display function events sorted by a given sorter.
+* Moves the measured blocks of a counting session from breakpoints to counter
+* trampolines in the suspended target process. Blocks that start with relative
+* jumps or calls, blocks that are too short and blocks that a thread is about to
+* run keep their breakpoints. The trampolines stay in the target process after
+* profiling because a thread may still be running one.
 **/
-std::string generateFunctionTable(std::list<TimedBlock*>& functionResults, bool (*sorter)(const TimedBlock*, const TimedBlock*))
+void installTrampolines(UserData* userData)
 {
-	functionResults.sort(sorter);
-
-	time_t totalTime = ::totalTime(functionResults);
-	unsigned int totalHits = ::totalHits(functionResults);
+	BreakpointSet& breakpoints = userData->getBreakpoints();
+	Debugger debugger;
 
-	std::ostringstream ss;
+	std::vector<address_t> threads = getInstructionPointers();
 
-	unsigned int counter = 1;
+	std::vector<std::pair<ea_t, unsigned int> > candidates;
 
-	for (std::list<TimedBlock*>::const_iterator Iter = functionResults.begin(); Iter != functionResults.end(); ++Iter)
+	for (unsigned int i=0;i<breakpoints.size();i++)
 	{
-		TimedBlock* bb = *Iter;
+		ea_t address = static_cast<ea_t>(breakpoints.getAddress(i));
+		unsigned int size = getRelocatableSize(address, userData->getProfiledBlocks());
 
-		if (bb->getHits() == 0)
+		for (unsigned int j=0;j<threads.size() && size != 0;j++)
 		{
-			// We can not break here because it's not guaranteed that useful events come later,
-			// depending on the exact sort algorithm.
-			continue;
+			if (threads[j] >= address && threads[j] < address + size)
+			{
+				size = 0;
+			}
+		}
+
+		if (size != 0)
+		{
+			candidates.push_back(std::make_pair(address, size));
 		}
+	}
 
-		createRow(ss, counter);
+	targetProcess = openTargetProcess();
 
-		createCell(ss, counter, "center");
-		createCell(ss, bb->getParentFunction().getName(), "left");
+	LPVOID area = targetProcess ? VirtualAllocEx(targetProcess, NULL, CounterTrampolines::getAreaSize(candidates.size()), MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE) : 0;
 
-		ss << "<td style=\"text-align:center\">";
-		ss << "0x" << std::uppercase << std::hex << bb->getParentFunction().getAddress().getAddress() << std::nouppercase;
-		ss << "</td>";
+	if (candidates.empty() || !area)
+	{
+		msg("Could not create the counter trampolines, all measured blocks keep their breakpoints\n");
 
-		ss << std::dec << std::fixed << std::setprecision(2);
-		createCell(ss, bb->getTime(), "right", " ms");
+		return;
+	}
 
-		createCell(ss, 100.0 * bb->getTime() / totalTime, "right", " %");
-		createCell(ss, bb->getHits(), "right");
-		createCell(ss, 100.0 * bb->getHits() / totalHits, "right", " %");
-		createCell(ss, 1.0 * bb->getTime() / bb->getHits(), "right", " ms");
+	CounterTrampolines& trampolines = userData->getTrampolines();
 
-		ss << "</tr>";
+	trampolines.create(reinterpret_cast<ULONG_PTR>(area), candidates.size());
 
-		++counter;
+	// Breakpoints that are already set must go before the original bytes are read
+	for (unsigned int i=0;i<candidates.size();i++)
+	{
+		debugger.removeBreakpoint(candidates[i].first);
 	}
 
-	return ss.str();
-}
+	debugger.flush();
 
-/**
-* Creates a list of all events.
-**/
-std::string generateEventsTable(const std::list<Event>& events)
-{
-	std::ostringstream ss;
+	std::vector<std::vector<unsigned char> > patches;
+
+	for (unsigned int i=0;i<candidates.size();i++)
+	{
+		std::vector<unsigned char> original(candidates[i].second);
+
+		if (debugger.readMemory(candidates[i].first, &original[0], original.size()))
+		{
+			patches.push_back(trampolines.addBlock(candidates[i].first, original));
+		}
+	}
 
-	unsigned int counter = 1;
+	const std::vector<unsigned char>& code = trampolines.getCode();
 
-	char timeBuffer[100] = {0};
-	char timeline[26];
+	SIZE_T written = 0;
 
-	for (std::list<Event>::const_iterator Iter = events.begin(); Iter != events.end(); ++Iter)
+	if (code.empty() || !WriteProcessMemory(targetProcess, reinterpret_cast<LPVOID>(static_cast<ULONG_PTR>(trampolines.getCodeAddress())), &code[0], code.size(), &written) || written != code.size())
 	{
-		createRow(ss, counter);
+		msg("Could not write the counter trampolines, all measured blocks keep their breakpoints\n");
+
+		trampolines.create(0, 0);
+
+		return;
+	}
+
+	FlushInstructionCache(targetProcess, reinterpret_cast<LPCVOID>(static_cast<ULONG_PTR>(trampolines.getCodeAddress())), code.size());
 
-		createCell(ss, counter, "center");
+	BreakpointSet patched;
 
-		_timeb eventTime = Iter->getTime();
-		ctime_s( timeline, 26, & ( eventTime.time ) );
+	for (unsigned int i=0;i<trampolines.getNumberOfBlocks();i++)
+	{
+		ea_t address = static_cast<ea_t>(trampolines.getBlock(i));
 
-		sprintf(timeBuffer, "%.8s.%hu", timeline + 11, eventTime.millitm);
+		// A block that keeps its original bytes never reaches its trampoline
+		if (debugger.writeMemory(address, &patches[i][0], patches[i].size()))
+		{
+			patched.add(address);
+		}
+	}
 
-		createCell(ss, timeBuffer, "center");
+	BreakpointSet remaining;
 
-		ss << "<td style=\"text-align:center\">";
-		ss << "0x" << std::uppercase << std::hex << Iter->getAddress().getAddress() << std::dec << std::nouppercase;
-		ss << "</td>";
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		if (!patched.contains(breakpoints.getAddress(i)))
+		{
+			remaining.add(breakpoints.getAddress(i));
+		}
+	}
 
-		createCell(ss, Iter->getParentFunction().getName(), "left");
+	breakpoints = remaining;
 
-		++counter;
+	for (unsigned int i=0;i<candidates.size();i++)
+	{
+		if (!patched.contains(candidates[i].first))
+		{
+			debugger.setBreakpoint(candidates[i].first);
+		}
 	}
 
-	return ss.str();
+	debugger.flush();
+
+	counterTimer = SetTimer(NULL, 0, COUNTER_READ_INTERVAL, readCounters);
+
+	msg("Counting %u blocks with trampolines and %u blocks with breakpoints\n", patched.size(), breakpoints.size());
 }
 
 /**
-* Generates a HTML table that is used to display block events sorted by a given sorter.
+* Reads the counters of the trampolines a last time and restores the original
+* bytes of the blocks.
 **/
-std::string generateBlocksTable(std::list<TimedBlock*>& blockResults, bool (*sorter)(const TimedBlock*, const TimedBlock*))
+void removeTrampolines(UserData* userData)
 {
-	blockResults.sort(sorter);
+	CounterTrampolines& trampolines = userData->getTrampolines();
+
+	if (counterTimer)
+	{
+		KillTimer(NULL, counterTimer);
 
-	time_t totalTime = ::totalTime(blockResults);
-	unsigned int totalHits = ::totalHits(blockResults);
+		counterTimer = 0;
+	}
 
-	std::ostringstream ss;
+	readTrampolineCounters(userData);
 
-	unsigned int counter = 1;
+	Debugger debugger;
 
-	for (std::list<TimedBlock*>::const_iterator Iter = blockResults.begin(); Iter != blockResults.end(); ++Iter)
+	// Fails harmlessly if the target process is gone
+	for (unsigned int i=0;i<trampolines.getNumberOfBlocks();i++)
 	{
-		TimedBlock* bb = *Iter;
+		const std::vector<unsigned char>& original = trampolines.getOriginalBytes(i);
 
-		// Skip the blocks that were not hit.
-		if (bb->getHits() == 0)
-		{
-			// We can not break here because it's not guaranteed that useful events come later,
-			// depending on the exact sort algorithm.
-			continue;
-		}
+		debugger.writeMemory(static_cast<ea_t>(trampolines.getBlock(i)), &original[0], original.size());
+	}
+
+	if (targetProcess)
+	{
+		CloseHandle(targetProcess);
 
-		createRow(ss, counter);
+		targetProcess = 0;
+	}
+
+	trampolinesPending = false;
+}
+
+/**
+* Returns the start addresses of a function and of all functions it can reach with
+* calls, jumps and function pointers. Calls through registers and tables are not
+* followed.
+**/
+std::set<ea_t> getCallClosure(ea_t start)
+{
+	std::set<ea_t> functions;
+	std::vector<ea_t> pending(1, start);
 
-		createCell(ss, counter, "center");
+	functions.insert(start);
 
-		ss << "<td style=\"text-align:center\">";
-		ss << "0x" << std::uppercase << std::hex << bb->getOffset().getAddress() << std::nouppercase;
-		ss << "</td>";
+	while (!pending.empty())
+	{
+		func_t* function = get_func(pending.back());
 
-		ss << std::dec << std::fixed << std::setprecision(2);
-		createCell(ss, bb->getParentFunction().getName(), "left");
-		createCell(ss, bb->getTime(), "right", " ms");
+		pending.pop_back();
 
-		createCell(ss, 100.0 * bb->getTime() / totalTime, "right", " %");
-		createCell(ss, bb->getHits(), "right");
-		createCell(ss, 100.0 * bb->getHits() / totalHits, "right", " %");
+		if (!function)
+		{
+			continue;
+		}
 
-		ss << "</tr>";
+		for (ea_t current = function->startEA; current != BADADDR && current < function->endEA; current = next_head(current, function->endEA))
+		{
+			xrefblk_t xref;
 
-		++counter;
+			for (bool found = xref.first_from(current, XREF_FAR); found; found = xref.next_from())
+			{
+				func_t* target = get_func(xref.to);
+
+				// Data references only count if they point to the start of a function
+				if (!target || target == function || (!xref.iscode && target->startEA != xref.to))
+				{
+					continue;
+				}
+
+				if (functions.insert(target->startEA).second)
+				{
+					pending.push_back(target->startEA);
+				}
+			}
+		}
 	}
 
-	return ss.str();
+	return functions;
 }
 
 /**
-* Checks whether a block was hit or not.
+* Keeps only the blocks of a triggered session that belong to the call-graph
+* closure of the trigger function.
 **/
-bool wasHit(const TimedBlock* block)
+void selectTriggerScope(UserData* userData)
 {
-	return block->getHits() != 0;
+	BreakpointSet& breakpoints = userData->getBreakpoints();
+
+	std::set<ea_t> functions = getCallClosure(static_cast<ea_t>(userData->getTriggerScope().getTrigger()));
+
+	BreakpointSet scope;
+
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		func_t* function = get_func(static_cast<ea_t>(breakpoints.getAddress(i)));
+
+		if (function && functions.count(function->startEA) != 0)
+		{
+			scope.add(breakpoints.getAddress(i));
+		}
+	}
+
+	breakpoints = scope;
+
+	msg("Profiling %u blocks in %u functions that the trigger function can reach\n", breakpoints.size(), functions.size());
+
+	if (!breakpoints.contains(userData->getTriggerScope().getTrigger()))
+	{
+		msg("The trigger function has a breakpoint of the user, so profiling never starts\n");
+	}
 }
 
 /**
-* Counts the number of blocks in a list of blocks that were hit.
+* Requests to enable or disable the breakpoints of the trigger scope. The
+* breakpoint of the trigger function always stays enabled.
 **/
-unsigned int countHitBlocks(const std::list<TimedBlock*>& blocks)
+void enableScopeBreakpoints(UserData* userData, bool enable)
 {
-	return std::count_if(blocks.begin(), blocks.end(), wasHit);
+	BreakpointSet& breakpoints = userData->getBreakpoints();
+	Debugger debugger;
+
+	ea_t trigger = static_cast<ea_t>(userData->getTriggerScope().getTrigger());
+
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		if (breakpoints.getAddress(i) != trigger)
+		{
+			debugger.enableBreakpoint(static_cast<ea_t>(breakpoints.getAddress(i)), enable);
+		}
+	}
 }
 
 /**
-* Creates the output HTML file.
+* Enters the trigger scope at a call of the trigger function by the current thread.
+* @return False if the return address of the call could not be read
 **/
-void writeOutput(const std::list<Event>& list, std::list<TimedBlock*>& blockResults, std::list<TimedBlock*>& functionResults)
+bool enterTriggerScope(UserData* userData, thread_id_t thread)
 {
-	msg("Generating the output file...\n");
+	Debugger debugger;
 
-	std::string pluginDir = ::idadir("plugins");
-	std::string hotchDir = pluginDir + "/hotch";
+	unsigned long long stackPointer;
+	unsigned int returnAddress;
+
+	if (!debugger.getRegister(STACK_POINTER, stackPointer) || !debugger.readMemory(static_cast<ea_t>(stackPointer), &returnAddress, sizeof(returnAddress)))
+	{
+		msg("Could not read the return address of the trigger function\n");
 
-	char filename[40] = {0};
+		return false;
+	}
 
-	sprintf(filename, "results.html");
-//	sprintf(filename, "results-%d.html", currentTime);
+	// The return address may be a profiled block or a breakpoint of the user
+	bool ownsBreakpoint = !debugger.hasBreakpoint(returnAddress);
 
-	std::string templateString;
-	
-	if (!readTextFile(hotchDir + "/template.htm", templateString))
+	if (ownsBreakpoint)
 	{
-		msg("Could not read template file\n");
-		return;
+		debugger.setBreakpoint(returnAddress);
 	}
 
-	IdaFile file;
-
-	unsigned int functions = file.getNumberOfFunctions();
-	unsigned int hitFunctions = countHitBlocks(functionResults);
-	unsigned int unhitFunctions = functions - hitFunctions;
+	enableScopeBreakpoints(userData, true);
 
-	unsigned int blocks = file.getDebugger().getNumberOfBreakpoints();
-	unsigned int hitBlocks = countHitBlocks(blockResults);
-	unsigned int unhitBlocks = blocks - hitBlocks;	
+	debugger.flush();
 
-	replaceString(templateString, "%FILENAME%", file.getInputfilePath());
-	replaceString(templateString, "%NUMBER_OF_FUNCTIONS%", toString(functions));
-	replaceString(templateString, "%NUMBER_OF_HIT_FUNCTIONS%", toString(hitFunctions));
-	replaceString(templateString, "%NUMBER_OF_HIT_FUNCTIONS_PERCENTAGE%", floatToString(100.0 * hitFunctions / functions));
-	replaceString(templateString, "%NUMBER_OF_NOT_HIT_FUNCTIONS%", toString(unhitFunctions));
-	replaceString(templateString, "%NUMBER_OF_NOT_HIT_FUNCTIONS_PERCENTAGE%", floatToString(100.0 * unhitFunctions / functions));
-	replaceString(templateString, "%NUMBER_OF_BLOCKS%", toString(blocks));
-	replaceString(templateString, "%NUMBER_OF_HIT_BLOCKS%", toString(hitBlocks));
-	replaceString(templateString, "%NUMBER_OF_HIT_BLOCKS_PERCENTAGE%", floatToString(100.0 * hitBlocks / blocks));
-	replaceString(templateString, "%NUMBER_OF_NOT_HIT_BLOCKS%", toString(unhitBlocks));
-	replaceString(templateString, "%NUMBER_OF_NOT_HIT_BLOCKS_PERCENTAGE%", floatToString(100.0 * unhitBlocks / blocks));
-	replaceString(templateString, "%FUNCTIONS_BY_HITS%", generateFunctionTable(functionResults, sortByHits));
-	replaceString(templateString, "%FUNCTIONS_BY_TIME%", generateFunctionTable(functionResults, sortByTime));
-	replaceString(templateString, "%FUNCTIONS_BY_AVERAGE_TIME%", generateFunctionTable(functionResults, sortByAverageTime));
-	replaceString(templateString, "%BLOCKS_BY_HITS%", generateBlocksTable(blockResults, sortByHits));
-	replaceString(templateString, "%BLOCKS_BY_TIME%", generateBlocksTable(blockResults, sortByTime));
-	replaceString(templateString, "%ALL_EVENTS%", generateEventsTable(list));
+	userData->getTriggerScope().enter(thread, returnAddress, stackPointer, ownsBreakpoint);
 
-	writeOutput(hotchDir + "/" + filename, templateString);
+	return true;
 }
 
 /**
-* Creates a map that is used to count function hits and how much time
-* is spent in each function.
+* Leaves the trigger scope and disables its breakpoints again.
 **/
-std::map<Offset, TimedBlock*> initFunctionMap()
+void leaveTriggerScope(UserData* userData)
 {
-	std::map<Offset, TimedBlock*> timedFunctions;
+	TriggerScope& scope = userData->getTriggerScope();
+	Debugger debugger;
 
-	IdaFile file = IdaFile();
+	enableScopeBreakpoints(userData, false);
 
-	for (FunctionIterator Iter = file.begin(); Iter != file.end(); ++Iter)
+	if (scope.ownsBreakpoint())
 	{
-		Offset functionOffset = Iter->getAddress();
-
-		timedFunctions[functionOffset] = new TimedBlock(functionOffset);
+		debugger.removeBreakpoint(static_cast<ea_t>(scope.getReturnAddress()));
 	}
 
-	return timedFunctions;
+	debugger.flush();
+
+	scope.leave();
 }
 
 /**
-* Takes the active breakpoints to create a map that is used to count
-* breakpoint hits and how much time is spent in blocks.
+* Queues the CPU time that the thread of the last recorded hit used up to now. The
+* time since that hit is split into on-CPU and off-CPU time with it.
 **/
-std::map<Offset, TimedBlock*> initBlockMap()
+void endLastHit(UserData* userData)
 {
-	std::map<Offset, TimedBlock*> timedBlocks;
-
-	IdaFile file = IdaFile();
-	Debugger debugger = file.getDebugger();
+	unsigned int thread = userData->getLastThread();
+	unsigned long long cpuTime;
 
-	// Initialize the time of each basic block to 0
-	for (unsigned int i=0;i<debugger.getNumberOfBreakpoints();i++)
+	if (thread != 0 && userData->getThreadClocks().getCpuTime(thread, cpuTime))
 	{
-		Breakpoint bp = debugger.getBreakpoint(i);
-
-		Offset breakpointAddress = bp.getAddress();
-
-		timedBlocks[breakpointAddress] = new TimedBlock(breakpointAddress);
+		userData->getWorker().addCpuTime(thread, cpuTime);
 	}
 
-	return timedBlocks;
+	userData->setLastThread(0);
 }
 
 /**
-* Calculates the block/function hits and the time spent in each block/function using the data
-* from the event list.
+* Follows the trigger scope of a triggered session at a breakpoint hit.
+* @return True if the hit belongs to the scope and is recorded
 **/
-void analyzeEventList(const std::list<Event>& list, std::map<Offset, TimedBlock*> timedBlocks, std::map<Offset, TimedBlock*> timedFunctions)
+bool updateTriggerScope(UserData* userData, thread_id_t thread, ea_t address)
 {
-	msg("Analyzing the profiler event list...\n");
-
-	_timeb lastTime;
-	Offset lastOffset(0);
+	TriggerScope& scope = userData->getTriggerScope();
 
-	// We calculate the time spent in each basic block
-	for (std::list<Event>::const_iterator Iter = list.begin(); Iter != list.end(); ++Iter)
+	if (scope.isInside() && address == scope.getReturnAddress())
 	{
-		_timeb currentTime = Iter->getTime();
-		Offset currentOffset = Iter->getAddress();
-
-		// Increase the hit counter at the basic block defined by the breakpoint.
-		timedBlocks[currentOffset]->hit();
-
-		// If the start of a function is hit, the hit counter of the function increases.
-		if (currentOffset.isFunctionStart())
-		{
-			if (timedFunctions.find(currentOffset) == timedFunctions.end())
-			{
-				msg("Internal Error: Invalid function I (%08X)\n", currentOffset.getAddress());
-			}
-
-			timedFunctions[currentOffset]->hit();
-		}
+		unsigned long long stackPointer;
 
-		// Skip the time calculation of the first event because we don't know how much time was spent
-		// on this block.
-		if (Iter == list.begin())
+		if (Debugger().getRegister(STACK_POINTER, stackPointer) && scope.isReturn(thread, address, stackPointer))
 		{
+			// Without the mark the analysis would join this call with the next one
+			endLastHit(userData);
 
-			lastTime = currentTime;
-			lastOffset = currentOffset;
-
-			continue;
-		}
+			userData->getWorker().addScopeExit(getCurrentTime());
 
-		unsigned int difference = (currentTime.time - lastTime.time) * 1000 + currentTime.millitm - lastTime.millitm;
+			leaveTriggerScope(userData);
 
-		if (timedBlocks.find(lastOffset) == timedBlocks.end())
-		{
-			msg("Internal Error: Invalid block\n");
+			return false;
 		}
 
-		// The time spent between the last breakpoint and the current breakpoint
-		// is added to the block that was hit previously.
-		timedBlocks[lastOffset]->addTime(difference);
-
-		// The time spent in a function is increased whenever a breakpoint inside a function is followed
-		// by another breakpoint hit (either inside or outside the function).
-		Function lastFunction = timedBlocks[lastOffset]->getParentFunction();
-		Offset lastFunctionOffset = lastFunction.getAddress();
-
-		if (timedFunctions.find(lastFunctionOffset) == timedFunctions.end())
+		// Returns of recursive calls are only recorded if they return to a profiled block
+		if (!userData->getBreakpoints().contains(address))
 		{
-			msg("Internal Error: Invalid function II\n");
+			return false;
 		}
+	}
 
-		timedFunctions[lastFunctionOffset]->addTime(difference);
-
-		lastTime = currentTime;
-		lastOffset = currentOffset;
+	if (!scope.isInside())
+	{
+		return address == scope.getTrigger() && enterTriggerScope(userData, thread);
 	}
+
+	// Other threads can run the code of the scope at the same time
+	return static_cast<unsigned int>(thread) == scope.getThread();
 }
 
-int debuggerCallback(void *user_data, int notification_code, va_list va);
+void initProfileMap(const BlockIndex& blockIndex, const BreakpointSet& breakpoints, ProfileMap& map);
 
 /**
-* When the process shuts down, the event list is analyzed and the profiling results are written
-* to the output file.
+* Keeps only the breakpoints of a counting session that are needed to infer the hits
+* of all blocks. All blocks are remembered as the profiled blocks of the session,
+* including the blocks with a breakpoint of the user. Those stay in the flow graph
+* but are never measured, so their hits are inferred like the others.
 **/
-void handleExitProcess(UserData* userData)
+void selectCounters(UserData* userData)
 {
-	IdaFile file = IdaFile();
+	BreakpointSet& breakpoints = userData->getBreakpoints();
+	Debugger debugger;
 
-	std::list<Event>& list = userData->getEventList().getList();
+	userData->getProfiledBlocks() = breakpoints;
 
-	std::map<Offset, TimedBlock*> timedBlocks = initBlockMap();
-	std::map<Offset, TimedBlock*> timedFunctions = initFunctionMap();
+	ProfileMap map;
 
-	analyzeEventList(list, timedBlocks, timedFunctions);
+	initProfileMap(BlockIndex(), breakpoints, map);
 
-	std::list<TimedBlock*> blockResults = projectSecond(timedBlocks);
-	std::list<TimedBlock*> functionResults = projectSecond(timedFunctions);
+	std::vector<bool> userBreakpoints(map.getNumberOfBlocks());
 
-	writeOutput(list, blockResults, functionResults);
-
-	for (std::map<Offset, TimedBlock*>::iterator Iter = timedBlocks.begin(); Iter != timedBlocks.end(); ++Iter)
+	for (unsigned int i=0;i<map.getNumberOfBlocks();i++)
 	{
-		delete Iter->second;
+		userBreakpoints[i] = debugger.hasBreakpoint(static_cast<ea_t>(map.getBlock(i).getAddress()));
 	}
 
-	removeBreakpoints();
+	placeCounters(map, userBreakpoints);
 
-	// Remove the debugger notification callback and get rid of the old userData
-	file.getDebugger().removeEventCallback(debuggerCallback, userData);
+	breakpoints.clear();
 
-	delete userData;
+	std::vector<address_t> profiled;
+	std::vector<address_t> measured;
+
+	for (unsigned int i=0;i<map.getNumberOfBlocks();i++)
+	{
+		profiled.push_back(map.getBlock(i).getAddress());
+
+		if (map.getBlock(i).isMeasured())
+		{
+			breakpoints.add(map.getBlock(i).getAddress());
+			measured.push_back(map.getBlock(i).getAddress());
+		}
+	}
+
+	// A continued session must record the same blocks
+	userData->getCheckpointer().setCountedBlocks(profiled, measured);
+
+	msg("Counting the hits of %u blocks with %u breakpoints\n", map.getNumberOfBlocks(), breakpoints.size());
 }
 
 /**
-* Debugger callback that handles events that are necessary for profiling.
+* Moves the measured blocks of a trampoline session to counter trampolines, or
+* remembers to do so at the first breakpoint hit if the process does not exist yet.
 **/
-int debuggerCallback(void *user_data, int notification_code, va_list va)
+void startTrampolines(UserData* userData)
 {
-	UserData* userData = (UserData*)user_data;
-	IdaFile file;
-	Debugger debugger = file.getDebugger();
+	if (userData->getTrampolines().isCreated() || trampolinesPending)
+	{
+		return;
+	}
 
-	if (notification_code == Debugger::EVENT_BREAKPOINT)
+	if (Debugger().isActive())
 	{
-		// Get the Thread ID
-		thread_id_t tid = va_arg(va, thread_id_t);
+		installTrampolines(userData);
+	}
+	else
+	{
+		// The process does not exist yet
+		trampolinesPending = true;
 
-		// Get the address of where the breakpoint was hit
-		ea_t addr = va_arg(va, ea_t);
+		msg("The counter trampolines are installed at the first breakpoint hit\n");
+	}
+}
+
+/**
+* Sets breakpoints on all basic blocks, or on the blocks a counting or triggered
+* session needs. The breakpoints are requested together and set in a single batch.
+* The breakpoints of a triggered session start out disabled.
+**/
+void setBreakpoints(UserData* userData)
+{
+	msg("Setting breakpoints on all basic blocks...\n");
 
-		_timeb timebuffer;
-		_ftime64_s( &timebuffer );
-		userData->getEventList().addEvent(Event(addr, timebuffer));
+	BreakpointSet& breakpoints = userData->getBreakpoints();
 
-		debugger.resumeProcess(true);
-	}
-	else if (notification_code == Debugger::EVENT_PROCESS_SUSPENDED)
+	// The blocks of a counting session are only selected once; a continued session
+	// takes them from the checkpoint
+	if (!userData->isCounting() || userData->getProfiledBlocks().size() == 0)
 	{
-		setBreakpoints();
+		breakpoints.clear();
 
-		msg("Resuming target process...\n");
+		// Counting sessions keep the blocks of the user in the flow graph
+		BreakpointCollector collector(breakpoints, !userData->isCounting());
 
-		debugger.resumeProcess(true);
+		iterateBasicBlocks(collector);
+
+		if (userData->isCounting())
+		{
+			selectCounters(userData);
+		}
 	}
-	else if (notification_code == Debugger::EVENT_PROCESS_EXIT)
+
+	if (userData->isInstrumenting())
 	{
-		handleExitProcess(userData);
+		startTrampolines(userData);
 	}
 
-	return 0;
+	if (userData->getTriggerScope().isTriggered())
+	{
+		selectTriggerScope(userData);
+	}
+
+	Debugger debugger = IdaFile().getDebugger();
+
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		debugger.setBreakpoint(static_cast<ea_t>(breakpoints.getAddress(i)));
+	}
+
+	if (userData->getTriggerScope().isTriggered())
+	{
+		enableScopeBreakpoints(userData, false);
+	}
+
+	debugger.flush();
+
+	msg("Set %u breakpoints\n", breakpoints.size());
+}
+
+/**
+* Removes the breakpoints that were set on the basic blocks in a single batch.
+**/
+void removeBreakpoints(const BreakpointSet& breakpoints)
+{
+	Debugger debugger = IdaFile().getDebugger();
+
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		debugger.removeBreakpoint(static_cast<ea_t>(breakpoints.getAddress(i)));
+	}
+
+	debugger.flush();
+}
+
+/**
+* Prepares the sampling of the instruction pointers. Every basic block becomes an
+* address range that ends at the next block or at the end of its function.
+**/
+void initSampling(UserData* userData)
+{
+	msg("Collecting the basic blocks for sampling...\n");
+
+	BreakpointSet& blocks = userData->getBreakpoints();
+
+	blocks.clear();
+
+	BreakpointCollector collector(blocks, false);
+
+	iterateBasicBlocks(collector);
+
+	std::vector<address_t> starts;
+
+	for (unsigned int i=0;i<blocks.size();i++)
+	{
+		starts.push_back(blocks.getAddress(i));
+	}
+
+	std::sort(starts.begin(), starts.end());
+
+	BlockRanges ranges;
+
+	for (unsigned int i=0;i<starts.size();i++)
+	{
+		func_t* function = get_func(static_cast<ea_t>(starts[i]));
+
+		address_t end = function ? function->endEA : get_item_end(static_cast<ea_t>(starts[i]));
+
+		if (i + 1 < starts.size() && starts[i + 1] < end)
+		{
+			end = starts[i + 1];
+		}
+
+		ranges.add(starts[i], end);
+	}
+
+	userData->getSamples().setRanges(ranges);
+
+	msg("Sampling %u blocks every %u ms\n", ranges.size(), SAMPLING_INTERVAL);
+}
+
+/**
+* Attributes the instruction pointer of every thread of the suspended target
+* process to its block.
+**/
+void takeSamples(UserData* userData)
+{
+	SampleCounter& samples = userData->getSamples();
+
+	std::vector<address_t> addresses = getInstructionPointers();
+
+	for (unsigned int i=0;i<addresses.size();i++)
+	{
+		samples.addSample(addresses[i]);
+	}
+}
+
+/**
+* Timer of sampling sessions that suspends the running target process to take
+* a sample. The sample is taken when the debugger reports the suspension.
+**/
+void CALLBACK sampleProcess(HWND, UINT, UINT_PTR, DWORD)
+{
+	Debugger debugger = IdaFile().getDebugger();
+
+	// Suspending the process runs a message loop that can call the timer again
+	if (samplePending || !activeSession || activeSession->isStopping() || !debugger.isActive() || debugger.isSuspended())
+	{
+		return;
+	}
+
+	samplePending = true;
+
+	debugger.suspendProcess(true);
+}
+
+/**
+* Returns the directory that contains the report template and the results.
+**/
+std::string getHotchDirectory()
+{
+	std::string pluginDir = ::idadir("plugins");
+
+	return pluginDir + "/hotch";
+}
+
+/**
+* Adds the block at the given address to the profile map.
+**/
+void addProfileBlock(ProfileMap& map, ea_t address)
+{
+	func_t* function = get_func(address);
+
+	map.addBlock(address, function ? map.findFunction(function->startEA) : ProfileMap::NO_FUNCTION);
+}
+
+/**
+* Collects the targets of the code references of an instruction, including the
+* next instruction if execution falls through to it. Calls are not included.
+**/
+void getFlowTargets(ea_t address, std::vector<ea_t>& targets)
+{
+	targets.clear();
+
+	xrefblk_t xref;
+
+	for (bool found = xref.first_from(address, XREF_ALL); found; found = xref.next_from())
+	{
+		if (xref.iscode && xref.type != fl_CF && xref.type != fl_CN)
+		{
+			targets.push_back(xref.to);
+		}
+	}
+}
+
+/**
+* Returns the last instruction of a block. A block ends at the first instruction
+* that does more than fall through to the next instruction or that falls through
+* to the start of another block.
+**/
+ea_t getLastInstruction(const ProfileMap& map, unsigned int block)
+{
+	ea_t current = static_cast<ea_t>(map.getBlock(block).getAddress());
+
+	std::vector<ea_t> targets;
+
+	while (true)
+	{
+		ea_t next = get_item_end(current);
+
+		getFlowTargets(current, targets);
+
+		if (targets.size() != 1 || targets[0] != next || map.findBlock(next) != BlockIndex::INVALID_INDEX)
+		{
+			return current;
+		}
+
+		current = next;
+	}
+}
+
+/**
+* Adds the control flow edges that leave a block to the profile map.
+* @param last The last instruction of the block
+**/
+void addBlockEdges(ProfileMap& map, unsigned int block, ea_t last)
+{
+	unsigned int function = map.getBlock(block).getFunction();
+
+	std::vector<ea_t> targets;
+
+	getFlowTargets(last, targets);
+
+	for (std::vector<ea_t>::const_iterator Iter = targets.begin(); Iter != targets.end(); ++Iter)
+	{
+		unsigned int target = map.findBlock(*Iter);
+
+		if (target != BlockIndex::INVALID_INDEX && map.getBlock(target).getFunction() == function)
+		{
+			map.addEdge(block, target);
+		}
+	}
+}
+
+/**
+* Remembers the module of an entry of the import address table.
+**/
+int idaapi collectImport(ea_t ea, const char*, uval_t, void* param)
+{
+	std::pair<std::map<ea_t, std::string>*, std::string>* imports = static_cast<std::pair<std::map<ea_t, std::string>*, std::string>*>(param);
+
+	(*imports->first)[ea] = imports->second;
+
+	return 1;
+}
+
+/**
+* Returns the module of each entry of the import address table.
+**/
+std::map<ea_t, std::string> getImportModules()
+{
+	std::map<ea_t, std::string> modules;
+
+	for (int i=0;i<get_import_module_qty();i++)
+	{
+		char buffer[200] = {0};
+
+		if (!get_import_module_name(i, buffer, sizeof(buffer)))
+		{
+			continue;
+		}
+
+		std::pair<std::map<ea_t, std::string>*, std::string> imports(&modules, buffer);
+
+		enum_import_names(i, collectImport, &imports);
+	}
+
+	return modules;
+}
+
+/**
+* Adds the segments of the profiled file and the demangled names and import modules
+* of its functions to the profile map. A thunk belongs to the module of the import
+* it jumps to.
+**/
+void addGroups(ProfileMap& map)
+{
+	for (int i=0;i<get_segm_qty();i++)
+	{
+		segment_t* segment = getnseg(i);
+		char buffer[200] = {0};
+
+		get_segm_name(segment, buffer, sizeof(buffer));
+
+		map.addSegment(segment->startEA, segment->endEA, buffer);
+	}
+
+	std::map<ea_t, std::string> importModules = getImportModules();
+
+	IdaFile file = IdaFile();
+
+	unsigned int index = 0;
+
+	for (FunctionIterator Iter = file.begin(); Iter != file.end(); ++Iter, ++index)
+	{
+		std::string name = Iter->getName();
+		char buffer[MAXSTR] = {0};
+
+		if (demangle_name(buffer, sizeof(buffer), name.c_str(), MNG_LONG_FORM) > 0 && name != buffer)
+		{
+			map.setDemangledName(index, buffer);
+		}
+
+		xrefblk_t xref;
+
+		if (Iter->isThunk() && xref.first_from(Iter->getAddress().getAddress(), XREF_DATA))
+		{
+			std::map<ea_t, std::string>::const_iterator module = importModules.find(xref.to);
+
+			if (module != importModules.end())
+			{
+				map.setModule(index, module->second);
+			}
+		}
+	}
+}
+
+/**
+* Creates the profile map of the profiled file. The blocks that were hit come first, in the
+* order of their trace indices, followed by all other profile breakpoints, with the
+* sizes of the blocks and the control flow edges between them.
+**/
+void initProfileMap(const BlockIndex& blockIndex, const BreakpointSet& breakpoints, ProfileMap& map)
+{
+	IdaFile file = IdaFile();
+
+	map.setInputFile(file.getInputfilePath());
+
+	for (FunctionIterator Iter = file.begin(); Iter != file.end(); ++Iter)
+	{
+		map.addFunction(Iter->getAddress().getAddress(), Iter->getName());
+	}
+
+	addGroups(map);
+
+	for (unsigned int i=0;i<blockIndex.size();i++)
+	{
+		addProfileBlock(map, static_cast<ea_t>(blockIndex.getAddress(i)));
+	}
+
+	for (unsigned int i=0;i<breakpoints.size();i++)
+	{
+		addProfileBlock(map, static_cast<ea_t>(breakpoints.getAddress(i)));
+	}
+
+	for (unsigned int i=0;i<map.getNumberOfBlocks();i++)
+	{
+		ea_t last = getLastInstruction(map, i);
+
+		map.setBlockSize(i, static_cast<unsigned int>(get_item_end(last) - map.getBlock(i).getAddress()));
+
+		if (map.getBlock(i).getFunction() != ProfileMap::NO_FUNCTION)
+		{
+			addBlockEdges(map, i, last);
+		}
+	}
+}
+
+/**
+* Rewinds the trace file for another pass over the events.
+**/
+std::istream& rewindTrace(std::ifstream& traceFile)
+{
+	traceFile.clear();
+	traceFile.seekg(0);
+
+	return traceFile;
+}
+
+/**
+* Writes the results of a detached session on a thread of its own so that IDA stays
+* responsive. The job works on a snapshot of the session taken up front: the profile
+* map with the names of all blocks and functions, the samples and the closed trace
+* file. Annotating the database needs IDA and is left to the main thread once the
+* job is done, as is showing the messages of the job.
+**/
+class ReportJob
+{
+private:
+	ProfileMap map;
+	Profile* profile;
+
+	SampleCounter samples;
+	bool sampling;
+
+	std::string directory;
+	std::string traceFilename;
+	std::string overheadReport;
+
+	unsigned long long events;
+
+	HANDLE thread;
+
+	volatile LONG cancelled;
+	volatile LONG finished;
+
+	// True if the job went through all stages
+	bool complete;
+
+	CRITICAL_SECTION lock;
+	std::vector<std::string> messages;
+
+	unsigned int stage;
+
+	static DWORD WINAPI run(LPVOID parameter);
+
+	void addMessage(const char* format, ...);
+
+	bool enterStage(const char* name);
+
+	bool writeOutputs(std::ifstream& traceFile);
+
+public:
+	/**
+	* @param samples The samples of a sampling session or 0
+	**/
+	ReportJob(const ProfileMap& map, const SampleCounter* samples, const std::string& directory, const std::string& traceFilename, unsigned long long events, const std::string& overheadReport);
+
+	~ReportJob();
+
+	/**
+	* Starts writing the results on the thread of the job.
+	* @return False if the thread could not be created
+	**/
+	bool start();
+
+	/**
+	* Writes the results on the calling thread.
+	**/
+	void write();
+
+	/**
+	* Makes the job stop at the next stage.
+	**/
+	void cancel() { InterlockedExchange(&cancelled, 1); }
+
+	bool isCancelled() const { return cancelled != 0; }
+
+	bool isFinished() const { return finished != 0; }
+
+	/**
+	* Returns true if the finished job wrote all results. A job that was cancelled
+	* during its last stage still completes it.
+	**/
+	bool isComplete() const { return complete; }
+
+	/**
+	* Returns the messages of the job since the last call.
+	**/
+	std::vector<std::string> takeMessages();
+
+	const ProfileMap& getMap() const { return map; }
+
+	Profile& getProfile() { return *profile; }
+};
+
+ReportJob::ReportJob(const ProfileMap& map, const SampleCounter* samples, const std::string& directory, const std::string& traceFilename, unsigned long long events, const std::string& overheadReport) : map(map), profile(0), sampling(samples != 0), directory(directory), traceFilename(traceFilename), overheadReport(overheadReport), events(events), thread(0), cancelled(0), finished(0), complete(false), stage(0)
+{
+	if (samples)
+	{
+		this->samples = *samples;
+	}
+
+	InitializeCriticalSection(&lock);
+}
+
+ReportJob::~ReportJob()
+{
+	if (thread)
+	{
+		WaitForSingleObject(thread, INFINITE);
+
+		CloseHandle(thread);
+	}
+
+	DeleteCriticalSection(&lock);
+
+	delete profile;
+}
+
+bool ReportJob::start()
+{
+	thread = CreateThread(NULL, 0, run, this, 0, NULL);
+
+	return thread != 0;
+}
+
+DWORD WINAPI ReportJob::run(LPVOID parameter)
+{
+	static_cast<ReportJob*>(parameter)->write();
+
+	return 0;
+}
+
+void ReportJob::addMessage(const char* format, ...)
+{
+	char buffer[MAXSTR];
+
+	va_list va;
+
+	va_start(va, format);
+	qvsnprintf(buffer, sizeof(buffer), format, va);
+	va_end(va);
+
+	EnterCriticalSection(&lock);
+
+	messages.push_back(buffer);
+
+	LeaveCriticalSection(&lock);
+}
+
+std::vector<std::string> ReportJob::takeMessages()
+{
+	std::vector<std::string> result;
+
+	EnterCriticalSection(&lock);
+
+	result.swap(messages);
+
+	LeaveCriticalSection(&lock);
+
+	return result;
+}
+
+/**
+* Announces the next stage of the job.
+* @return False if the job was cancelled
+**/
+bool ReportJob::enterStage(const char* name)
+{
+	if (isCancelled())
+	{
+		return false;
+	}
+
+	addMessage("%s (%u/%u)...\n", name, ++stage, NUMBER_OF_REPORT_STAGES);
+
+	return true;
+}
+
+void ReportJob::write()
+{
+	std::ifstream traceFile(traceFilename.c_str(), std::ios::binary);
+
+	addMessage("Recorded %s events in %s bytes\n", toString(events).c_str(), toString(getFileSize(traceFile)).c_str());
+
+	complete = writeOutputs(traceFile);
+
+	InterlockedExchange(&finished, 1);
+}
+
+/**
+* Analyzes the trace and writes all output files, one stage at a time.
+* @return False if the job was cancelled before its last stage
+**/
+bool ReportJob::writeOutputs(std::ifstream& traceFile)
+{
+	if (!enterStage("Indexing the trace"))
+	{
+		return false;
+	}
+
+	TraceIndex index;
+	TraceDecoder indexedEvents(rewindTrace(traceFile));
+
+	index.build(indexedEvents);
+
+	if (!writeTraceIndex(directory + "/results.index", index))
+	{
+		addMessage("Could not write the trace index\n");
+	}
+
+	if (!enterStage("Exporting the profile"))
+	{
+		return false;
+	}
+
+	if (!writeProfileMap(directory + "/results.map", map))
+	{
+		addMessage("Could not write the profile map\n");
+	}
+
+	// Counting traces only hold the measured blocks and sampling sessions record no events,
+	// so their calls and transitions are not the real ones
+	bool hasTransitions = !sampling && !map.isCounting();
+
+	if (!hasTransitions)
+	{
+		addMessage("The timeline, the code layout and the paths are not written for %s sessions\n", sampling ? "sampling" : "counting");
+	}
+	else
+	{
+		std::ofstream timeline((directory + "/timeline.json").c_str());
+		TraceDecoder timelineEvents(rewindTrace(traceFile));
+
+		exportChromeTrace(timelineEvents, map, timeline);
+
+		if (!timeline)
+		{
+			addMessage("Could not write the timeline\n");
+		}
+	}
+
+	if (!enterStage("Analyzing the profiler event list"))
+	{
+		return false;
+	}
+
+	profile = new Profile(map);
+
+	TraceDecoder decoder(rewindTrace(traceFile));
+
+	if (map.isCounting())
+	{
+		unsigned int unresolved = analyzeCounts(decoder, map, *profile);
+
+		addMessage("Inferred the hits of %u blocks from %u measured blocks\n", map.getNumberOfBlocks() - map.getNumberOfMeasuredBlocks() - unresolved, map.getNumberOfMeasuredBlocks());
+
+		if (unresolved != 0)
+		{
+			addMessage("The hits of %u blocks could not be inferred\n", unresolved);
+		}
+	}
+	else
+	{
+		analyzeEventList(decoder, map, *profile);
+	}
+
+	if (sampling)
+	{
+		addMessage("Took %s samples, %s of them outside of the profiled blocks\n", toString(samples.getNumberOfSamples()).c_str(), toString(samples.getNumberOfUnknownSamples()).c_str());
+
+		analyzeSamples(samples, map, *profile, SAMPLING_INTERVAL);
+	}
+
+	if (!enterStage("Writing the statistics"))
+	{
+		return false;
+	}
+
+	if (!writeCoverage(directory + "/results.cov", CoverageLayout(map).getCoverage(*profile)))
+	{
+		addMessage("Could not write the coverage file\n");
+	}
+
+	std::ofstream statistics((directory + "/results.csv").c_str());
+
+	writeStatistics(statistics, map, *profile);
+
+	if (!statistics)
+	{
+		addMessage("Could not write the statistics file\n");
+	}
+
+	std::ofstream contexts((directory + "/results.folded").c_str());
+
+	writeFoldedContexts(contexts, map, profile->getContexts());
+
+	if (!contexts)
+	{
+		addMessage("Could not write the calling contexts\n");
+	}
+
+	RollupTree tree;
+
+	createRollups(map, *profile, tree);
+
+	std::ofstream rollups((directory + "/results.rollup.csv").c_str());
+
+	writeRollups(rollups, tree);
+
+	if (!rollups)
+	{
+		addMessage("Could not write the rollups\n");
+	}
+
+	if (!enterStage("Computing the code layout"))
+	{
+		return false;
+	}
+
+	if (hasTransitions)
+	{
+		LayoutProfiler layoutProfiler(map);
+		TraceDecoder layoutEvents(rewindTrace(traceFile));
+
+		profileLayout(layoutEvents, layoutProfiler);
+
+		CodeLayout layout(map, layoutProfiler);
+
+		std::ofstream symbolOrder((directory + "/results.order").c_str());
+
+		writeSymbolOrder(symbolOrder, map, layout);
+
+		std::ofstream layoutReport((directory + "/results.layout.txt").c_str());
+
+		writeLayoutReport(layoutReport, map, layout);
+
+		if (!symbolOrder || !layoutReport)
+		{
+			addMessage("Could not write the code layout\n");
+		}
+	}
+
+	if (!enterStage("Counting the paths"))
+	{
+		return false;
+	}
+
+	// Paths need every block of a call
+	if (hasTransitions)
+	{
+		PathProfiler pathProfiler(map);
+		TraceDecoder pathEvents(rewindTrace(traceFile));
+
+		profilePaths(pathEvents, pathProfiler);
+
+		std::ofstream paths((directory + "/results.paths.txt").c_str());
+
+		writePathReport(paths, map, pathProfiler);
+
+		if (!paths)
+		{
+			addMessage("Could not write the hot paths\n");
+		}
+	}
+
+	if (!enterStage("Generating the output file"))
+	{
+		return false;
+	}
+
+	TraceDecoder events(rewindTrace(traceFile));
+
+	if (!writeOutput(directory + "/template.htm", directory + "/results.html", map, *profile, events, overheadReport))
+	{
+		addMessage("Could not read template file\n");
+	}
+
+	return true;
+}
+
+/**
+* Returns the color of a block that took the given time. The colors cover four
+* orders of magnitude below the time of the hottest block.
+**/
+bgcolor_t getHeatColor(unsigned long long time, unsigned long long maximumTime)
+{
+	if (time == 0)
+	{
+		return HEAT_COLORS[0];
+	}
+
+	double level = (NUMBER_OF_HEAT_COLORS - 1) * (1.0 + std::log10(1.0 * time / maximumTime) / 4.0);
+
+	return HEAT_COLORS[level < 0 ? 0 : static_cast<unsigned int>(level + 0.5)];
+}
+
+/**
+* Colors all instructions of a block.
+**/
+void setBlockColor(const ProfileMap& map, unsigned int block, bgcolor_t color)
+{
+	ea_t last = getLastInstruction(map, block);
+
+	for (ea_t current = static_cast<ea_t>(map.getBlock(block).getAddress()); ; current = get_item_end(current))
+	{
+		Offset(current).setColor(color);
+
+		if (current == last)
+		{
+			break;
+		}
+	}
+}
+
+/**
+* Replaces the Hotch line of a comment and keeps all other lines.
+* @param line The new Hotch line or an empty string to remove it
+**/
+std::string mergeComment(const std::string& comment, const std::string& line)
+{
+	std::istringstream lines(comment);
+
+	std::string result;
+	std::string current;
+
+	while (std::getline(lines, current))
+	{
+		if (current.compare(0, COMMENT_PREFIX.size(), COMMENT_PREFIX) != 0)
+		{
+			result += result.empty() ? current : "\n" + current;
+		}
+	}
+
+	if (!line.empty())
+	{
+		result += result.empty() ? line : "\n" + line;
+	}
+
+	return result;
+}
+
+/**
+* Shows the results of a profiling run in the database: hit blocks are colored by
+* the time spent in them and functions get a comment line with their statistics.
+* The colors and comments of an earlier run are replaced. The views are refreshed
+* once at the end.
+**/
+void annotateDatabase(const ProfileMap& map, Profile& profile)
+{
+	msg("Annotating the database...\n");
+
+	RefreshBatch batch;
+
+	unsigned long long maximumTime = 0;
+	unsigned long long totalTime = 0;
+
+	for (unsigned int i=0;i<profile.getNumberOfBlocks();i++)
+	{
+		maximumTime = std::max(maximumTime, profile.getBlock(i).getTime());
+		totalTime += profile.getBlock(i).getTime();
+	}
+
+	for (unsigned int i=0;i<profile.getNumberOfBlocks();i++)
+	{
+		const TimedBlock& block = profile.getBlock(i);
+
+		if (block.getHits() != 0)
+		{
+			setBlockColor(map, i, getHeatColor(block.getTime(), maximumTime));
+		}
+		else if (std::find(HEAT_COLORS, HEAT_COLORS + NUMBER_OF_HEAT_COLORS, Offset(static_cast<ea_t>(block.getAddress())).getColor()) != HEAT_COLORS + NUMBER_OF_HEAT_COLORS)
+		{
+			setBlockColor(map, i, DEFCOLOR);
+		}
+	}
+
+	for (unsigned int i=0;i<profile.getNumberOfFunctions();i++)
+	{
+		const TimedBlock& statistics = profile.getFunction(i);
+
+		func_t* function = get_func(static_cast<ea_t>(statistics.getAddress()));
+
+		if (!function)
+		{
+			continue;
+		}
+
+		std::ostringstream line;
+
+		if (statistics.getHits() != 0 || statistics.getTime() != 0)
+		{
+			const LatencySketch& latency = statistics.getLatency();
+
+			line << COMMENT_PREFIX << statistics.getHits() << " calls, " << statistics.getTime() << " ms (";
+			line << std::fixed << std::setprecision(2) << (totalTime ? 100.0 * statistics.getTime() / totalTime : 0.0) << "% of the time), ";
+			line << "call p50/p95/p99 " << latency.getQuantile(0.50) << "/" << latency.getQuantile(0.95) << "/" << latency.getQuantile(0.99) << " ms";
+		}
+
+		Function annotated(function);
+
+		std::string comment = annotated.getComment();
+		std::string merged = mergeComment(comment, line.str());
+
+		if (merged != comment)
+		{
+			annotated.setComment(merged);
+		}
+	}
+}
+
+int debuggerCallback(void *user_data, int notification_code, va_list va);
+
+/**
+* Ends the profiling of the target process: the profile breakpoints are removed,
+* sampling stops and the debugger events are no longer handled.
+**/
+void detachSession(UserData* userData)
+{
+	IdaFile file;
+
+	if (samplingTimer)
+	{
+		KillTimer(NULL, samplingTimer);
+
+		samplingTimer = 0;
+	}
+
+	// A stop or the exit of the process can take the place of a pending sample suspension
+	samplePending = false;
+
+	if (!userData->isSampling())
+	{
+		removeBreakpoints(userData->getBreakpoints());
+	}
+
+	if (userData->isInstrumenting())
+	{
+		removeTrampolines(userData);
+	}
+
+	TriggerScope& scope = userData->getTriggerScope();
+
+	if (scope.isTriggered())
+	{
+		if (scope.isInside())
+		{
+			leaveTriggerScope(userData);
+		}
+
+		msg("Profiled %u calls of the trigger function\n", scope.getNumberOfEntries());
+	}
+
+	file.getDebugger().removeEventCallback(debuggerCallback, userData);
+
+	userData->getWorker().stop();
+
+	activeSession = 0;
+}
+
+/**
+* Shows the messages of the report job and annotates the database once the job is
+* done.
+**/
+void CALLBACK pollReport(HWND, UINT, UINT_PTR, DWORD)
+{
+	if (!reportJob)
+	{
+		return;
+	}
+
+	std::vector<std::string> messages = reportJob->takeMessages();
+
+	for (std::vector<std::string>::const_iterator Iter = messages.begin(); Iter != messages.end(); ++Iter)
+	{
+		msg("%s", Iter->c_str());
+	}
+
+	if (!reportJob->isFinished())
+	{
+		return;
+	}
+
+	KillTimer(NULL, reportTimer);
+
+	reportTimer = 0;
+
+	if (!reportJob->isComplete())
+	{
+		msg("Writing the results was cancelled\n");
+	}
+	else
+	{
+		annotateDatabase(reportJob->getMap(), reportJob->getProfile());
+
+		msg("The results were written to %s\n", getHotchDirectory().c_str());
+	}
+
+	delete reportJob;
+
+	reportJob = 0;
+}
+
+/**
+* Takes a snapshot of a detached session and writes its profiling results to the
+* output files in the background. The session is deleted afterwards.
+**/
+void writeResults(UserData* userData)
+{
+	TraceEncoder& trace = userData->getTrace();
+	Checkpointer& checkpointer = userData->getCheckpointer();
+
+	OverheadMonitor& overhead = userData->getOverhead();
+
+	overhead.setEventStoreSize(trace.getData().size());
+
+	std::string overheadReport = overhead.getSessionReport(getCurrentTime());
+
+	msg("Profiler overhead: %s\n", overheadReport.c_str());
+
+	CounterTrampolines& trampolines = userData->getTrampolines();
+
+	BreakpointSet instrumentedBlocks;
+
+	if (trampolines.getNumberOfBlocks() != 0)
+	{
+		std::vector<unsigned char> payload;
+
+		for (unsigned int i=0;i<trampolines.getNumberOfBlocks();i++)
+		{
+			Trace::appendVarint(payload, userData->getBlockIndex().addBlock(trampolines.getBlock(i)));
+			Trace::appendVarint(payload, trampolines.getCount(i));
+
+			instrumentedBlocks.add(trampolines.getBlock(i));
+		}
+
+		trace.addRecord(Trace::EXTENDED_BLOCK_HITS, payload);
+	}
+
+	if (userData->isSampling())
+	{
+		trace.addRecord(Trace::EXTENDED_SAMPLES, encodeSamples(userData->getSamples(), SAMPLING_INTERVAL));
+	}
+
+	if (!checkpointer.close(trace))
+	{
+		msg("Could not write the trace file\n");
+	}
+
+	// The names of the blocks and functions come from the IDB and are taken here
+	ProfileMap map;
+
+	initProfileMap(userData->getBlockIndex(), userData->isCounting() ? userData->getProfiledBlocks() : userData->getBreakpoints(), map);
+
+	if (userData->isCounting())
+	{
+		for (unsigned int i=0;i<map.getNumberOfBlocks();i++)
+		{
+			if (userData->getBreakpoints().contains(map.getBlock(i).getAddress()) || instrumentedBlocks.contains(map.getBlock(i).getAddress()))
+			{
+				map.setMeasured(i);
+			}
+		}
+	}
+
+	reportJob = new ReportJob(map, userData->isSampling() ? &userData->getSamples() : 0, getHotchDirectory(), checkpointer.getTraceFilename(), trace.getNumberOfEvents(), overheadReport);
+
+	delete userData;
+
+	if (!reportJob->start())
+	{
+		msg("Could not start the report thread, writing the results now\n");
+
+		reportJob->write();
+	}
+
+	reportTimer = SetTimer(NULL, 0, REPORT_POLL_INTERVAL, pollReport);
+
+	msg("Writing the results in the background, run Hotch again to cancel\n");
+}
+
+/**
+* When the process shuts down, the event list is analyzed and the profiling results are written
+* to the output file.
+**/
+void handleExitProcess(UserData* userData)
+{
+	detachSession(userData);
+
+	writeResults(userData);
+}
+
+/**
+* Stops profiling a suspended target process and writes the results. The target
+* keeps running without breakpoints while the results are written.
+* @param resume True to resume the target process
+**/
+void stopProfiling(UserData* userData, bool resume)
+{
+	msg("Stopping the profiler...\n");
+
+	detachSession(userData);
+
+	if (resume)
+	{
+		msg("Resuming target process...\n");
+
+		IdaFile().getDebugger().resumeProcess(true);
+	}
+
+	writeResults(userData);
+}
+
+/**
+* Debugger callback that handles events that are necessary for profiling.
+**/
+int debuggerCallback(void *user_data, int notification_code, va_list va)
+{
+	UserData* userData = (UserData*)user_data;
+	Debugger debugger;
+
+	if (notification_code == Debugger::EVENT_BREAKPOINT)
+	{
+		unsigned long long callbackStart = getMicroseconds();
+
+		// Get the Thread ID
+		thread_id_t tid = va_arg(va, thread_id_t);
+
+		// Get the address of where the breakpoint was hit
+		ea_t addr = va_arg(va, ea_t);
+
+		TriggerScope& scope = userData->getTriggerScope();
+
+		bool isReturn = scope.isInside() && addr == scope.getReturnAddress();
+
+		// The return address of the trigger function can have a breakpoint of the user too
+		bool isUserBreakpoint = !userData->getBreakpoints().contains(addr) && !(isReturn && scope.ownsBreakpoint());
+
+		// Breakpoints of the user stop the process as usual
+		if (userData->isSampling() || (isUserBreakpoint && !isReturn))
+		{
+			return 0;
+		}
+
+		// Hits outside of the trigger scope are not recorded
+		if (scope.isTriggered() && !updateTriggerScope(userData, tid, addr))
+		{
+			if (!isUserBreakpoint)
+			{
+				debugger.resumeProcess(true);
+			}
+
+			return 0;
+		}
+
+		unsigned long long time = getCurrentTime();
+
+		// The worker thread stores the event while the target runs on
+		EventWorker& worker = userData->getWorker();
+
+		// The CPU time of this thread ends the time of the last hit if it came from the same thread
+		if (userData->getLastThread() != static_cast<unsigned int>(tid))
+		{
+			endLastHit(userData);
+		}
+
+		unsigned long long cpuTime;
+
+		if (!userData->getThreadClocks().getCpuTime(tid, cpuTime))
+		{
+			cpuTime = NO_CPU_TIME;
+		}
+
+		worker.addEvent(addr, tid, time, cpuTime);
+
+		userData->setLastThread(tid);
+
+		if (trampolinesPending)
+		{
+			trampolinesPending = false;
+
+			installTrampolines(userData);
+		}
+
+		OverheadMonitor& overhead = userData->getOverhead();
+
+		if (overhead.isReportDue(time))
+		{
+			if (worker.takeFailedCheckpoints() != 0)
+			{
+				msg("Could not write the checkpoint\n");
+			}
+
+			overhead.setEventStoreSize(worker.getEventStoreSize());
+
+			msg("Hotch: %s\n", overhead.getIntervalReport(time).c_str());
+		}
+
+		unsigned long long resumeStart = getMicroseconds();
+
+		debugger.resumeProcess(true);
+
+		overhead.addEvent(resumeStart - callbackStart, getMicroseconds() - resumeStart);
+	}
+	else if (notification_code == Debugger::EVENT_PROCESS_SUSPENDED && userData->isStopping())
+	{
+		stopProfiling(userData, true);
+	}
+	else if (notification_code == Debugger::EVENT_PROCESS_SUSPENDED && userData->isSampling())
+	{
+		// Suspensions of the user are left alone
+		if (samplePending)
+		{
+			unsigned long long callbackStart = getMicroseconds();
+
+			takeSamples(userData);
+
+			samplePending = false;
+
+			unsigned long long resumeStart = getMicroseconds();
+
+			debugger.resumeProcess(true);
+
+			userData->getOverhead().addEvent(resumeStart - callbackStart, getMicroseconds() - resumeStart);
+		}
+	}
+	else if (notification_code == Debugger::EVENT_PROCESS_SUSPENDED)
+	{
+		setBreakpoints(userData);
+
+		msg("Resuming target process...\n");
+
+		debugger.resumeProcess(true);
+	}
+	else if (notification_code == Debugger::EVENT_THREAD_EXIT)
+	{
+		va_arg(va, pid_t);
+
+		thread_id_t thread = va_arg(va, thread_id_t);
+
+		// The handle of an exited thread still reads its final CPU time
+		if (userData->getLastThread() == static_cast<unsigned int>(thread))
+		{
+			endLastHit(userData);
+		}
+
+		// Thread IDs are reused, so the next thread with this ID needs a new handle
+		userData->getThreadClocks().removeThread(thread);
+	}
+	else if (notification_code == Debugger::EVENT_PROCESS_EXIT)
+	{
+		handleExitProcess(userData);
+	}
+
+	return 0;
+}
+
+
+/**
+* Returns the mode of a session. A checkpoint can only be continued by a session of
+* the same mode because the trace of each mode records other blocks.
+**/
+std::string getSessionMode(UserData* userData)
+{
+	if (userData->isSampling())
+	{
+		return "sampling";
+	}
+	else if (userData->isInstrumenting())
+	{
+		return "trampolines";
+	}
+	else if (userData->isCounting())
+	{
+		return "counting";
+	}
+	else if (userData->getTriggerScope().isTriggered())
+	{
+		std::ostringstream mode;
+
+		mode << "triggered " << std::hex << userData->getTriggerScope().getTrigger();
+
+		return mode.str();
+	}
+
+	return "breakpoints";
+}
+
+/**
+* Takes the blocks of a continued counting session from its checkpoint. Measured
+* blocks that got a breakpoint of the user in the meantime are left to the user.
+**/
+void restoreCountedBlocks(UserData* userData)
+{
+	const Checkpointer& checkpointer = userData->getCheckpointer();
+	Debugger debugger;
+
+	BreakpointSet& profiled = userData->getProfiledBlocks();
+	BreakpointSet& breakpoints = userData->getBreakpoints();
+
+	for (unsigned int i=0;i<checkpointer.getProfiledBlocks().size();i++)
+	{
+		profiled.add(checkpointer.getProfiledBlocks()[i]);
+	}
+
+	for (unsigned int i=0;i<checkpointer.getMeasuredBlocks().size();i++)
+	{
+		address_t address = checkpointer.getMeasuredBlocks()[i];
+
+		if (!debugger.hasBreakpoint(static_cast<ea_t>(address)))
+		{
+			breakpoints.add(address);
+		}
+	}
+}
+
+/**
+* Starts the trace of a session. If the last session was interrupted in the same
+* mode, the user can continue it instead of starting a new one. The checkpoint of
+* a session in another mode is discarded.
+* @param resume True to continue an interrupted session without asking
+**/
+void startTrace(UserData* userData, bool resume)
+{
+	Checkpointer& checkpointer = userData->getCheckpointer();
+
+	std::string mode = getSessionMode(userData);
+
+	checkpointer.setMode(mode);
+
+	if (checkpointer.hasCheckpoint())
+	{
+		std::string interruptedMode = checkpointer.readMode();
+
+		if (interruptedMode != mode)
+		{
+			msg("The interrupted session profiled in another mode (%s) and can not be continued\n", interruptedMode.empty() ? "unknown" : interruptedMode.c_str());
+		}
+		else if (resume || askyn_c(1, "The last profiling session was interrupted.\nDo you want to continue it?") == 1)
+		{
+			if (checkpointer.resume(userData->getBlockIndex(), userData->getTrace()))
+			{
+				if (userData->isCounting())
+				{
+					restoreCountedBlocks(userData);
+				}
+
+				msg("Continuing the interrupted session after %s events\n", toString(userData->getTrace().getNumberOfEvents()).c_str());
+
+				return;
+			}
+
+			msg("Could not read the checkpoint, starting a new session\n");
+		}
+	}
+
+	if (!checkpointer.start(userData->getTrace()))
+	{
+		msg("Could not create the trace file\n");
+	}
+}
+
+/**
+* Creates the state of a profiling session. If the last session was interrupted,
+* the user can continue it instead of starting a new one.
+* @param resume True to continue an interrupted session without asking
+**/
+UserData* createSession(bool resume)
+{
+	UserData* userData = new UserData(getHotchDirectory(), CHECKPOINT_INTERVAL, OVERHEAD_INTERVAL);
+
+	startTrace(userData, resume);
+
+	return userData;
+}
+
+/**
+* Stops the running profiling session and writes its results without terminating
+* the target process. Running the plugin with argument 2 stops without asking.
+**/
+void stopSession(int arg)
+{
+	if (arg != 2 && askyn_c(1, "Hotch is profiling the target process.\nDo you want to stop profiling and write the results?") != 1)
+	{
+		return;
+	}
+
+	Debugger debugger = IdaFile().getDebugger();
+
+	if (debugger.isActive() && !debugger.isSuspended())
+	{
+		// The session is stopped when the process is suspended
+
+		activeSession->stop();
+
+		msg("Suspending the target process...\n");
+		debugger.suspendProcess(true);
+	}
+	else
+	{
+		// A process that was suspended by the user stays suspended
+
+		stopProfiling(activeSession, false);
+	}
+}
+
+/**
+* Creates the state of a sampling session. Sampling sessions record no events, but
+* their results are written from the empty trace like those of other sessions.
+**/
+UserData* createSamplingSession()
+{
+	UserData* userData = new UserData(getHotchDirectory(), CHECKPOINT_INTERVAL, OVERHEAD_INTERVAL);
+
+	userData->enableSampling();
+
+	startTrace(userData, false);
+
+	return userData;
+}
+
+/**
+* Creates the state of a counting session, which only records the hits of the
+* blocks and needs fewer breakpoints.
+* @param instrumenting True to count with trampolines in the target process
+* where possible
+**/
+UserData* createCountingSession(bool instrumenting)
+{
+	UserData* userData = new UserData(getHotchDirectory(), CHECKPOINT_INTERVAL, OVERHEAD_INTERVAL);
+
+	userData->enableCounting();
+
+	if (instrumenting)
+	{
+		userData->enableInstrumenting();
+	}
+
+	startTrace(userData, false);
+
+	return userData;
 }
 
+/**
+* Creates the state of a triggered session, which only profiles the calls of the
+* function at the cursor and the functions they reach.
+* @return The session or 0 if the cursor is not inside a function
+**/
+UserData* createTriggeredSession()
+{
+	func_t* function = get_func(IdaFile().getScreenEA().getAddress());
+
+	if (!function)
+	{
+		msg("Place the cursor inside the function that triggers profiling\n");
+
+		return 0;
+	}
+
+	UserData* userData = new UserData(getHotchDirectory(), CHECKPOINT_INTERVAL, OVERHEAD_INTERVAL);
+
+	userData->getTriggerScope().setTrigger(function->startEA);
+
+	startTrace(userData, false);
 
-void IDAP_run(int)
+	msg("Profiling the calls of %s\n", Function(function).getName().c_str());
+
+	return userData;
+}
+
+/**
+* Starts profiling. Running the plugin with argument 1 continues an interrupted
+* session without asking, argument 3 samples the target process instead of setting
+* breakpoints and argument 4 only counts the hits of the blocks. Argument 5 counts
+* them with trampolines in the target process instead of breakpoints and argument 6
+* only profiles the calls of the function at the cursor. Running the plugin
+* while profiling stops the session, running it while the results are written
+* cancels writing them.
+**/
+void IDAP_run(int arg)
 {
+	if (reportJob)
+	{
+		if (askyn_c(0, "Hotch is still writing the results of the last session.\nDo you want to cancel it?") == 1)
+		{
+			msg("Cancelling...\n");
+
+			reportJob->cancel();
+		}
+
+		return;
+	}
+
+	if (activeSession)
+	{
+		stopSession(arg);
+
+		return;
+	}
+
 	IdaFile file;
 
 	msg("Starting to profile %s\n", file.getName().c_str());
 
 	Debugger debugger = file.getDebugger();
 
-	debugger.addEventCallback(&debuggerCallback, new UserData);
+	UserData* userData;
+
+	if (arg == 3)
+	{
+		userData = createSamplingSession();
+	}
+	else if (arg == 4 || arg == 5)
+	{
+		userData = createCountingSession(arg == 5);
+	}
+	else if (arg == 6)
+	{
+		userData = createTriggeredSession();
+
+		if (!userData)
+		{
+			return;
+		}
+	}
+	else
+	{
+		userData = createSession(arg == 1);
+	}
+
+	userData->getOverhead().start(getCurrentTime());
+
+	if (!userData->getWorker().start())
+	{
+		msg("Could not start the event worker, events are stored in the debugger callback\n");
+	}
+
+	activeSession = userData;
+
+	debugger.addEventCallback(&debuggerCallback, userData);
+
+	if (userData->isSampling())
+	{
+		initSampling(userData);
+
+		samplingTimer = SetTimer(NULL, 0, SAMPLING_INTERVAL, sampleProcess);
+
+		if (!debugger.isActive())
+		{
+			msg("Starting target process\n");
+
+			debugger.startProcess(file.getInputfilePath(), "", "");
+		}
+
+		return;
+	}
 
 	if (debugger.isActive() && !debugger.isSuspended())
 	{
@@ -554,7 +2273,7 @@ void IDAP_run(int)
 	{
 		// If the target is already suspended, set the breakpoints and resume the process.
 
-		setBreakpoints();
+		setBreakpoints(userData);
 
 		debugger.resumeProcess(true);
 	}
@@ -562,7 +2281,7 @@ void IDAP_run(int)
 	{
 		// If the debugger is not yet running, set the breakpoints and start the process.
 
-		setBreakpoints();
+		setBreakpoints(userData);
 
 		msg("Starting target process\n");
 
@@ -577,6 +2296,16 @@ int IDAP_init(void)
 
 void IDAP_term(void)
 {
+	if (reportJob)
+	{
+		KillTimer(NULL, reportTimer);
+
+		reportJob->cancel();
+
+		delete reportJob;
+
+		reportJob = 0;
+	}
 }
 
 // There isn't much use for these yet, but I set them anyway.
@@ -1,88 +1,197 @@
 #ifndef HOTCH_HPP
 #define HOTCH_HPP
 
-#include <sys/timeb.h>
-
 #include "libida.hpp"
+#include "blockindex.hpp"
+#include "breakpointset.hpp"
+#include "checkpoint.hpp"
+#include "eventqueue.hpp"
+#include "overhead.hpp"
+#include "sampling.hpp"
+#include "threadclocks.hpp"
+#include "trace.hpp"
+#include "trampoline.hpp"
+#include "trigger.hpp"
 
-class Event
+class UserData
 {
 private:
-	Offset offset;
-	_timeb time;
+	BlockIndex blockIndex;
+	BreakpointSet breakpoints;
+	TraceEncoder trace;
+	Checkpointer checkpointer;
+	EventWorker worker;
+	OverheadMonitor overhead;
+	SampleCounter samples;
+	ThreadClocks threadClocks;
+
+	// All blocks of a counting session, of which only some have breakpoints
+	BreakpointSet profiledBlocks;
+
+	CounterTrampolines trampolines;
+
+	TriggerScope triggerScope;
+
+	// Thread of the last recorded hit or 0
+	unsigned int lastThread;
+
+	bool stopping;
+	bool sampling;
+	bool counting;
+	bool instrumenting;
 
 public:
-	Event(Offset offset, _timeb time) : offset(offset), time(time) { }
+	ea_t lastOffset;
 
-	Offset getAddress() const
+	/**
+	* @param directory The directory the trace and the checkpoints are written to
+	* @param checkpointInterval The minimum time between two checkpoints in milliseconds
+	* @param overheadInterval The minimum time between two reports of the profiler overhead in milliseconds
+	**/
+	UserData(const std::string& directory, unsigned long long checkpointInterval, unsigned long long overheadInterval) : checkpointer(directory + "/results.trace", directory + "/session.checkpoint", checkpointInterval), worker(blockIndex, trace, checkpointer), overhead(overheadInterval), lastThread(0), stopping(false), sampling(false), counting(false), instrumenting(false), lastOffset(0) { }
+
+	BlockIndex& getBlockIndex()
 	{
-		return offset;
+		return blockIndex;
 	}
 
-	_timeb getTime() const
+	/**
+	* Returns the breakpoints that Hotch set in the target process. Sampling
+	* sessions keep the profiled blocks here without setting breakpoints and
+	* counting sessions only keep the measured blocks, without the blocks that
+	* counter trampolines count.
+	**/
+	BreakpointSet& getBreakpoints()
 	{
-		return time;
+		return breakpoints;
 	}
 
-	Function getParentFunction() const { return Function(get_func(offset.getAddress())); }
-};
+	TraceEncoder& getTrace()
+	{
+		return trace;
+	}
 
-class EventList
-{
-private:
-	std::list<Event> events;
-public:
-	void addEvent(const Event& event)
+	Checkpointer& getCheckpointer()
 	{
-		events.push_back(event);
+		return checkpointer;
 	}
 
-	std::list<Event> getList()
+	/**
+	* Returns the worker that stores the breakpoint hits. The block index, the
+	* trace and the checkpointer must not be used while it runs.
+	**/
+	EventWorker& getWorker()
 	{
-		return events;
+		return worker;
 	}
-};
 
-class UserData
-{
-private:
-	EventList eventList;
+	/**
+	* Returns the CPU clocks of the threads of the target process, which the
+	* debugger callback reads at every breakpoint hit.
+	**/
+	ThreadClocks& getThreadClocks()
+	{
+		return threadClocks;
+	}
 
-public:
-	ea_t lastOffset;
+	OverheadMonitor& getOverhead()
+	{
+		return overhead;
+	}
 
-	UserData() : lastOffset(0) { }
+	/**
+	* Remembers the thread of the last recorded hit, whose CPU time is read
+	* again when its time ends.
+	* @param thread The thread or 0 if the time of the last hit ended already
+	**/
+	void setLastThread(unsigned int thread)
+	{
+		lastThread = thread;
+	}
 
-	EventList& getEventList()
+	unsigned int getLastThread() const
 	{
-		return eventList;
+		return lastThread;
 	}
-};
 
-class TimedBlock
-{
-private:
-	Offset offset;
-	unsigned int accumulatedTime;
-	unsigned int hits;
+	/**
+	* Marks the session to be stopped once the target process is suspended.
+	**/
+	void stop()
+	{
+		stopping = true;
+	}
 
-public:
-	TimedBlock(const Offset& offset) : offset(offset), accumulatedTime(0), hits(0) { }
+	bool isStopping() const
+	{
+		return stopping;
+	}
+
+	/**
+	* Makes the session sample the instruction pointers of the target process
+	* instead of setting breakpoints.
+	**/
+	void enableSampling()
+	{
+		sampling = true;
+	}
+
+	bool isSampling() const
+	{
+		return sampling;
+	}
+
+	SampleCounter& getSamples()
+	{
+		return samples;
+	}
 
-	unsigned int getHits() const
+	/**
+	* Makes the session count the hits of the blocks with as few breakpoints as
+	* possible and infer the hits of the other blocks after the run.
+	**/
+	void enableCounting()
 	{
-		return hits;
+		counting = true;
 	}
 
-	unsigned int getTime() const { return accumulatedTime; }
+	bool isCounting() const
+	{
+		return counting;
+	}
 
-	void hit() { ++hits; }
+	BreakpointSet& getProfiledBlocks()
+	{
+		return profiledBlocks;
+	}
+
+	/**
+	* Makes a counting session count the measured blocks with trampolines in the
+	* target process where possible instead of with breakpoints.
+	**/
+	void enableInstrumenting()
+	{
+		instrumenting = true;
+	}
 
-	void addTime(unsigned int time) { accumulatedTime += time; }
+	bool isInstrumenting() const
+	{
+		return instrumenting;
+	}
 
-	Offset getOffset() { return offset; }
+	CounterTrampolines& getTrampolines()
+	{
+		return trampolines;
+	}
 
-	Function getParentFunction() const { return Function(get_func(offset.getAddress())); }
+	/**
+	* Returns the trigger scope, which is only used if the session profiles the
+	* calls of a trigger function.
+	**/
+	TriggerScope& getTriggerScope()
+	{
+		return triggerScope;
+	}
 };
 
 #endif
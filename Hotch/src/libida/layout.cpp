@@ -0,0 +1,598 @@
+#include "layout.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <set>
+#include <string>
+
+namespace
+{
+	const unsigned int NO_BLOCK = 0xFFFFFFFF;
+	const unsigned int NO_CHAIN = 0xFFFFFFFF;
+
+	// Blocks of unknown size are assumed to end at the next block, but not beyond this
+	const unsigned int MAXIMUM_ESTIMATED_SIZE = 256;
+	const unsigned int DEFAULT_BLOCK_SIZE = 16;
+
+	typedef std::pair<unsigned long long, std::pair<unsigned int, unsigned int> > WeightedEdge;
+
+	/**
+	* Sorts edges by weight, heaviest first.
+	**/
+	bool isHeavier(const WeightedEdge& lhs, const WeightedEdge& rhs)
+	{
+		return lhs.first > rhs.first;
+	}
+
+	/**
+	* Sorts chains by weight, heaviest first.
+	**/
+	bool isHeavierChain(const std::pair<unsigned long long, std::vector<unsigned int> >& lhs, const std::pair<unsigned long long, std::vector<unsigned int> >& rhs)
+	{
+		return lhs.first > rhs.first;
+	}
+
+	/**
+	* Sorts blocks by address.
+	**/
+	class AddressOrder
+	{
+	private:
+		const ProfileMap& map;
+
+	public:
+		AddressOrder(const ProfileMap& map) : map(map) { }
+
+		bool operator()(unsigned int lhs, unsigned int rhs) const
+		{
+			return map.getBlock(lhs).getAddress() < map.getBlock(rhs).getAddress();
+		}
+	};
+
+	/**
+	* Checks whether the name of a function is one the linker knows.
+	**/
+	bool isLinkerSymbol(const ProfileFunction& function)
+	{
+		const char* DUMMY_PREFIXES[] = { "sub_", "nullsub_", "j_", "unknown_libname_" };
+
+		if (!function.getModule().empty() || function.getName().empty())
+		{
+			return false;
+		}
+
+		for (unsigned int i = 0; i < sizeof(DUMMY_PREFIXES) / sizeof(DUMMY_PREFIXES[0]); i++)
+		{
+			if (function.getName().compare(0, std::string(DUMMY_PREFIXES[i]).size(), DUMMY_PREFIXES[i]) == 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	* Writes the change from the current to the suggested value as a percentage.
+	**/
+	void writeChange(std::ostream& stream, unsigned long long current, unsigned long long suggested)
+	{
+		if (current != 0)
+		{
+			stream << " (" << std::showpos << std::fixed << std::setprecision(1) << 100.0 * (static_cast<double>(suggested) - current) / current << std::noshowpos << " %)";
+		}
+
+		stream << "\n";
+	}
+}
+
+std::vector<LayoutProfiler::Frame>& LayoutProfiler::getStack(unsigned int thread)
+{
+	if (lastStack == 0 || thread != lastThread)
+	{
+		lastThread = thread;
+		lastStack = &stacks[thread];
+	}
+
+	return *lastStack;
+}
+
+void LayoutProfiler::addEvent(const TraceEvent& event)
+{
+	if (event.block >= map.getNumberOfBlocks() || map.getBlock(event.block).getFunction() == ProfileMap::NO_FUNCTION)
+	{
+		return;
+	}
+
+	++blockHits[event.block];
+
+	tracker.addEvent(event);
+
+	std::vector<Frame>& stack = getStack(event.thread);
+
+	if (stack.empty())
+	{
+		return;
+	}
+
+	Frame& frame = stack.back();
+
+	if (frame.lastBlock != NO_BLOCK)
+	{
+		++transitions[std::make_pair(frame.lastBlock, event.block)];
+	}
+
+	frame.lastBlock = event.block;
+}
+
+void LayoutProfiler::enterFunction(unsigned int thread, unsigned int function, unsigned long long)
+{
+	std::vector<Frame>& stack = getStack(thread);
+
+	if (!stack.empty())
+	{
+		++calls[std::make_pair(stack.back().function, function)];
+	}
+
+	Frame frame;
+
+	frame.function = function;
+	frame.lastBlock = NO_BLOCK;
+
+	stack.push_back(frame);
+}
+
+void LayoutProfiler::exitFunction(unsigned int thread, unsigned int, unsigned long long, unsigned long long)
+{
+	getStack(thread).pop_back();
+}
+
+void LayoutProfiler::addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+{
+	unsigned long long time = tracker.getLastTime();
+
+	if (Trace::isBreak(type, payload, time))
+	{
+		tracker.finish(time);
+	}
+}
+
+CodeLayout::CodeLayout(const ProfileMap& map, const LayoutProfiler& profiler) : sizes(map.getNumberOfBlocks())
+{
+	std::vector<unsigned int> byAddress;
+	std::vector<std::vector<unsigned int> > functionBlocks(map.getNumberOfFunctions());
+	std::vector<unsigned long long> weights(map.getNumberOfFunctions());
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		byAddress.push_back(i);
+	}
+
+	std::sort(byAddress.begin(), byAddress.end(), AddressOrder(map));
+
+	for (unsigned int i = 0; i < byAddress.size(); i++)
+	{
+		unsigned int block = byAddress[i];
+		const ProfileBlock& profileBlock = map.getBlock(block);
+
+		sizes[block] = profileBlock.getSize();
+
+		if (sizes[block] == 0)
+		{
+			sizes[block] = i + 1 < byAddress.size() ? static_cast<unsigned int>(std::min<address_t>(map.getBlock(byAddress[i + 1]).getAddress() - profileBlock.getAddress(), MAXIMUM_ESTIMATED_SIZE)) : DEFAULT_BLOCK_SIZE;
+		}
+
+		if (profileBlock.getFunction() != ProfileMap::NO_FUNCTION)
+		{
+			functionBlocks[profileBlock.getFunction()].push_back(block);
+			weights[profileBlock.getFunction()] += profiler.getBlockHits(block);
+		}
+	}
+
+	orderFunctions(map, profiler, weights);
+
+	// Sort the transitions into the functions they belong to
+	std::vector<std::vector<WeightedEdge> > functionEdges(map.getNumberOfFunctions());
+
+	const std::map<std::pair<unsigned int, unsigned int>, unsigned long long>& transitions = profiler.getTransitions();
+
+	for (std::map<std::pair<unsigned int, unsigned int>, unsigned long long>::const_iterator Iter = transitions.begin(); Iter != transitions.end(); ++Iter)
+	{
+		unsigned int function = map.getBlock(Iter->first.first).getFunction();
+
+		if (Iter->first.first != Iter->first.second && function == map.getBlock(Iter->first.second).getFunction())
+		{
+			functionEdges[function].push_back(std::make_pair(Iter->second, Iter->first));
+		}
+	}
+
+	for (std::vector<unsigned int>::const_iterator Iter = functions.begin(); Iter != functions.end(); ++Iter)
+	{
+		orderBlocks(map, profiler, *Iter, functionBlocks[*Iter], functionEdges[*Iter]);
+	}
+
+	// The current layout as it is in the file
+	std::vector<address_t> addresses(map.getNumberOfBlocks());
+	std::vector<unsigned int> next(map.getNumberOfBlocks(), NO_BLOCK);
+
+	for (unsigned int i = 0; i < byAddress.size(); i++)
+	{
+		unsigned int block = byAddress[i];
+
+		addresses[block] = map.getBlock(block).getAddress();
+
+		if (i + 1 < byAddress.size() && map.getBlock(byAddress[i + 1]).getAddress() == addresses[block] + sizes[block])
+		{
+			next[block] = byAddress[i + 1];
+		}
+	}
+
+	original = getStatistics(map, profiler, addresses, next);
+
+	// The suggested layout, starting at the first hot function
+	address_t address = 0;
+
+	std::fill(next.begin(), next.end(), NO_BLOCK);
+
+	for (std::vector<std::vector<unsigned int> >::const_iterator Iter = blockOrders.begin(); Iter != blockOrders.end(); ++Iter)
+	{
+		address = (address + FUNCTION_ALIGNMENT - 1) / FUNCTION_ALIGNMENT * FUNCTION_ALIGNMENT;
+
+		for (unsigned int i = 0; i < Iter->size(); i++)
+		{
+			unsigned int block = (*Iter)[i];
+
+			addresses[block] = address;
+			address += sizes[block];
+
+			if (i + 1 < Iter->size())
+			{
+				next[block] = (*Iter)[i + 1];
+			}
+		}
+	}
+
+	suggested = getStatistics(map, profiler, addresses, next);
+}
+
+/**
+* Orders the functions that were hit along their call edges.
+* @param weights The number of block hits of each function
+**/
+void CodeLayout::orderFunctions(const ProfileMap& map, const LayoutProfiler& profiler, const std::vector<unsigned long long>& weights)
+{
+	std::vector<std::vector<unsigned int> > chains;
+	std::vector<unsigned int> chainOf(map.getNumberOfFunctions(), NO_CHAIN);
+
+	for (unsigned int i = 0; i < map.getNumberOfFunctions(); i++)
+	{
+		if (weights[i] != 0)
+		{
+			chainOf[i] = chains.size();
+			chains.push_back(std::vector<unsigned int>(1, i));
+		}
+	}
+
+	// Calls in both directions add up to the weight of an edge
+	std::map<std::pair<unsigned int, unsigned int>, unsigned long long> edgeWeights;
+
+	const std::map<std::pair<unsigned int, unsigned int>, unsigned long long>& calls = profiler.getCalls();
+
+	for (std::map<std::pair<unsigned int, unsigned int>, unsigned long long>::const_iterator Iter = calls.begin(); Iter != calls.end(); ++Iter)
+	{
+		if (Iter->first.first != Iter->first.second)
+		{
+			edgeWeights[std::make_pair(std::min(Iter->first.first, Iter->first.second), std::max(Iter->first.first, Iter->first.second))] += Iter->second;
+		}
+	}
+
+	std::vector<WeightedEdge> edges;
+
+	for (std::map<std::pair<unsigned int, unsigned int>, unsigned long long>::const_iterator Iter = edgeWeights.begin(); Iter != edgeWeights.end(); ++Iter)
+	{
+		edges.push_back(std::make_pair(Iter->second, Iter->first));
+	}
+
+	std::stable_sort(edges.begin(), edges.end(), isHeavier);
+
+	for (std::vector<WeightedEdge>::const_iterator Iter = edges.begin(); Iter != edges.end(); ++Iter)
+	{
+		unsigned int caller = Iter->second.first;
+		unsigned int callee = Iter->second.second;
+
+		unsigned int first = chainOf[caller];
+		unsigned int second = chainOf[callee];
+
+		if (first == second || first == NO_CHAIN || second == NO_CHAIN)
+		{
+			continue;
+		}
+
+		std::vector<unsigned int>& head = chains[first];
+		std::vector<unsigned int>& tail = chains[second];
+
+		// Turn the chains so that the two functions end up as close as possible
+		unsigned int callerPosition = std::find(head.begin(), head.end(), caller) - head.begin();
+		unsigned int calleePosition = std::find(tail.begin(), tail.end(), callee) - tail.begin();
+
+		if (callerPosition < head.size() - 1 - callerPosition)
+		{
+			std::reverse(head.begin(), head.end());
+		}
+
+		if (calleePosition > tail.size() - 1 - calleePosition)
+		{
+			std::reverse(tail.begin(), tail.end());
+		}
+
+		for (std::vector<unsigned int>::const_iterator Function = tail.begin(); Function != tail.end(); ++Function)
+		{
+			chainOf[*Function] = first;
+		}
+
+		head.insert(head.end(), tail.begin(), tail.end());
+		tail.clear();
+	}
+
+	// Hotter chains first
+	std::vector<std::pair<unsigned long long, std::vector<unsigned int> > > orderedChains;
+
+	for (std::vector<std::vector<unsigned int> >::const_iterator Iter = chains.begin(); Iter != chains.end(); ++Iter)
+	{
+		if (Iter->empty())
+		{
+			continue;
+		}
+
+		unsigned long long weight = 0;
+
+		for (std::vector<unsigned int>::const_iterator Function = Iter->begin(); Function != Iter->end(); ++Function)
+		{
+			weight += weights[*Function];
+		}
+
+		orderedChains.push_back(std::make_pair(weight, *Iter));
+	}
+
+	std::stable_sort(orderedChains.begin(), orderedChains.end(), isHeavierChain);
+
+	for (std::vector<std::pair<unsigned long long, std::vector<unsigned int> > >::const_iterator Iter = orderedChains.begin(); Iter != orderedChains.end(); ++Iter)
+	{
+		functions.insert(functions.end(), Iter->second.begin(), Iter->second.end());
+	}
+}
+
+/**
+* Orders the blocks of a function along their transitions and adds the order to
+* the layout.
+* @param blocks The blocks of the function in address order
+* @param edges The transitions between the blocks of the function
+**/
+void CodeLayout::orderBlocks(const ProfileMap& map, const LayoutProfiler& profiler, unsigned int function, const std::vector<unsigned int>& blocks, const std::vector<WeightedEdge>& edges)
+{
+	std::vector<std::vector<unsigned int> > chains;
+	std::map<unsigned int, unsigned int> chainOf;
+
+	for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+	{
+		if (profiler.getBlockHits(*Iter) != 0)
+		{
+			chainOf[*Iter] = chains.size();
+			chains.push_back(std::vector<unsigned int>(1, *Iter));
+		}
+	}
+
+	unsigned int entry = map.findBlock(map.getFunction(function).getAddress());
+
+	std::vector<WeightedEdge> sortedEdges(edges);
+
+	std::stable_sort(sortedEdges.begin(), sortedEdges.end(), isHeavier);
+
+	// A block can only be followed by one block, so only chain ends are joined
+	for (std::vector<WeightedEdge>::const_iterator Iter = sortedEdges.begin(); Iter != sortedEdges.end(); ++Iter)
+	{
+		unsigned int from = Iter->second.first;
+		unsigned int to = Iter->second.second;
+
+		unsigned int first = chainOf[from];
+		unsigned int second = chainOf[to];
+
+		if (first == second || to == entry || chains[first].back() != from || chains[second].front() != to)
+		{
+			continue;
+		}
+
+		for (std::vector<unsigned int>::const_iterator Block = chains[second].begin(); Block != chains[second].end(); ++Block)
+		{
+			chainOf[*Block] = first;
+		}
+
+		chains[first].insert(chains[first].end(), chains[second].begin(), chains[second].end());
+		chains[second].clear();
+	}
+
+	// The chain of the entry block comes first, followed by the hotter chains
+	std::vector<unsigned int> order;
+	std::vector<std::pair<unsigned long long, std::vector<unsigned int> > > orderedChains;
+
+	for (std::vector<std::vector<unsigned int> >::const_iterator Iter = chains.begin(); Iter != chains.end(); ++Iter)
+	{
+		if (Iter->empty())
+		{
+			continue;
+		}
+
+		if (Iter->front() == entry)
+		{
+			order = *Iter;
+
+			continue;
+		}
+
+		unsigned long long weight = 0;
+
+		for (std::vector<unsigned int>::const_iterator Block = Iter->begin(); Block != Iter->end(); ++Block)
+		{
+			weight += profiler.getBlockHits(*Block);
+		}
+
+		orderedChains.push_back(std::make_pair(weight, *Iter));
+	}
+
+	std::stable_sort(orderedChains.begin(), orderedChains.end(), isHeavierChain);
+
+	for (std::vector<std::pair<unsigned long long, std::vector<unsigned int> > >::const_iterator Iter = orderedChains.begin(); Iter != orderedChains.end(); ++Iter)
+	{
+		order.insert(order.end(), Iter->second.begin(), Iter->second.end());
+	}
+
+	hotBlocks.push_back(order.size());
+
+	// Cold blocks last
+	for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+	{
+		if (profiler.getBlockHits(*Iter) == 0)
+		{
+			order.push_back(*Iter);
+		}
+	}
+
+	blockOrders.push_back(order);
+}
+
+/**
+* Measures a layout of the blocks.
+* @param addresses The address of each block in the layout
+* @param next The block placed directly after each block or NO_BLOCK
+**/
+LayoutStatistics CodeLayout::getStatistics(const ProfileMap& map, const LayoutProfiler& profiler, const std::vector<address_t>& addresses, const std::vector<unsigned int>& next) const
+{
+	LayoutStatistics statistics;
+
+	statistics.bytes = 0;
+	statistics.fallThroughs = 0;
+	statistics.transitions = 0;
+
+	std::set<address_t> cacheLines;
+	std::set<address_t> pages;
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		if (profiler.getBlockHits(i) == 0)
+		{
+			continue;
+		}
+
+		address_t last = addresses[i] + std::max(sizes[i], 1u) - 1;
+
+		statistics.bytes += sizes[i];
+
+		for (address_t line = addresses[i] / CACHE_LINE_SIZE; line <= last / CACHE_LINE_SIZE; line++)
+		{
+			cacheLines.insert(line);
+		}
+
+		for (address_t page = addresses[i] / MEMORY_PAGE_SIZE; page <= last / MEMORY_PAGE_SIZE; page++)
+		{
+			pages.insert(page);
+		}
+	}
+
+	statistics.cacheLines = cacheLines.size();
+	statistics.pages = pages.size();
+
+	const std::map<std::pair<unsigned int, unsigned int>, unsigned long long>& transitions = profiler.getTransitions();
+
+	for (std::map<std::pair<unsigned int, unsigned int>, unsigned long long>::const_iterator Iter = transitions.begin(); Iter != transitions.end(); ++Iter)
+	{
+		statistics.transitions += Iter->second;
+
+		if (next[Iter->first.first] == Iter->first.second)
+		{
+			statistics.fallThroughs += Iter->second;
+		}
+	}
+
+	return statistics;
+}
+
+void profileLayout(TraceDecoder& decoder, LayoutProfiler& profiler)
+{
+	decoder.setRecordListener(&profiler);
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		profiler.addEvent(event);
+	}
+
+	decoder.setRecordListener(0);
+}
+
+void writeSymbolOrder(std::ostream& stream, const ProfileMap& map, const CodeLayout& layout)
+{
+	const std::vector<unsigned int>& functions = layout.getFunctions();
+
+	for (std::vector<unsigned int>::const_iterator Iter = functions.begin(); Iter != functions.end(); ++Iter)
+	{
+		if (isLinkerSymbol(map.getFunction(*Iter)))
+		{
+			stream << map.getFunction(*Iter).getName() << "\n";
+		}
+	}
+}
+
+void writeLayoutReport(std::ostream& stream, const ProfileMap& map, const CodeLayout& layout)
+{
+	const LayoutStatistics& original = layout.getOriginalStatistics();
+	const LayoutStatistics& suggested = layout.getSuggestedStatistics();
+
+	const std::vector<unsigned int>& functions = layout.getFunctions();
+
+	unsigned int symbols = 0;
+
+	for (std::vector<unsigned int>::const_iterator Iter = functions.begin(); Iter != functions.end(); ++Iter)
+	{
+		symbols += isLinkerSymbol(map.getFunction(*Iter)) ? 1 : 0;
+	}
+
+	stream << "Hot functions: " << functions.size() << " of " << map.getNumberOfFunctions() << " (" << symbols << " in the symbol order file)\n";
+	stream << "Hot code: " << original.bytes << " bytes\n\n";
+	stream << "                              Current  Suggested\n";
+	stream << "Cache lines (" << std::setw(4) << CodeLayout::CACHE_LINE_SIZE << " bytes)   " << std::setw(9) << original.cacheLines << "  " << std::setw(9) << suggested.cacheLines;
+
+	writeChange(stream, original.cacheLines, suggested.cacheLines);
+
+	stream << "Pages (" << std::setw(4) << CodeLayout::MEMORY_PAGE_SIZE << " bytes)         " << std::setw(9) << original.pages << "  " << std::setw(9) << suggested.pages;
+
+	writeChange(stream, original.pages, suggested.pages);
+
+	stream << "Fall-through transitions   " << std::setw(9) << original.fallThroughs << "  " << std::setw(9) << suggested.fallThroughs;
+
+	writeChange(stream, original.fallThroughs, suggested.fallThroughs);
+
+	stream << "\nThe suggested layout places the hot functions together in the order of the\n";
+	stream << "symbol order file, hot blocks first, and leaves all other functions where\n";
+	stream << "they are. Block orders need compiler support such as profile-guided\n";
+	stream << "optimization; the blocks after | were not hit.\n\n";
+
+	for (unsigned int i = 0; i < functions.size(); i++)
+	{
+		stream << map.getFunctionName(functions[i]) << ":";
+
+		const std::vector<unsigned int>& blocks = layout.getBlockOrder(i);
+
+		for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+		{
+			if (Iter - blocks.begin() == layout.getNumberOfHotBlocks(i))
+			{
+				stream << " |";
+			}
+
+			stream << " " << std::hex << std::uppercase << map.getBlock(*Iter).getAddress() << std::nouppercase << std::dec;
+		}
+
+		stream << "\n";
+	}
+}
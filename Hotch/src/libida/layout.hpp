@@ -0,0 +1,163 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include <map>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "callstack.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* Counts the calls between functions and the transitions between the blocks of
+* each function one event at a time.
+*
+* A transition goes from one block of a call to the next block of the same call,
+* so returning from a callee continues at the block that made the call.
+**/
+class LayoutProfiler : public CallStackListener, public TraceRecordListener
+{
+private:
+	struct Frame
+	{
+		unsigned int function;
+		unsigned int lastBlock;
+	};
+
+	const ProfileMap& map;
+
+	CallStackTracker tracker;
+
+	std::map<unsigned int, std::vector<Frame> > stacks;
+
+	unsigned int lastThread;
+	std::vector<Frame>* lastStack;
+
+	std::vector<unsigned long long> blockHits;
+
+	std::map<std::pair<unsigned int, unsigned int>, unsigned long long> calls;
+	std::map<std::pair<unsigned int, unsigned int>, unsigned long long> transitions;
+
+	std::vector<Frame>& getStack(unsigned int thread);
+
+public:
+	LayoutProfiler(const ProfileMap& map) : map(map), tracker(map, *this), lastThread(0), lastStack(0), blockHits(map.getNumberOfBlocks()) { }
+
+	void addEvent(const TraceEvent& event);
+
+	void enterFunction(unsigned int thread, unsigned int function, unsigned long long time);
+
+	void exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time);
+
+	/**
+	* Ends the calls that are running where an interrupted trace was continued or
+	* a triggered session left its scope, so that no call or transition spans
+	* the time between.
+	**/
+	void addRecord(unsigned int type, const std::vector<unsigned char>& payload);
+
+	unsigned long long getBlockHits(unsigned int block) const { return blockHits[block]; }
+
+	/**
+	* Returns the number of calls by caller and callee.
+	**/
+	const std::map<std::pair<unsigned int, unsigned int>, unsigned long long>& getCalls() const { return calls; }
+
+	/**
+	* Returns the number of transitions by source and target block.
+	**/
+	const std::map<std::pair<unsigned int, unsigned int>, unsigned long long>& getTransitions() const { return transitions; }
+};
+
+/**
+* The instruction cache and page footprint of the blocks that were hit, and how
+* often control fell through to the block placed directly after the last one.
+**/
+struct LayoutStatistics
+{
+	unsigned long long bytes;
+	unsigned int cacheLines;
+	unsigned int pages;
+
+	unsigned long long fallThroughs;
+	unsigned long long transitions;
+};
+
+/**
+* A code layout for the functions that were hit, derived with the algorithms of
+* Pettis and Hansen.
+*
+* Functions are placed by merging chains of functions along the call edges,
+* heaviest edges first, so that functions that call each other often end up next
+* to each other. The blocks of a function are chained along their transitions,
+* heaviest first, so that the most frequent successor of a block directly follows
+* it. The entry block stays first and blocks that were not hit go to the end of
+* their function.
+**/
+class CodeLayout
+{
+private:
+	std::vector<unsigned int> functions;
+	std::vector<std::vector<unsigned int> > blockOrders;
+	std::vector<unsigned int> hotBlocks;
+
+	// Block sizes, estimated from the distance to the next block where unknown
+	std::vector<unsigned int> sizes;
+
+	LayoutStatistics original;
+	LayoutStatistics suggested;
+
+	void orderFunctions(const ProfileMap& map, const LayoutProfiler& profiler, const std::vector<unsigned long long>& weights);
+	void orderBlocks(const ProfileMap& map, const LayoutProfiler& profiler, unsigned int function, const std::vector<unsigned int>& blocks, const std::vector<std::pair<unsigned long long, std::pair<unsigned int, unsigned int> > >& edges);
+
+	LayoutStatistics getStatistics(const ProfileMap& map, const LayoutProfiler& profiler, const std::vector<address_t>& addresses, const std::vector<unsigned int>& next) const;
+
+public:
+	static const unsigned int CACHE_LINE_SIZE = 64;
+	static const unsigned int MEMORY_PAGE_SIZE = 4096;
+	static const unsigned int FUNCTION_ALIGNMENT = 16;
+
+	CodeLayout(const ProfileMap& map, const LayoutProfiler& profiler);
+
+	/**
+	* Returns the functions that were hit in their suggested order.
+	**/
+	const std::vector<unsigned int>& getFunctions() const { return functions; }
+
+	/**
+	* Returns the suggested block order of the function at a position of getFunctions().
+	**/
+	const std::vector<unsigned int>& getBlockOrder(unsigned int position) const { return blockOrders[position]; }
+
+	/**
+	* Returns the number of blocks at the start of a block order that were hit.
+	**/
+	unsigned int getNumberOfHotBlocks(unsigned int position) const { return hotBlocks[position]; }
+
+	const LayoutStatistics& getOriginalStatistics() const { return original; }
+
+	const LayoutStatistics& getSuggestedStatistics() const { return suggested; }
+};
+
+/**
+* Counts the calls and block transitions of a trace.
+**/
+void profileLayout(TraceDecoder& decoder, LayoutProfiler& profiler);
+
+/**
+* Writes the functions of a layout as a symbol order file, one name per line, as
+* read by the /ORDER option of the Microsoft linker and the --symbol-ordering-file
+* option of lld and gold. Import thunks and functions that only have names made
+* up by IDA are left out because the linker does not know them.
+**/
+void writeSymbolOrder(std::ostream& stream, const ProfileMap& map, const CodeLayout& layout);
+
+/**
+* Writes the expected footprint of the current and the suggested layout and the
+* suggested block order of each function.
+**/
+void writeLayoutReport(std::ostream& stream, const ProfileMap& map, const CodeLayout& layout);
+
+#endif
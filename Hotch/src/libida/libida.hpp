@@ -44,8 +44,67 @@ std::string read2(S (*f)(U p1, V p2, char* buffer, T size), U p1, V p2)
 	return buffer;
 }
 
+/**
+* Converts a string that was allocated by IDA and releases it. IDA returns no
+* string at all if there is nothing to return.
+**/
+std::string takeString(char* string)
+{
+	std::string result = string ? string : "";
+
+	qfree(string);
+
+	return result;
+}
+
 class Instruction;
 
+/**
+* Defers the view refreshes of the setters while it exists. The views are refreshed
+* once when the outermost batch ends, so changing many items does not redraw the
+* views after every single change.
+**/
+class RefreshBatch
+{
+private:
+	static unsigned int depth;
+	static bool pending;
+
+	RefreshBatch(const RefreshBatch&);
+	RefreshBatch& operator=(const RefreshBatch&);
+
+public:
+	RefreshBatch() { ++depth; }
+
+	~RefreshBatch()
+	{
+		if (--depth == 0 && pending)
+		{
+			pending = false;
+
+			refresh_idaview_anyway();
+		}
+	}
+
+	/**
+	* Refreshes the views now or at the end of the current batch.
+	**/
+	static void refresh()
+	{
+		if (depth == 0)
+		{
+			refresh_idaview_anyway();
+		}
+		else
+		{
+			pending = true;
+		}
+	}
+};
+
+unsigned int RefreshBatch::depth = 0;
+bool RefreshBatch::pending = false;
+
 class Offset
 {
 private:
@@ -82,17 +141,17 @@ public:
 
 	uchar getByte() const { return get_byte(offset); }
 
-	void setByte(uchar value) const { patch_byte(offset, value); refresh_idaview_anyway(); }
+	void setByte(uchar value) const { patch_byte(offset, value); RefreshBatch::refresh(); }
 
 	ushort getWord() const { return get_word(offset); }
 
-	void setWord(ushort value) const { patch_word(offset, value); refresh_idaview_anyway(); }
+	void setWord(ushort value) const { patch_word(offset, value); RefreshBatch::refresh(); }
 
 	ulong get3Byte() const { return get_3byte(offset); }
 
 	ulong getDword() const { return get_long(offset); }
 
-	void setDword(ulong value) const { patch_long(offset, value); refresh_idaview_anyway(); }
+	void setDword(ulong value) const { patch_long(offset, value); RefreshBatch::refresh(); }
 
 	ulonglong getQword() const { return get_qword(offset); }
 
@@ -170,7 +229,7 @@ public:
 
 	std::string getName() const { return read2(&get_name, BADADDR, offset); }
 
-	void setName(const std::string& name) const { set_name(offset, name.c_str()); refresh_idaview_anyway(); }
+	void setName(const std::string& name) const { set_name(offset, name.c_str()); RefreshBatch::refresh(); }
 
 	bool hasName() const { return has_name(getFlags()); }
 
@@ -190,6 +249,12 @@ public:
 
 	std::string getRepeatableComment() const { return read2(&get_cmt, offset, true); }
 
+	void setComment(const std::string& comment) const { set_cmt(offset, comment.c_str(), false); RefreshBatch::refresh(); }
+
+	bgcolor_t getColor() const { return get_item_color(offset); }
+
+	void setColor(bgcolor_t color) const { set_item_color(offset, color); RefreshBatch::refresh(); }
+
 	std::vector<std::string> getAnteriorLines() const { return getExtraLines(E_PREV); }
 
 	std::vector<std::string> getPosteriorLines() const { return getExtraLines(E_NEXT); }
@@ -306,16 +371,18 @@ public:
 
 	Offset getAddress() const { return Offset(function->startEA); }
 
-	std::string getComment() const { return get_func_cmt(function, false); }
+	std::string getComment() const { return takeString(get_func_cmt(function, false)); }
 
-	void setComment(const std::string& comment) const { set_func_cmt(function, comment.c_str(), false); }
+	void setComment(const std::string& comment) const { set_func_cmt(function, comment.c_str(), false); RefreshBatch::refresh(); }
 
-	std::string getRepeatableComment() const { return get_func_cmt(function, true); }
+	std::string getRepeatableComment() const { return takeString(get_func_cmt(function, true)); }
 
-	void setRepeatableComment(const std::string& comment) const { set_func_cmt(function, comment.c_str(), true); }
+	void setRepeatableComment(const std::string& comment) const { set_func_cmt(function, comment.c_str(), true); RefreshBatch::refresh(); }
 
 	bool containsOffset(const Offset& offset) const { return func_contains(function, offset.getAddress()); }
 
+	bool isThunk() const { return (function->flags & FUNC_THUNK) != 0; }
+
 //	FunctionChunkIterator begin();
 //	FunctionChunkIterator end();
 
@@ -494,6 +561,69 @@ class Debugger
 			request_del_bpt(offset);
 		}
 
+		void enableBreakpoint(ea_t offset, bool enable)
+		{
+			request_enable_bpt(offset, enable);
+		}
+
+		bool hasBreakpoint(ea_t offset) const
+		{
+			return exist_bpt(offset);
+		}
+
+		unsigned int getNumberOfThreads() const
+		{
+			return get_thread_qty();
+		}
+
+		thread_id_t getThread(unsigned int index) const
+		{
+			return getn_thread(index);
+		}
+
+		thread_id_t getCurrentThread() const
+		{
+			return get_current_thread();
+		}
+
+		bool selectThread(thread_id_t thread)
+		{
+			return select_thread(thread);
+		}
+
+		/**
+		* Reads a register of the current thread.
+		**/
+		bool getRegister(const std::string& name, unsigned long long& value) const
+		{
+			regval_t regval;
+
+			if (!get_reg_val(name.c_str(), &regval))
+			{
+				return false;
+			}
+
+			value = regval.ival;
+
+			return true;
+		}
+
+		/**
+		* Reads memory of the target process.
+		**/
+		bool readMemory(ea_t offset, void* buffer, unsigned int size) const
+		{
+			return read_dbg_memory(offset, buffer, size) == static_cast<ssize_t>(size);
+		}
+
+		/**
+		* Writes memory of the target process.
+		**/
+		bool writeMemory(ea_t offset, const void* buffer, unsigned int size)
+		{
+			return write_dbg_memory(offset, buffer, size) == static_cast<ssize_t>(size);
+		}
+
 		void addEventCallback(hook_cb_t* callback, void* userData)
 		{
 			hook_to_notification_point(HT_DBG, callback, userData);
@@ -560,11 +690,13 @@ class Debugger
 		static const unsigned int EVENT_BREAKPOINT;
 		static const unsigned int EVENT_PROCESS_EXIT;
 		static const unsigned int EVENT_PROCESS_SUSPENDED;
+		static const unsigned int EVENT_THREAD_EXIT;
 };
 
 const unsigned int Debugger::EVENT_BREAKPOINT = dbg_bpt;
 const unsigned int Debugger::EVENT_PROCESS_EXIT = dbg_process_exit;
 const unsigned int Debugger::EVENT_PROCESS_SUSPENDED = dbg_suspend_process;
+const unsigned int Debugger::EVENT_THREAD_EXIT = dbg_thread_exit;
 
 class IdaFile
 {
@@ -627,7 +759,11 @@ bool hasOtherReferences(Offset offset, const std::vector<Offset>& offsets)
 	return false;
 }
 
-void iterateBasicBlocks(const InstructionIterator& begin, const InstructionIterator& end, void (*callback)(const Offset&))
+/**
+* Calls a function or function object for the first instruction of every basic block.
+**/
+template<typename Callback>
+void iterateBasicBlocks(const InstructionIterator& begin, const InstructionIterator& end, Callback& callback)
 {
 	Offset lastOffset = 0;
 
@@ -658,7 +794,8 @@ void iterateBasicBlocks(const InstructionIterator& begin, const InstructionItera
 	}
 }
 
-void iterateBasicBlocks(void (*callback)(const Offset&))
+template<typename Callback>
+void iterateBasicBlocks(Callback& callback)
 {
 	IdaFile file;
 	iterateBasicBlocks(file.beginInstructions(), file.endInstructions(), callback);
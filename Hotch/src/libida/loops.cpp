@@ -0,0 +1,326 @@
+#include "loops.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	const unsigned int UNVISITED = 0xFFFFFFFF;
+
+	/**
+	* Sorts loops by the number of their blocks, largest loops first.
+	**/
+	bool isLarger(const Loop& lhs, const Loop& rhs)
+	{
+		return lhs.getBlocks().size() > rhs.getBlocks().size();
+	}
+
+	/**
+	* Returns the nearest common dominator of two nodes. Nodes are numbered in
+	* reverse postorder, so dominators always have lower numbers.
+	**/
+	unsigned int intersect(const std::vector<unsigned int>& dominators, unsigned int lhs, unsigned int rhs)
+	{
+		while (lhs != rhs)
+		{
+			while (lhs > rhs)
+			{
+				lhs = dominators[lhs];
+			}
+
+			while (rhs > lhs)
+			{
+				rhs = dominators[rhs];
+			}
+		}
+
+		return lhs;
+	}
+}
+
+LoopForest::LoopForest(const ProfileMap& map) : innermostLoops(map.getNumberOfBlocks(), NO_LOOP)
+{
+	for (unsigned int i = 0; i < map.getNumberOfFunctions(); i++)
+	{
+		unsigned int entry = map.findBlock(map.getFunction(i).getAddress());
+
+		if (entry != BlockIndex::INVALID_INDEX && map.getBlock(entry).getFunction() == i)
+		{
+			findLoops(map, entry);
+		}
+	}
+}
+
+/**
+* Finds the loops of the function that starts at the given block.
+**/
+void LoopForest::findLoops(const ProfileMap& map, unsigned int entry)
+{
+	unsigned int function = map.getBlock(entry).getFunction();
+
+	// Number the reachable blocks of the function in reverse postorder
+	std::map<unsigned int, unsigned int> numbers;
+	std::vector<unsigned int> postorder;
+	std::vector<std::pair<unsigned int, unsigned int> > stack;
+
+	numbers[entry] = UNVISITED;
+	stack.push_back(std::make_pair(entry, 0u));
+
+	while (!stack.empty())
+	{
+		unsigned int block = stack.back().first;
+		const std::vector<unsigned int>& successors = map.getSuccessors(block);
+
+		if (stack.back().second == successors.size())
+		{
+			postorder.push_back(block);
+			stack.pop_back();
+
+			continue;
+		}
+
+		unsigned int successor = successors[stack.back().second++];
+
+		if (map.getBlock(successor).getFunction() == function && numbers.find(successor) == numbers.end())
+		{
+			numbers[successor] = UNVISITED;
+			stack.push_back(std::make_pair(successor, 0u));
+		}
+	}
+
+	unsigned int count = postorder.size();
+
+	std::vector<unsigned int> blocks(postorder.rbegin(), postorder.rend());
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		numbers[blocks[i]] = i;
+	}
+
+	std::vector<std::vector<unsigned int> > predecessors(count);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const std::vector<unsigned int>& successors = map.getSuccessors(blocks[i]);
+
+		for (std::vector<unsigned int>::const_iterator Iter = successors.begin(); Iter != successors.end(); ++Iter)
+		{
+			std::map<unsigned int, unsigned int>::const_iterator number = numbers.find(*Iter);
+
+			if (number != numbers.end())
+			{
+				predecessors[number->second].push_back(i);
+			}
+		}
+	}
+
+	// Iterative dominator algorithm of Cooper, Harvey and Kennedy
+	std::vector<unsigned int> dominators(count, UNVISITED);
+
+	dominators[0] = 0;
+
+	bool changed = true;
+
+	while (changed)
+	{
+		changed = false;
+
+		for (unsigned int i = 1; i < count; i++)
+		{
+			unsigned int dominator = UNVISITED;
+
+			for (std::vector<unsigned int>::const_iterator Iter = predecessors[i].begin(); Iter != predecessors[i].end(); ++Iter)
+			{
+				if (dominators[*Iter] != UNVISITED)
+				{
+					dominator = dominator == UNVISITED ? *Iter : intersect(dominators, *Iter, dominator);
+				}
+			}
+
+			if (dominators[i] != dominator)
+			{
+				dominators[i] = dominator;
+				changed = true;
+			}
+		}
+	}
+
+	// Collect the blocks of the loop of every header that is the target of a back edge
+	std::vector<Loop> functionLoops;
+	std::vector<bool> inLoop(count);
+
+	for (unsigned int header = 0; header < count; header++)
+	{
+		std::vector<unsigned int> worklist;
+
+		for (std::vector<unsigned int>::const_iterator Iter = predecessors[header].begin(); Iter != predecessors[header].end(); ++Iter)
+		{
+			unsigned int dominator = *Iter;
+
+			while (dominator > header)
+			{
+				dominator = dominators[dominator];
+			}
+
+			if (dominator == header)
+			{
+				worklist.push_back(*Iter);
+			}
+		}
+
+		if (worklist.empty())
+		{
+			continue;
+		}
+
+		std::fill(inLoop.begin(), inLoop.end(), false);
+
+		inLoop[header] = true;
+
+		std::vector<unsigned int> body(1, blocks[header]);
+
+		while (!worklist.empty())
+		{
+			unsigned int block = worklist.back();
+
+			worklist.pop_back();
+
+			if (inLoop[block])
+			{
+				continue;
+			}
+
+			inLoop[block] = true;
+			body.push_back(blocks[block]);
+
+			worklist.insert(worklist.end(), predecessors[block].begin(), predecessors[block].end());
+		}
+
+		functionLoops.push_back(Loop(blocks[header], body));
+	}
+
+	// Outer loops are larger than the loops nested in them, so going from the largest
+	// to the smallest loop leaves every block with its innermost loop.
+	std::stable_sort(functionLoops.begin(), functionLoops.end(), isLarger);
+
+	for (std::vector<Loop>::iterator Iter = functionLoops.begin(); Iter != functionLoops.end(); ++Iter)
+	{
+		unsigned int index = loops.size();
+
+		Iter->parent = innermostLoops[Iter->header];
+		Iter->depth = Iter->parent == NO_LOOP ? 1 : loops[Iter->parent].depth + 1;
+
+		for (std::vector<unsigned int>::const_iterator Block = Iter->blocks.begin(); Block != Iter->blocks.end(); ++Block)
+		{
+			innermostLoops[*Block] = index;
+		}
+
+		loops.push_back(*Iter);
+	}
+}
+
+LoopProfiler::ThreadState& LoopProfiler::getState(unsigned int thread)
+{
+	if (lastState == 0 || thread != lastThread)
+	{
+		lastThread = thread;
+		lastState = &threads[thread];
+	}
+
+	return *lastState;
+}
+
+void LoopProfiler::exitLoop(ThreadState& state, unsigned long long time)
+{
+	const ActiveLoop& active = state.loops.back();
+
+	statistics[active.loop].addEntry(active.iterations, time - active.enterTime);
+
+	state.loops.pop_back();
+}
+
+void LoopProfiler::addEvent(const TraceEvent& event)
+{
+	unsigned int loop = forest.getInnermostLoop(event.block);
+
+	ThreadState& state = getState(event.thread);
+
+	// Leave the loops of the current call that do not contain the block
+	while (!state.loops.empty() && state.loops.back().frame == state.frames && !forest.contains(state.loops.back().loop, event.block))
+	{
+		exitLoop(state, event.time);
+	}
+
+	if (loop == LoopForest::NO_LOOP)
+	{
+		return;
+	}
+
+	unsigned int active = LoopForest::NO_LOOP;
+
+	if (!state.loops.empty() && state.loops.back().frame == state.frames)
+	{
+		active = state.loops.back().loop;
+	}
+
+	if (loop == active)
+	{
+		// Hitting the header again starts the next iteration
+		if (forest.getLoop(loop).getHeader() == event.block)
+		{
+			++state.loops.back().iterations;
+		}
+
+		return;
+	}
+
+	// Enter the loops between the active loop and the innermost loop of the block
+	std::vector<unsigned int> entered;
+
+	for (unsigned int current = loop; current != active && current != LoopForest::NO_LOOP; current = forest.getLoop(current).getParent())
+	{
+		entered.push_back(current);
+	}
+
+	for (std::vector<unsigned int>::reverse_iterator Iter = entered.rbegin(); Iter != entered.rend(); ++Iter)
+	{
+		ActiveLoop enteredLoop;
+
+		enteredLoop.loop = *Iter;
+		enteredLoop.frame = state.frames;
+		enteredLoop.enterTime = event.time;
+		enteredLoop.iterations = 1;
+
+		state.loops.push_back(enteredLoop);
+	}
+}
+
+void LoopProfiler::enterFunction(unsigned int thread)
+{
+	++getState(thread).frames;
+}
+
+void LoopProfiler::exitFunction(unsigned int thread, unsigned long long time)
+{
+	ThreadState& state = getState(thread);
+
+	while (!state.loops.empty() && state.loops.back().frame == state.frames)
+	{
+		exitLoop(state, time);
+	}
+
+	--state.frames;
+}
+
+void LoopProfiler::reset(unsigned long long time)
+{
+	for (std::map<unsigned int, ThreadState>::iterator Iter = threads.begin(); Iter != threads.end(); ++Iter)
+	{
+		while (!Iter->second.loops.empty())
+		{
+			exitLoop(Iter->second, time);
+		}
+	}
+
+	threads.clear();
+	lastState = 0;
+}
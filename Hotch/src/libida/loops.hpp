@@ -0,0 +1,189 @@
+#ifndef LOOPS_HPP
+#define LOOPS_HPP
+
+#include <map>
+#include <vector>
+
+#include "profilemap.hpp"
+#include "sketch.hpp"
+#include "trace.hpp"
+
+/**
+* A natural loop: the header block and all blocks that can reach a back edge to
+* the header without passing through the header.
+**/
+class Loop
+{
+private:
+	unsigned int header;
+	unsigned int parent;
+	unsigned int depth;
+
+	std::vector<unsigned int> blocks;
+
+	friend class LoopForest;
+
+public:
+	Loop(unsigned int header, const std::vector<unsigned int>& blocks) : header(header), parent(0xFFFFFFFF), depth(1), blocks(blocks) { }
+
+	/**
+	* Returns the index of the header block in the profile map.
+	**/
+	unsigned int getHeader() const { return header; }
+
+	/**
+	* Returns the innermost loop this loop is nested in or LoopForest::NO_LOOP.
+	**/
+	unsigned int getParent() const { return parent; }
+
+	/**
+	* Returns the nesting depth of the loop, starting at 1 for outermost loops.
+	**/
+	unsigned int getDepth() const { return depth; }
+
+	const std::vector<unsigned int>& getBlocks() const { return blocks; }
+};
+
+/**
+* Finds the natural loops of all functions of a profile map.
+*
+* The dominators of each function are computed from the control flow edges of the
+* map, starting at the first block of the function. An edge to a block that
+* dominates the source of the edge is a back edge; all back edges to the same
+* header form one loop. Blocks that can not be reached from the first block of
+* their function are not part of any loop.
+**/
+class LoopForest
+{
+private:
+	std::vector<Loop> loops;
+	std::vector<unsigned int> innermostLoops;
+
+	void findLoops(const ProfileMap& map, unsigned int entry);
+
+public:
+	static const unsigned int NO_LOOP = 0xFFFFFFFF;
+
+	LoopForest(const ProfileMap& map);
+
+	unsigned int getNumberOfLoops() const { return loops.size(); }
+
+	const Loop& getLoop(unsigned int index) const { return loops[index]; }
+
+	/**
+	* Returns the innermost loop that contains a block or NO_LOOP.
+	**/
+	unsigned int getInnermostLoop(unsigned int block) const { return innermostLoops[block]; }
+
+	/**
+	* Checks whether a block is part of a loop or of one of the loops nested in it.
+	**/
+	bool contains(unsigned int loop, unsigned int block) const
+	{
+		for (unsigned int current = innermostLoops[block]; current != NO_LOOP; current = loops[current].parent)
+		{
+			if (current == loop)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
+
+/**
+* The accumulated executions of a loop. An entry lasts from the first hit of a
+* block of the loop until the first hit of a block outside of it in the same
+* call; every hit of the header after the first starts another iteration.
+**/
+class LoopStatistics
+{
+private:
+	unsigned long long entries;
+	unsigned long long iterations;
+	unsigned long long accumulatedTime;
+
+	// Distribution of the iterations per entry
+	LatencySketch iterationCounts;
+
+public:
+	LoopStatistics() : entries(0), iterations(0), accumulatedTime(0) { }
+
+	void addEntry(unsigned long long iterations, unsigned long long time)
+	{
+		++entries;
+
+		this->iterations += iterations;
+		accumulatedTime += time;
+
+		iterationCounts.add(iterations);
+	}
+
+	unsigned long long getEntries() const { return entries; }
+
+	unsigned long long getIterations() const { return iterations; }
+
+	unsigned long long getTime() const { return accumulatedTime; }
+
+	const LatencySketch& getIterationCounts() const { return iterationCounts; }
+};
+
+/**
+* Follows the loops each thread is in one event at a time.
+*
+* The function entries and exits of a CallStackTracker must be passed on before
+* the event that caused them, so that a call from a loop body does not end the
+* loop and returning from a function ends all loops of its frame.
+**/
+class LoopProfiler
+{
+private:
+	struct ActiveLoop
+	{
+		unsigned int loop;
+		unsigned int frame;
+		unsigned long long enterTime;
+		unsigned long long iterations;
+	};
+
+	struct ThreadState
+	{
+		std::vector<ActiveLoop> loops;
+		unsigned int frames;
+
+		ThreadState() : frames(0) { }
+	};
+
+	const LoopForest& forest;
+	std::vector<LoopStatistics>& statistics;
+
+	std::map<unsigned int, ThreadState> threads;
+
+	unsigned int lastThread;
+	ThreadState* lastState;
+
+	ThreadState& getState(unsigned int thread);
+
+	void exitLoop(ThreadState& state, unsigned long long time);
+
+public:
+	/**
+	* @param statistics The statistics of each loop of the forest
+	**/
+	LoopProfiler(const LoopForest& forest, std::vector<LoopStatistics>& statistics) : forest(forest), statistics(statistics), lastThread(0), lastState(0) { }
+
+	void addEvent(const TraceEvent& event);
+
+	void enterFunction(unsigned int thread);
+
+	void exitFunction(unsigned int thread, unsigned long long time);
+
+	/**
+	* Leaves the loops that are still active at the given time and forgets the
+	* state of all threads.
+	**/
+	void reset(unsigned long long time);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include "overhead.hpp"
+
+#include <sstream>
+
+#include "helpers.hpp"
+
+void OverheadMonitor::start(unsigned long long time)
+{
+	startTime = time;
+	lastReport = time;
+	lastReportEvents = events;
+}
+
+std::string OverheadMonitor::formatLatency(const LatencySketch& latency)
+{
+	return toString(latency.getQuantile(0.50)) + "/" + toString(latency.getQuantile(0.95)) + "/" + toString(latency.getQuantile(0.99)) + " us";
+}
+
+std::string OverheadMonitor::getIntervalReport(unsigned long long time)
+{
+	unsigned long long duration = time - lastReport;
+	unsigned long long intervalEvents = events - lastReportEvents;
+
+	std::ostringstream report;
+
+	report << intervalEvents << " events (" << (duration ? intervalEvents * 1000 / duration : 0) << "/s)";
+	report << ", callback p50/p95/p99 " << formatLatency(intervalCallbackLatency);
+	report << ", resume p50/p95/p99 " << formatLatency(intervalResumeLatency);
+	report << ", event buffer " << eventStoreBytes << " bytes";
+
+	lastReport = time;
+	lastReportEvents = events;
+
+	intervalCallbackLatency = LatencySketch();
+	intervalResumeLatency = LatencySketch();
+
+	return report.str();
+}
+
+std::string OverheadMonitor::getSessionReport(unsigned long long time) const
+{
+	unsigned long long duration = time - startTime;
+
+	std::ostringstream report;
+
+	report << events << " events in " << duration / 1000 << " s (" << (duration ? events * 1000 / duration : 0) << "/s)";
+	report << ", callback p50/p95/p99 " << formatLatency(callbackLatency);
+	report << ", resume p50/p95/p99 " << formatLatency(resumeLatency);
+	report << ", event buffer " << eventStoreBytes << " bytes";
+
+	return report.str();
+}
@@ -0,0 +1,90 @@
+#ifndef OVERHEAD_HPP
+#define OVERHEAD_HPP
+
+#include <string>
+
+#include "sketch.hpp"
+
+/**
+* Measures the cost of profiling itself: how many breakpoint events the debugger
+* callback handles per second, how long the callback takes for each event and
+* how long it takes to resume the target process afterwards.
+*
+* Latencies are measured in microseconds. The numbers of the current interval
+* are shown periodically while profiling; the numbers of the whole session end
+* up in the report.
+**/
+class OverheadMonitor
+{
+private:
+	unsigned long long interval;
+
+	unsigned long long startTime;
+	unsigned long long lastReport;
+	unsigned long long lastReportEvents;
+
+	unsigned long long events;
+
+	LatencySketch callbackLatency;
+	LatencySketch resumeLatency;
+
+	// Latencies since the last periodic report
+	LatencySketch intervalCallbackLatency;
+	LatencySketch intervalResumeLatency;
+
+	unsigned long long eventStoreBytes;
+
+	static std::string formatLatency(const LatencySketch& latency);
+
+public:
+	/**
+	* @param interval The minimum time between two periodic reports in milliseconds
+	**/
+	OverheadMonitor(unsigned long long interval) : interval(interval), startTime(0), lastReport(0), lastReportEvents(0), events(0), eventStoreBytes(0) { }
+
+	/**
+	* Starts measuring.
+	* @param time The current time in milliseconds
+	**/
+	void start(unsigned long long time);
+
+	/**
+	* Counts a handled event.
+	* @param callbackTime The time the callback spent on the event in microseconds
+	* @param resumeTime The time it took to resume the target process in microseconds
+	**/
+	void addEvent(unsigned long long callbackTime, unsigned long long resumeTime)
+	{
+		++events;
+
+		callbackLatency.add(callbackTime);
+		resumeLatency.add(resumeTime);
+
+		intervalCallbackLatency.add(callbackTime);
+		intervalResumeLatency.add(resumeTime);
+	}
+
+	/**
+	* Sets the number of bytes the recorded events that were not yet written to the
+	* trace file take in memory.
+	**/
+	void setEventStoreSize(unsigned long long bytes) { eventStoreBytes = bytes; }
+
+	/**
+	* Returns true if the last periodic report is older than the report interval.
+	**/
+	bool isReportDue(unsigned long long time) const { return time - lastReport >= interval; }
+
+	/**
+	* Returns a line with the numbers of the interval since the last periodic
+	* report and starts the next interval.
+	**/
+	std::string getIntervalReport(unsigned long long time);
+
+	/**
+	* Returns a line with the numbers of the whole session.
+	**/
+	std::string getSessionReport(unsigned long long time) const;
+};
+
+#endif
@@ -0,0 +1,405 @@
+#include "paths.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <utility>
+
+namespace
+{
+	const unsigned int NO_NODE = 0xFFFFFFFF;
+
+	// Functions with more paths are not numbered so that path numbers can not overflow
+	const unsigned long long MAXIMUM_PATHS = 1ULL << 48;
+
+	// States of the nodes during the depth-first search
+	const char UNVISITED = 0;
+	const char ON_STACK = 1;
+	const char FINISHED = 2;
+
+	typedef std::pair<unsigned long long, std::pair<unsigned int, unsigned long long> > PathHits;
+
+	/**
+	* Sorts paths by hits, most hits first.
+	**/
+	bool hasMoreHits(const PathHits& lhs, const PathHits& rhs)
+	{
+		return lhs.first > rhs.first;
+	}
+}
+
+// The constant is passed by reference to getValue
+const unsigned int PathNumbering::ENTRY;
+
+PathNumbering::PathNumbering(const ProfileMap& map, unsigned int function, const std::vector<unsigned int>& blocks, const std::vector<unsigned int>& nodes) : blocks(blocks), edges(blocks.size() + 2), paths(0)
+{
+	unsigned int entry = map.findBlock(map.getFunction(function).getAddress());
+
+	if (entry == BlockIndex::INVALID_INDEX || map.getBlock(entry).getFunction() != function)
+	{
+		return;
+	}
+
+	unsigned int exit = getExit();
+
+	std::vector<std::vector<unsigned int> > successors(blocks.size() + 2);
+	std::vector<bool> exits(blocks.size() + 2);
+	std::vector<bool> headers(blocks.size() + 2);
+
+	// Nodes in the order the search finishes them, successors before predecessors
+	std::vector<unsigned int> order;
+
+	std::vector<char> states(blocks.size() + 2, UNVISITED);
+	std::vector<bool> hasSuccessors(blocks.size() + 2);
+
+	// Nodes on the search path with the index of their next successor
+	std::vector<std::pair<unsigned int, unsigned int> > stack;
+
+	stack.push_back(std::make_pair(nodes[entry], 0u));
+	states[nodes[entry]] = ON_STACK;
+
+	while (!stack.empty())
+	{
+		unsigned int node = stack.back().first;
+		const std::vector<unsigned int>& next = map.getSuccessors(blocks[node - 1]);
+
+		if (stack.back().second == next.size())
+		{
+			// Blocks that return or only leave the function end their paths
+			if (!hasSuccessors[node])
+			{
+				exits[node] = true;
+			}
+
+			states[node] = FINISHED;
+			order.push_back(node);
+			stack.pop_back();
+
+			continue;
+		}
+
+		unsigned int block = next[stack.back().second++];
+
+		if (map.getBlock(block).getFunction() != function)
+		{
+			continue;
+		}
+
+		unsigned int target = nodes[block];
+
+		hasSuccessors[node] = true;
+
+		if (states[target] == ON_STACK)
+		{
+			exits[node] = true;
+			headers[target] = true;
+		}
+		else
+		{
+			successors[node].push_back(target);
+
+			if (states[target] == UNVISITED)
+			{
+				states[target] = ON_STACK;
+				stack.push_back(std::make_pair(target, 0u));
+			}
+		}
+	}
+
+	successors[ENTRY].push_back(nodes[entry]);
+
+	for (unsigned int node = 1; node < exit; node++)
+	{
+		if (exits[node])
+		{
+			successors[node].push_back(exit);
+		}
+
+		if (headers[node] && node != nodes[entry])
+		{
+			successors[ENTRY].push_back(node);
+		}
+	}
+
+	order.push_back(ENTRY);
+
+	std::vector<unsigned long long> pathsFrom(blocks.size() + 2);
+
+	pathsFrom[exit] = 1;
+
+	for (std::vector<unsigned int>::const_iterator Iter = order.begin(); Iter != order.end(); ++Iter)
+	{
+		for (std::vector<unsigned int>::const_iterator Target = successors[*Iter].begin(); Target != successors[*Iter].end(); ++Target)
+		{
+			Edge edge;
+
+			edge.target = *Target;
+			edge.value = pathsFrom[*Iter];
+
+			edges[*Iter].push_back(edge);
+
+			pathsFrom[*Iter] += pathsFrom[*Target];
+
+			if (pathsFrom[*Iter] > MAXIMUM_PATHS)
+			{
+				edges.clear();
+
+				return;
+			}
+		}
+	}
+
+	paths = pathsFrom[ENTRY];
+}
+
+bool PathNumbering::getValue(unsigned int from, unsigned int to, unsigned long long& value) const
+{
+	if (from >= edges.size())
+	{
+		return false;
+	}
+
+	for (std::vector<Edge>::const_iterator Iter = edges[from].begin(); Iter != edges[from].end(); ++Iter)
+	{
+		if (Iter->target == to)
+		{
+			value = Iter->value;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::vector<unsigned int> PathNumbering::getPath(unsigned long long path) const
+{
+	std::vector<unsigned int> result;
+
+	unsigned int node = ENTRY;
+
+	while (isValid() && node != getExit())
+	{
+		// The path continues along the edge with the largest value that fits
+		std::vector<Edge>::const_iterator edge = edges[node].end() - 1;
+
+		while (edge->value > path)
+		{
+			--edge;
+		}
+
+		path -= edge->value;
+		node = edge->target;
+
+		if (node != getExit())
+		{
+			result.push_back(blocks[node - 1]);
+		}
+	}
+
+	return result;
+}
+
+PathProfiler::PathProfiler(const ProfileMap& map) : map(map), tracker(map, *this), nodes(map.getNumberOfBlocks(), NO_NODE), lastThread(0), lastStack(0), counts(map.getNumberOfFunctions()), brokenPaths(0)
+{
+	std::vector<std::vector<unsigned int> > functionBlocks(map.getNumberOfFunctions());
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		unsigned int function = map.getBlock(i).getFunction();
+
+		if (function != ProfileMap::NO_FUNCTION)
+		{
+			functionBlocks[function].push_back(i);
+			nodes[i] = functionBlocks[function].size();
+		}
+	}
+
+	numberings.reserve(map.getNumberOfFunctions());
+
+	for (unsigned int function = 0; function < map.getNumberOfFunctions(); function++)
+	{
+		numberings.push_back(PathNumbering(map, function, functionBlocks[function], nodes));
+	}
+}
+
+std::vector<PathProfiler::Frame>& PathProfiler::getStack(unsigned int thread)
+{
+	if (lastStack == 0 || thread != lastThread)
+	{
+		lastThread = thread;
+		lastStack = &stacks[thread];
+	}
+
+	return *lastStack;
+}
+
+/**
+* Counts the path of a call if it can end at the last block of the call.
+**/
+void PathProfiler::endPath(Frame& frame)
+{
+	if (!frame.valid)
+	{
+		return;
+	}
+
+	const PathNumbering& numbering = numberings[frame.function];
+
+	unsigned long long value;
+
+	if (numbering.getValue(frame.lastNode, numbering.getExit(), value))
+	{
+		++counts[frame.function][frame.path + value];
+	}
+	else
+	{
+		++brokenPaths;
+	}
+
+	frame.valid = false;
+}
+
+void PathProfiler::addEvent(const TraceEvent& event)
+{
+	if (event.block >= map.getNumberOfBlocks() || map.getBlock(event.block).getFunction() == ProfileMap::NO_FUNCTION)
+	{
+		return;
+	}
+
+	tracker.addEvent(event);
+
+	std::vector<Frame>& stack = getStack(event.thread);
+
+	if (stack.empty() || !numberings[stack.back().function].isValid())
+	{
+		return;
+	}
+
+	Frame& frame = stack.back();
+
+	const PathNumbering& numbering = numberings[frame.function];
+
+	unsigned int node = nodes[event.block];
+	unsigned long long value;
+
+	if (frame.valid && numbering.getValue(frame.lastNode, node, value))
+	{
+		frame.path += value;
+	}
+	else
+	{
+		// Back edges and transitions outside of the graph start a new path
+		endPath(frame);
+
+		frame.valid = numbering.getValue(PathNumbering::ENTRY, node, frame.path);
+	}
+
+	frame.lastNode = node;
+}
+
+void PathProfiler::enterFunction(unsigned int thread, unsigned int function, unsigned long long)
+{
+	Frame frame;
+
+	frame.function = function;
+	frame.lastNode = NO_NODE;
+	frame.valid = false;
+	frame.path = 0;
+
+	getStack(thread).push_back(frame);
+}
+
+void PathProfiler::exitFunction(unsigned int thread, unsigned int, unsigned long long, unsigned long long)
+{
+	std::vector<Frame>& stack = getStack(thread);
+
+	endPath(stack.back());
+
+	stack.pop_back();
+}
+
+void PathProfiler::addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+{
+	unsigned long long time = tracker.getLastTime();
+
+	if (Trace::isBreak(type, payload, time))
+	{
+		tracker.finish(time);
+	}
+}
+
+void PathProfiler::finish()
+{
+	tracker.finish();
+}
+
+void profilePaths(TraceDecoder& decoder, PathProfiler& profiler)
+{
+	decoder.setRecordListener(&profiler);
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		profiler.addEvent(event);
+	}
+
+	decoder.setRecordListener(0);
+
+	profiler.finish();
+}
+
+void writePathReport(std::ostream& stream, const ProfileMap& map, const PathProfiler& profiler, unsigned int maximumPaths)
+{
+	std::vector<PathHits> paths;
+	std::vector<unsigned long long> functionHits(map.getNumberOfFunctions());
+
+	unsigned int functions = 0;
+	unsigned int unnumbered = 0;
+
+	for (unsigned int function = 0; function < map.getNumberOfFunctions(); function++)
+	{
+		const std::map<unsigned long long, unsigned long long>& counts = profiler.getPaths(function);
+
+		for (std::map<unsigned long long, unsigned long long>::const_iterator Iter = counts.begin(); Iter != counts.end(); ++Iter)
+		{
+			paths.push_back(std::make_pair(Iter->second, std::make_pair(function, Iter->first)));
+
+			functionHits[function] += Iter->second;
+		}
+
+		functions += counts.empty() ? 0 : 1;
+		unnumbered += profiler.getNumbering(function).isValid() ? 0 : 1;
+	}
+
+	unsigned int written = std::min<unsigned int>(maximumPaths, paths.size());
+
+	std::partial_sort(paths.begin(), paths.begin() + written, paths.end(), hasMoreHits);
+
+	stream << "Hit paths: " << paths.size() << " in " << functions << " functions\n";
+	stream << "Paths that left the control flow graph: " << profiler.getNumberOfBrokenPaths() << "\n";
+	stream << "Functions with too many paths to number: " << unnumbered << "\n\n";
+
+	stream << "A path runs from the first block of a function or a loop header to a\n";
+	stream << "return or a jump back to a loop header. Share is the share of the path\n";
+	stream << "among all paths of its function.\n\n";
+
+	stream << "      Hits   Share  Blocks  Function: blocks\n";
+
+	for (unsigned int i = 0; i < written; i++)
+	{
+		unsigned int function = paths[i].second.first;
+
+		std::vector<unsigned int> blocks = profiler.getNumbering(function).getPath(paths[i].second.second);
+
+		stream << std::setw(10) << paths[i].first << "  " << std::fixed << std::setprecision(1) << std::setw(5) << 100.0 * paths[i].first / functionHits[function] << " %";
+		stream << "  " << std::setw(6) << blocks.size() << "  " << map.getFunctionName(function) << ":";
+
+		for (std::vector<unsigned int>::const_iterator Iter = blocks.begin(); Iter != blocks.end(); ++Iter)
+		{
+			stream << " " << std::hex << std::uppercase << map.getBlock(*Iter).getAddress() << std::nouppercase << std::dec;
+		}
+
+		stream << "\n";
+	}
+}
@@ -0,0 +1,163 @@
+#ifndef PATHS_HPP
+#define PATHS_HPP
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include "callstack.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+/**
+* The Ball-Larus numbering of the acyclic paths through a function.
+*
+* A depth-first search from the first block finds the back edges; without them
+* the control flow graph is acyclic. A virtual entry node leads to the first block
+* and to the target of every back edge, and a virtual exit node is reached from
+* the blocks without successors and from the source of every back edge. Each edge
+* gets a value so that the sums of the values along the paths from the entry to
+* the exit number these paths from 0 to getNumberOfPaths() - 1. A path thus starts
+* at the first block or at a loop header and ends at a return or a back edge.
+*
+* Node i + 1 stands for the block getBlock(i), the entry and the exit are the nodes
+* ENTRY and getExit().
+**/
+class PathNumbering
+{
+private:
+	struct Edge
+	{
+		unsigned int target;
+		unsigned long long value;
+	};
+
+	std::vector<unsigned int> blocks;
+
+	// Outgoing edges of each node in the order of their values
+	std::vector<std::vector<Edge> > edges;
+
+	unsigned long long paths;
+
+public:
+	static const unsigned int ENTRY = 0;
+
+	/**
+	* Numbers the paths of a function.
+	* @param blocks The blocks of the function
+	* @param nodes The node of each block of the map within its function
+	**/
+	PathNumbering(const ProfileMap& map, unsigned int function, const std::vector<unsigned int>& blocks, const std::vector<unsigned int>& nodes);
+
+	/**
+	* Checks whether the paths could be numbered. This fails for functions without
+	* a first block and functions with too many paths.
+	**/
+	bool isValid() const { return paths != 0; }
+
+	unsigned long long getNumberOfPaths() const { return paths; }
+
+	unsigned int getExit() const { return blocks.size() + 1; }
+
+	unsigned int getBlock(unsigned int index) const { return blocks[index]; }
+
+	/**
+	* Returns the value of the edge between two nodes.
+	* @return False if there is no such edge in the acyclic graph
+	**/
+	bool getValue(unsigned int from, unsigned int to, unsigned long long& value) const;
+
+	/**
+	* Returns the blocks of a path in the order they are executed.
+	**/
+	std::vector<unsigned int> getPath(unsigned long long path) const;
+};
+
+/**
+* Counts how often each acyclic path of each function is executed.
+*
+* Every call keeps the number of the path it is on as the sum of the values of
+* the edges taken since the path started. Taking a back edge or returning adds the
+* value of the edge to the exit and counts the path. Transitions that are not
+* edges of the map, such as exceptions or calls of the current function that are
+* folded into its frame, end the path like a back edge if the last block has an
+* edge to the exit and break it otherwise.
+**/
+class PathProfiler : public CallStackListener, public TraceRecordListener
+{
+private:
+	struct Frame
+	{
+		unsigned int function;
+		unsigned int lastNode;
+
+		bool valid;
+		unsigned long long path;
+	};
+
+	const ProfileMap& map;
+
+	CallStackTracker tracker;
+
+	std::vector<unsigned int> nodes;
+	std::vector<PathNumbering> numberings;
+
+	std::map<unsigned int, std::vector<Frame> > stacks;
+
+	unsigned int lastThread;
+	std::vector<Frame>* lastStack;
+
+	// Hits of each path by function
+	std::vector<std::map<unsigned long long, unsigned long long> > counts;
+
+	unsigned long long brokenPaths;
+
+	std::vector<Frame>& getStack(unsigned int thread);
+
+	void endPath(Frame& frame);
+
+public:
+	PathProfiler(const ProfileMap& map);
+
+	void addEvent(const TraceEvent& event);
+
+	void enterFunction(unsigned int thread, unsigned int function, unsigned long long time);
+
+	void exitFunction(unsigned int thread, unsigned int function, unsigned long long enterTime, unsigned long long time);
+
+	/**
+	* Ends the calls that are running where an interrupted trace was continued or
+	* a triggered session left its scope.
+	**/
+	void addRecord(unsigned int type, const std::vector<unsigned char>& payload);
+
+	/**
+	* Counts the paths of the calls that are still running at the end of the trace.
+	**/
+	void finish();
+
+	const PathNumbering& getNumbering(unsigned int function) const { return numberings[function]; }
+
+	/**
+	* Returns the hits of the paths of a function by path number.
+	**/
+	const std::map<unsigned long long, unsigned long long>& getPaths(unsigned int function) const { return counts[function]; }
+
+	/**
+	* Returns the number of paths that left the control flow graph before they
+	* could be counted.
+	**/
+	unsigned long long getNumberOfBrokenPaths() const { return brokenPaths; }
+};
+
+/**
+* Counts the paths of a trace.
+**/
+void profilePaths(TraceDecoder& decoder, PathProfiler& profiler);
+
+/**
+* Writes the most frequently executed paths with their blocks, most hits first.
+**/
+void writePathReport(std::ostream& stream, const ProfileMap& map, const PathProfiler& profiler, unsigned int maximumPaths = 50);
+
+#endif
@@ -0,0 +1,367 @@
+#include "profilemap.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+/**
+* Profile maps are stored as text files with one record per line. The first
+* word of a line is the record type:
+*
+* HOTCHMAP <version>
+* I <path of the profiled file>
+* F <address> <name>                  (functions, in index order)
+* N <function index> <demangled name>
+* M <function index> <module>         (import thunks)
+* S <start> <end> <name>              (segments, in address order)
+* B <address> <function index or ->   (blocks, in index order)
+* Z <block index> <size>              (block sizes in bytes, after the blocks)
+* C <block index>                     (measured blocks of counting sessions)
+* E <block index> <block index>       (control flow edges, after the blocks)
+*
+* Lines of unknown record types are ignored.
+**/
+namespace
+{
+	const char* MAGIC = "HOTCHMAP";
+	const unsigned int VERSION = 1;
+}
+
+unsigned int ProfileMap::addFunction(address_t address, const std::string& name)
+{
+	std::map<address_t, unsigned int>::const_iterator Iter = functionIndices.find(address);
+
+	if (Iter != functionIndices.end())
+	{
+		return Iter->second;
+	}
+
+	unsigned int index = functions.size();
+
+	functions.push_back(ProfileFunction(address, name));
+	functionIndices[address] = index;
+
+	return index;
+}
+
+namespace
+{
+	bool isBefore(address_t address, const ProfileSegment& segment)
+	{
+		return address < segment.getStart();
+	}
+}
+
+unsigned int ProfileMap::findSegment(address_t address) const
+{
+	std::vector<ProfileSegment>::const_iterator Iter = std::upper_bound(segments.begin(), segments.end(), address, isBefore);
+
+	if (Iter == segments.begin() || address >= (Iter - 1)->getEnd())
+	{
+		return NO_SEGMENT;
+	}
+
+	return (Iter - segments.begin()) - 1;
+}
+
+unsigned int ProfileMap::addBlock(address_t address, unsigned int function)
+{
+	unsigned int index = blockIndex.addBlock(address);
+
+	if (index == blocks.size())
+	{
+		blocks.push_back(ProfileBlock(address, function));
+		successors.push_back(std::vector<unsigned int>());
+	}
+
+	return index;
+}
+
+void ProfileMap::addEdge(unsigned int from, unsigned int to)
+{
+	std::vector<unsigned int>& targets = successors[from];
+
+	if (std::find(targets.begin(), targets.end(), to) == targets.end())
+	{
+		targets.push_back(to);
+	}
+}
+
+unsigned int ProfileMap::findFunction(address_t address) const
+{
+	std::map<address_t, unsigned int>::const_iterator Iter = functionIndices.find(address);
+
+	if (Iter == functionIndices.end())
+	{
+		return NO_FUNCTION;
+	}
+
+	return Iter->second;
+}
+
+std::string ProfileMap::getFunctionName(unsigned int function) const
+{
+	return function == NO_FUNCTION ? "" : functions[function].getName();
+}
+
+/**
+* Reads a profile map from a file.
+* @param filename The name of the file
+* @param map The map that is filled by the function
+* @return True if the file was a valid profile map
+**/
+bool readProfileMap(const std::string& filename, ProfileMap& map)
+{
+	std::ifstream file(filename.c_str());
+
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+
+	if (!std::getline(file, line))
+	{
+		return false;
+	}
+
+	std::istringstream header(line);
+	std::string magic;
+	unsigned int version = 0;
+
+	if (!(header >> magic >> version) || magic != MAGIC || version != VERSION)
+	{
+		return false;
+	}
+
+	while (std::getline(file, line))
+	{
+		std::istringstream ss(line);
+		std::string type;
+
+		if (!(ss >> type))
+		{
+			continue;
+		}
+
+		if (type == "I")
+		{
+			std::string path;
+
+			std::getline(ss >> std::ws, path);
+
+			map.setInputFile(path);
+		}
+		else if (type == "F")
+		{
+			address_t address;
+			std::string name;
+
+			if (!(ss >> std::hex >> address))
+			{
+				return false;
+			}
+
+			std::getline(ss >> std::ws, name);
+
+			map.addFunction(address, name);
+		}
+		else if (type == "N" || type == "M")
+		{
+			unsigned int function;
+			std::string name;
+
+			if (!(ss >> function) || function >= map.getNumberOfFunctions())
+			{
+				return false;
+			}
+
+			std::getline(ss >> std::ws, name);
+
+			if (type == "N")
+			{
+				map.setDemangledName(function, name);
+			}
+			else
+			{
+				map.setModule(function, name);
+			}
+		}
+		else if (type == "S")
+		{
+			address_t start;
+			address_t end;
+			std::string name;
+
+			if (!(ss >> std::hex >> start >> end))
+			{
+				return false;
+			}
+
+			std::getline(ss >> std::ws, name);
+
+			map.addSegment(start, end, name);
+		}
+		else if (type == "B")
+		{
+			address_t address;
+			std::string function;
+
+			if (!(ss >> std::hex >> address >> function))
+			{
+				return false;
+			}
+
+			unsigned int index = ProfileMap::NO_FUNCTION;
+
+			if (function != "-")
+			{
+				char* end;
+				unsigned long value = std::strtoul(function.c_str(), &end, 10);
+
+				if (*end != 0 || value >= map.getNumberOfFunctions())
+				{
+					return false;
+				}
+
+				index = static_cast<unsigned int>(value);
+			}
+
+			// Blocks are numbered in the order of the trace, so a repeated block would shift all later ones
+			if (map.addBlock(address, index) != map.getNumberOfBlocks() - 1)
+			{
+				return false;
+			}
+		}
+		else if (type == "Z")
+		{
+			unsigned int block;
+			unsigned int size;
+
+			if (!(ss >> block >> size) || block >= map.getNumberOfBlocks())
+			{
+				return false;
+			}
+
+			map.setBlockSize(block, size);
+		}
+		else if (type == "C")
+		{
+			unsigned int block;
+
+			if (!(ss >> block) || block >= map.getNumberOfBlocks())
+			{
+				return false;
+			}
+
+			map.setMeasured(block);
+		}
+		else if (type == "E")
+		{
+			unsigned int from;
+			unsigned int to;
+
+			if (!(ss >> from >> to) || from >= map.getNumberOfBlocks() || to >= map.getNumberOfBlocks())
+			{
+				return false;
+			}
+
+			map.addEdge(from, to);
+		}
+	}
+
+	return true;
+}
+
+/**
+* Writes a profile map to a file.
+* @param filename The name of the file
+* @param map The map to write
+* @return True if the file was written successfully
+**/
+bool writeProfileMap(const std::string& filename, const ProfileMap& map)
+{
+	std::ofstream file(filename.c_str());
+
+	if (!file)
+	{
+		return false;
+	}
+
+	file << MAGIC << " " << VERSION << "\n";
+	file << "I " << map.getInputFile() << "\n";
+
+	for (unsigned int i = 0; i < map.getNumberOfFunctions(); i++)
+	{
+		const ProfileFunction& function = map.getFunction(i);
+
+		file << "F " << std::hex << function.getAddress() << std::dec << " " << function.getName() << "\n";
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfFunctions(); i++)
+	{
+		const ProfileFunction& function = map.getFunction(i);
+
+		if (!function.getDemangledName().empty())
+		{
+			file << "N " << i << " " << function.getDemangledName() << "\n";
+		}
+
+		if (!function.getModule().empty())
+		{
+			file << "M " << i << " " << function.getModule() << "\n";
+		}
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfSegments(); i++)
+	{
+		const ProfileSegment& segment = map.getSegment(i);
+
+		file << "S " << std::hex << segment.getStart() << " " << segment.getEnd() << std::dec << " " << segment.getName() << "\n";
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		const ProfileBlock& block = map.getBlock(i);
+
+		file << "B " << std::hex << block.getAddress() << std::dec << " ";
+
+		if (block.getFunction() == ProfileMap::NO_FUNCTION)
+		{
+			file << "-";
+		}
+		else
+		{
+			file << block.getFunction();
+		}
+
+		file << "\n";
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		if (map.getBlock(i).getSize() != 0)
+		{
+			file << "Z " << i << " " << map.getBlock(i).getSize() << "\n";
+		}
+
+		if (map.getBlock(i).isMeasured())
+		{
+			file << "C " << i << "\n";
+		}
+	}
+
+	for (unsigned int i = 0; i < map.getNumberOfBlocks(); i++)
+	{
+		const std::vector<unsigned int>& successors = map.getSuccessors(i);
+
+		for (std::vector<unsigned int>::const_iterator Iter = successors.begin(); Iter != successors.end(); ++Iter)
+		{
+			file << "E " << i << " " << *Iter << "\n";
+		}
+	}
+
+	return file.good();
+}
@@ -0,0 +1,219 @@
+#ifndef PROFILEMAP_HPP
+#define PROFILEMAP_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "blockindex.hpp"
+
+/**
+* A function of the profiled file.
+**/
+class ProfileFunction
+{
+private:
+	address_t address;
+	std::string name;
+
+	std::string demangledName;
+	std::string module;
+
+	friend class ProfileMap;
+
+public:
+	ProfileFunction(address_t address, const std::string& name) : address(address), name(name) { }
+
+	address_t getAddress() const { return address; }
+
+	const std::string& getName() const { return name; }
+
+	/**
+	* Returns the demangled name of the function or an empty string if the name
+	* is not mangled.
+	**/
+	const std::string& getDemangledName() const { return demangledName; }
+
+	/**
+	* Returns the module an import thunk jumps to or an empty string for
+	* functions of the profiled file itself.
+	**/
+	const std::string& getModule() const { return module; }
+};
+
+/**
+* A segment of the profiled file.
+**/
+class ProfileSegment
+{
+private:
+	address_t start;
+	address_t end;
+	std::string name;
+
+public:
+	ProfileSegment(address_t start, address_t end, const std::string& name) : start(start), end(end), name(name) { }
+
+	address_t getStart() const { return start; }
+
+	address_t getEnd() const { return end; }
+
+	const std::string& getName() const { return name; }
+};
+
+/**
+* A profiled basic block and the function it belongs to.
+**/
+class ProfileBlock
+{
+private:
+	address_t address;
+	unsigned int function;
+	unsigned int size;
+	bool measured;
+
+	friend class ProfileMap;
+
+public:
+	ProfileBlock(address_t address, unsigned int function) : address(address), function(function), size(0), measured(false) { }
+
+	address_t getAddress() const { return address; }
+
+	unsigned int getFunction() const { return function; }
+
+	/**
+	* Returns the size of the block in bytes or 0 if it is not known.
+	**/
+	unsigned int getSize() const { return size; }
+
+	/**
+	* Checks whether the block had a breakpoint in a counting session. The hits of
+	* all other blocks of a counting session are inferred from the measured ones.
+	**/
+	bool isMeasured() const { return measured; }
+};
+
+/**
+* Describes the functions and blocks of a profiled file. Blocks are stored in the
+* order of their trace indices so that the events of a trace can be resolved
+* without the IDB the trace was recorded in.
+**/
+class ProfileMap
+{
+private:
+	std::string inputFile;
+
+	std::vector<ProfileFunction> functions;
+	std::map<address_t, unsigned int> functionIndices;
+
+	// Sorted by address
+	std::vector<ProfileSegment> segments;
+
+	std::vector<ProfileBlock> blocks;
+	BlockIndex blockIndex;
+
+	// Control flow successors of each block
+	std::vector<std::vector<unsigned int> > successors;
+
+	unsigned int measuredBlocks;
+
+public:
+	static const unsigned int NO_FUNCTION = 0xFFFFFFFF;
+	static const unsigned int NO_SEGMENT = 0xFFFFFFFF;
+
+	ProfileMap() : measuredBlocks(0) { }
+
+	const std::string& getInputFile() const { return inputFile; }
+
+	void setInputFile(const std::string& filename) { inputFile = filename; }
+
+	unsigned int addFunction(address_t address, const std::string& name);
+
+	void setDemangledName(unsigned int function, const std::string& name) { functions[function].demangledName = name; }
+
+	void setModule(unsigned int function, const std::string& module) { functions[function].module = module; }
+
+	unsigned int addBlock(address_t address, unsigned int function);
+
+	void setBlockSize(unsigned int block, unsigned int size) { blocks[block].size = size; }
+
+	void setMeasured(unsigned int block)
+	{
+		if (!blocks[block].measured)
+		{
+			blocks[block].measured = true;
+			++measuredBlocks;
+		}
+	}
+
+	/**
+	* Checks whether the map belongs to a counting session, in which only the
+	* measured blocks had breakpoints.
+	**/
+	bool isCounting() const { return measuredBlocks != 0; }
+
+	unsigned int getNumberOfMeasuredBlocks() const { return measuredBlocks; }
+
+	/**
+	* Adds a segment. Segments must be added in ascending order and must not overlap.
+	**/
+	void addSegment(address_t start, address_t end, const std::string& name) { segments.push_back(ProfileSegment(start, end, name)); }
+
+	/**
+	* Returns the index of the segment that contains an address or NO_SEGMENT.
+	**/
+	unsigned int findSegment(address_t address) const;
+
+	const ProfileSegment& getSegment(unsigned int index) const { return segments[index]; }
+
+	unsigned int getNumberOfSegments() const { return segments.size(); }
+
+	/**
+	* Adds a control flow edge between two blocks. Adding an edge twice has no effect.
+	**/
+	void addEdge(unsigned int from, unsigned int to);
+
+	/**
+	* Returns the index of the function that starts at the given address or NO_FUNCTION.
+	**/
+	unsigned int findFunction(address_t address) const;
+
+	/**
+	* Returns the index of the block at the given address or BlockIndex::INVALID_INDEX.
+	**/
+	unsigned int findBlock(address_t address) const { return blockIndex.getIndex(address); }
+
+	const ProfileFunction& getFunction(unsigned int index) const { return functions[index]; }
+
+	const ProfileBlock& getBlock(unsigned int index) const { return blocks[index]; }
+
+	/**
+	* Returns the blocks control can flow to from the end of a block.
+	**/
+	const std::vector<unsigned int>& getSuccessors(unsigned int block) const { return successors[block]; }
+
+	unsigned int getNumberOfFunctions() const { return functions.size(); }
+
+	unsigned int getNumberOfBlocks() const { return blocks.size(); }
+
+	/**
+	* Returns the name of a function or an empty string for NO_FUNCTION.
+	**/
+	std::string getFunctionName(unsigned int function) const;
+
+	/**
+	* Checks whether a block is the first block of its function.
+	**/
+	bool isFunctionStart(unsigned int block) const
+	{
+		unsigned int function = blocks[block].getFunction();
+
+		return function != NO_FUNCTION && functions[function].getAddress() == blocks[block].getAddress();
+	}
+};
+
+bool readProfileMap(const std::string& filename, ProfileMap& map);
+bool writeProfileMap(const std::string& filename, const ProfileMap& map);
+
+#endif
@@ -0,0 +1,377 @@
+#include "report.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "helpers.hpp"
+#include "rollup.hpp"
+
+/**
+* Checks whether a block was hit or not.
+**/
+bool wasHit(const TimedBlock* block)
+{
+	return block->getHits() != 0;
+}
+
+/**
+* Counts the number of blocks in a list of blocks that were hit.
+**/
+unsigned int countHitBlocks(const std::list<TimedBlock*>& blocks)
+{
+	return std::count_if(blocks.begin(), blocks.end(), wasHit);
+}
+
+/**
+* Marker for blocks and functions that have no row in the report data.
+**/
+static const int NO_ROW = -1;
+
+/**
+* Returns the index of a function name in the string table of the report data and
+* adds the function to the table when its name is used for the first time.
+* @param function The index of the function in the profile map
+* @param nameIndices The string table index of each function, or NO_ROW
+* @param names The functions in the order of the string table
+**/
+int getNameIndex(unsigned int function, std::vector<int>& nameIndices, std::vector<unsigned int>& names)
+{
+	if (function == ProfileMap::NO_FUNCTION)
+	{
+		return NO_ROW;
+	}
+
+	if (nameIndices[function] == NO_ROW)
+	{
+		nameIndices[function] = names.size();
+		names.push_back(function);
+	}
+
+	return nameIndices[function];
+}
+
+/**
+* Writes the statistics of a block or function as a row of the report data.
+**/
+void writeDataRow(std::ostream& stream, const TimedBlock& bb, int name, bool first)
+{
+	if (!first)
+	{
+		stream << ",";
+	}
+
+	stream << "\n" << bb.getAddress() << "," << name << "," << bb.getTime() << "," << bb.getHits();
+	stream << "," << bb.getLatency().getQuantile(0.50);
+	stream << "," << bb.getLatency().getQuantile(0.95);
+	stream << "," << bb.getLatency().getQuantile(0.99);
+	stream << "," << bb.getOnCpuTime() << "," << bb.getOffCpuTime();
+}
+
+/**
+* Writes the results of a profiling run as the JSON object the report template renders.
+*
+* Each table is a flat array of numbers with a fixed number of values per row
+* and every function name is stored once in a string table:
+*
+* names:     function names
+* functions: address, name, total time, hits, p50, p95, p99, on-CPU time,
+*            off-CPU time
+* blocks:    address, name, total time, hits, p50, p95, p99, on-CPU time,
+*            off-CPU time
+* loops:     header address, name, depth, blocks, entries, iterations, total time,
+*            p50, p95 and maximum of the iterations per entry
+* rollups:   parent row, total time, hits, number of blocks or functions
+* events:    row in blocks, time difference to the previous event
+*
+* The on-CPU and off-CPU times are 0 if the trace has no CPU times of the threads.
+* The group names of the rollups are stored in rollupNames and the three roots
+* (segments, modules and namespaces) have the parent -1. Only blocks, functions,
+* loops and groups that were hit have a row.
+**/
+void writeReportData(std::ostream& stream, const ProfileMap& map, Profile& profile, TraceDecoder& events)
+{
+	std::vector<int> nameIndices(map.getNumberOfFunctions(), NO_ROW);
+	std::vector<unsigned int> names;
+
+	stream << "{\"functions\":[";
+
+	bool first = true;
+
+	for (unsigned int i = 0; i < profile.getNumberOfFunctions(); i++)
+	{
+		const TimedBlock& function = profile.getFunction(i);
+
+		if (function.getHits() != 0 || function.getTime() != 0)
+		{
+			writeDataRow(stream, function, getNameIndex(i, nameIndices, names), first);
+
+			first = false;
+		}
+	}
+
+	stream << "],\n\"blocks\":[";
+
+	std::vector<int> blockRows(profile.getNumberOfBlocks(), NO_ROW);
+	int rows = 0;
+
+	for (unsigned int i = 0; i < profile.getNumberOfBlocks(); i++)
+	{
+		const TimedBlock& block = profile.getBlock(i);
+
+		if (block.getHits() != 0)
+		{
+			writeDataRow(stream, block, getNameIndex(block.getFunction(), nameIndices, names), rows == 0);
+
+			blockRows[i] = rows++;
+		}
+	}
+
+	stream << "],\n\"loops\":[";
+
+	const LoopForest& forest = profile.getLoopForest();
+
+	first = true;
+
+	for (unsigned int i = 0; i < forest.getNumberOfLoops(); i++)
+	{
+		const Loop& loop = forest.getLoop(i);
+		const LoopStatistics& statistics = profile.getLoops()[i];
+
+		if (statistics.getEntries() == 0)
+		{
+			continue;
+		}
+
+		const ProfileBlock& header = map.getBlock(loop.getHeader());
+
+		stream << (first ? "\n" : ",\n") << header.getAddress() << "," << getNameIndex(header.getFunction(), nameIndices, names);
+		stream << "," << loop.getDepth() << "," << loop.getBlocks().size() << "," << statistics.getEntries();
+		stream << "," << statistics.getIterations() << "," << statistics.getTime();
+		stream << "," << statistics.getIterationCounts().getQuantile(0.50);
+		stream << "," << statistics.getIterationCounts().getQuantile(0.95);
+		stream << "," << statistics.getIterationCounts().getMaximum();
+
+		first = false;
+	}
+
+	stream << "],\n\"rollups\":[";
+
+	RollupTree rollups;
+
+	createRollups(map, profile, rollups);
+
+	std::vector<int> rollupRows(rollups.getNumberOfNodes(), NO_ROW);
+	std::vector<unsigned int> rollupNames;
+
+	// Parents are always created before their children
+	for (unsigned int i = 0; i < rollups.getNumberOfNodes(); i++)
+	{
+		const RollupNode& node = rollups.getNode(i);
+
+		if (node.items == 0 && node.parent != RollupTree::NO_NODE)
+		{
+			continue;
+		}
+
+		rollupRows[i] = rollupNames.size();
+
+		stream << (rollupNames.empty() ? "\n" : ",\n") << (node.parent == RollupTree::NO_NODE ? NO_ROW : rollupRows[node.parent]);
+		stream << "," << node.time << "," << node.hits << "," << node.items;
+
+		rollupNames.push_back(i);
+	}
+
+	stream << "],\n\"rollupNames\":[";
+
+	for (std::vector<unsigned int>::size_type i = 0; i < rollupNames.size(); i++)
+	{
+		if (i != 0)
+		{
+			stream << ",";
+		}
+
+		writeJsonString(stream, rollups.getNode(rollupNames[i]).name);
+	}
+
+	stream << "],\n\"events\":[";
+
+	TraceEvent event;
+	unsigned long long lastTime = 0;
+	unsigned int counter = 0;
+
+	while (events.next(event))
+	{
+		if (event.block >= blockRows.size() || blockRows[event.block] == NO_ROW)
+		{
+			continue;
+		}
+
+		if (counter != 0)
+		{
+			stream << ",";
+		}
+
+		// Keep the lines short for editors that struggle with long lines
+		if (counter % 16 == 0)
+		{
+			stream << "\n";
+		}
+
+		// Events of different threads are not necessarily in time order
+		if (event.time >= lastTime)
+		{
+			stream << blockRows[event.block] << "," << (event.time - lastTime);
+		}
+		else
+		{
+			stream << blockRows[event.block] << ",-" << (lastTime - event.time);
+		}
+
+		lastTime = event.time;
+		++counter;
+	}
+
+	stream << "],\n\"names\":[";
+
+	for (std::vector<unsigned int>::size_type i = 0; i < names.size(); i++)
+	{
+		if (i != 0)
+		{
+			stream << ",";
+		}
+
+		writeJsonString(stream, map.getFunctionName(names[i]));
+	}
+
+	stream << "]}";
+}
+
+/**
+* Fills the summary placeholders of the report template with the results of a
+* profiling run. The tables are rendered by the template from %DATA%.
+* @param overhead Description of the cost of profiling or an empty string if it
+* was not measured
+**/
+std::string generateReport(const std::string& templateString, const ProfileMap& map, Profile& profile, const std::string& overhead)
+{
+	std::string output = templateString;
+
+	std::list<TimedBlock*> blockResults = profile.getBlockResults();
+	std::list<TimedBlock*> functionResults = profile.getFunctionResults();
+
+	unsigned int functions = map.getNumberOfFunctions();
+	unsigned int hitFunctions = countHitBlocks(functionResults);
+	unsigned int unhitFunctions = functions - hitFunctions;
+
+	unsigned int blocks = map.getNumberOfBlocks();
+	unsigned int hitBlocks = countHitBlocks(blockResults);
+	unsigned int unhitBlocks = blocks - hitBlocks;
+
+	replaceString(output, "%FILENAME%", map.getInputFile());
+	replaceString(output, "%NUMBER_OF_FUNCTIONS%", toString(functions));
+	replaceString(output, "%NUMBER_OF_HIT_FUNCTIONS%", toString(hitFunctions));
+	replaceString(output, "%NUMBER_OF_HIT_FUNCTIONS_PERCENTAGE%", floatToString(100.0 * hitFunctions / functions));
+	replaceString(output, "%NUMBER_OF_NOT_HIT_FUNCTIONS%", toString(unhitFunctions));
+	replaceString(output, "%NUMBER_OF_NOT_HIT_FUNCTIONS_PERCENTAGE%", floatToString(100.0 * unhitFunctions / functions));
+	replaceString(output, "%NUMBER_OF_BLOCKS%", toString(blocks));
+	replaceString(output, "%NUMBER_OF_HIT_BLOCKS%", toString(hitBlocks));
+	replaceString(output, "%NUMBER_OF_HIT_BLOCKS_PERCENTAGE%", floatToString(100.0 * hitBlocks / blocks));
+	replaceString(output, "%NUMBER_OF_NOT_HIT_BLOCKS%", toString(unhitBlocks));
+	replaceString(output, "%NUMBER_OF_NOT_HIT_BLOCKS_PERCENTAGE%", floatToString(100.0 * unhitBlocks / blocks));
+	replaceString(output, "%PROFILER_OVERHEAD%", overhead.empty() ? "" : "Profiler overhead: " + overhead);
+
+	return output;
+}
+
+/**
+* Writes the report of a profiling run. The report data is streamed into the
+* place of %DATA% so the potentially large event list is never held in memory.
+**/
+void writeReport(std::ostream& stream, const std::string& templateString, const ProfileMap& map, Profile& profile, TraceDecoder& events, const std::string& overhead)
+{
+	std::string output = generateReport(templateString, map, profile, overhead);
+
+	std::string::size_type data = output.find("%DATA%");
+
+	if (data == std::string::npos)
+	{
+		stream << output;
+
+		return;
+	}
+
+	stream.write(output.c_str(), data);
+
+	writeReportData(stream, map, profile, events);
+
+	stream << output.substr(data + 6);
+}
+
+/**
+* Creates the output HTML file.
+* @param templateFilename The name of the report template
+* @param outputFilename The name of the HTML file to create
+* @param overhead Description of the cost of profiling for the report footer
+* @return False if the template could not be read
+**/
+bool writeOutput(const std::string& templateFilename, const std::string& outputFilename, const ProfileMap& map, Profile& profile, TraceDecoder& events, const std::string& overhead)
+{
+	std::string templateString;
+
+	if (!readTextFile(templateFilename, templateString))
+	{
+		return false;
+	}
+
+	std::ofstream file(outputFilename.c_str(), std::ios::binary);
+
+	writeReport(file, templateString, map, profile, events, overhead);
+
+	return true;
+}
+
+/**
+* Writes a CSV line with the statistics of a block or function.
+**/
+void writeStatisticsLine(std::ostream& stream, const char* type, const std::string& name, const TimedBlock& bb)
+{
+	std::string quotedName = name;
+
+	replaceString(quotedName, "\"", "\"\"");
+
+	stream << type << ",0x" << std::uppercase << std::hex << bb.getAddress() << std::nouppercase << std::dec;
+	stream << ",\"" << quotedName << "\"," << bb.getHits() << "," << bb.getTime();
+	stream << "," << bb.getLatency().getQuantile(0.50);
+	stream << "," << bb.getLatency().getQuantile(0.95);
+	stream << "," << bb.getLatency().getQuantile(0.99);
+	stream << "," << bb.getOnCpuTime() << "," << bb.getOffCpuTime() << "\n";
+}
+
+/**
+* Writes the statistics of all functions and blocks that were hit as CSV.
+**/
+void writeStatistics(std::ostream& stream, const ProfileMap& map, Profile& profile)
+{
+	stream << "type,address,function,hits,time_ms,p50_ms,p95_ms,p99_ms,on_cpu_ms,off_cpu_ms\n";
+
+	for (unsigned int i = 0; i < profile.getNumberOfFunctions(); i++)
+	{
+		const TimedBlock& function = profile.getFunction(i);
+
+		if (function.getHits() != 0 || function.getTime() != 0)
+		{
+			writeStatisticsLine(stream, "function", map.getFunctionName(i), function);
+		}
+	}
+
+	for (unsigned int i = 0; i < profile.getNumberOfBlocks(); i++)
+	{
+		const TimedBlock& block = profile.getBlock(i);
+
+		if (block.getHits() != 0)
+		{
+			writeStatisticsLine(stream, "block", map.getFunctionName(block.getFunction()), block);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+#include <list>
+#include <ostream>
+#include <string>
+
+#include "analysis.hpp"
+#include "profilemap.hpp"
+#include "trace.hpp"
+
+unsigned int countHitBlocks(const std::list<TimedBlock*>& blocks);
+
+void writeReportData(std::ostream& stream, const ProfileMap& map, Profile& profile, TraceDecoder& events);
+
+std::string generateReport(const std::string& templateString, const ProfileMap& map, Profile& profile, const std::string& overhead = "");
+
+void writeReport(std::ostream& stream, const std::string& templateString, const ProfileMap& map, Profile& profile, TraceDecoder& events, const std::string& overhead = "");
+
+void writeStatistics(std::ostream& stream, const ProfileMap& map, Profile& profile);
+
+bool writeOutput(const std::string& templateFilename, const std::string& outputFilename, const ProfileMap& map, Profile& profile, TraceDecoder& events, const std::string& overhead = "");
+
+#endif
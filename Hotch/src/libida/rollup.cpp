@@ -0,0 +1,257 @@
+#include "rollup.hpp"
+
+#include "helpers.hpp"
+
+// The constants are passed by reference to container functions
+const unsigned int RollupTree::NO_NODE;
+
+namespace
+{
+	const char* NO_SEGMENT_NAME = "[no segment]";
+	const char* NO_FUNCTION_NAME = "[no function]";
+	const char* GLOBAL_NAMESPACE = "[global]";
+
+	/**
+	* Returns the name of a file without its directory.
+	**/
+	std::string getBaseName(const std::string& path)
+	{
+		std::string::size_type separator = path.find_last_of("/\\");
+
+		return separator == std::string::npos ? path : path.substr(separator + 1);
+	}
+
+	/**
+	* Returns the scopes of a demangled name without the return type, the calling
+	* convention and the parameters. Template arguments stay with their scope.
+	**/
+	std::vector<std::string> splitScopes(const std::string& name)
+	{
+		std::vector<std::string> scopes;
+		std::string current;
+
+		int depth = 0;
+
+		for (std::string::size_type i = 0; i < name.size(); i++)
+		{
+			char c = name[i];
+
+			if (c == '<')
+			{
+				++depth;
+			}
+			else if (c == '>')
+			{
+				--depth;
+			}
+			else if (depth == 0 && c == '(' && !current.empty())
+			{
+				break;
+			}
+			else if (depth == 0 && c == ' ')
+			{
+				// Everything before a space belongs to the return type or the calling convention
+				scopes.clear();
+				current.clear();
+
+				continue;
+			}
+			else if (depth == 0 && c == ':' && i + 1 < name.size() && name[i + 1] == ':')
+			{
+				scopes.push_back(current);
+				current.clear();
+
+				++i;
+
+				continue;
+			}
+
+			current += c;
+		}
+
+		scopes.push_back(current);
+
+		return scopes;
+	}
+}
+
+RollupTree::RollupTree()
+{
+	addNode(NO_NODE, "Segments");
+	addNode(NO_NODE, "Modules");
+	addNode(NO_NODE, "Namespaces");
+}
+
+unsigned int RollupTree::addNode(unsigned int parent, const std::string& name)
+{
+	RollupNode node;
+
+	node.name = name;
+	node.parent = parent;
+	node.time = 0;
+	node.hits = 0;
+	node.items = 0;
+
+	unsigned int index = nodes.size();
+
+	nodes.push_back(node);
+	children[std::make_pair(parent, name)] = index;
+
+	return index;
+}
+
+unsigned int RollupTree::getChild(unsigned int parent, const std::string& name)
+{
+	std::map<std::pair<unsigned int, std::string>, unsigned int>::const_iterator Iter = children.find(std::make_pair(parent, name));
+
+	if (Iter != children.end())
+	{
+		return Iter->second;
+	}
+
+	return addNode(parent, name);
+}
+
+void RollupTree::add(unsigned int node, unsigned long long time, unsigned long long hits)
+{
+	for (unsigned int current = node; current != NO_NODE; current = nodes[current].parent)
+	{
+		nodes[current].time += time;
+		nodes[current].hits += hits;
+		nodes[current].items += 1;
+	}
+}
+
+std::vector<std::string> getNamespaces(const ProfileFunction& function)
+{
+	std::vector<std::string> namespaces;
+
+	if (!function.getDemangledName().empty())
+	{
+		namespaces = splitScopes(function.getDemangledName());
+
+		// The last scope is the function itself
+		namespaces.pop_back();
+
+		return namespaces;
+	}
+
+	const std::string& name = function.getName();
+
+	std::string::size_type start = name.find_first_not_of('_');
+
+	if (start == std::string::npos)
+	{
+		return namespaces;
+	}
+
+	std::string::size_type end = name.find('_', start);
+
+	if (end != std::string::npos)
+	{
+		namespaces.push_back(name.substr(start, end - start));
+	}
+
+	return namespaces;
+}
+
+void createRollups(const ProfileMap& map, Profile& profile, RollupTree& tree)
+{
+	// Blocks are grouped by the segment they are in
+	std::vector<unsigned int> segmentNodes(map.getNumberOfSegments(), RollupTree::NO_NODE);
+
+	for (unsigned int i = 0; i < profile.getNumberOfBlocks(); i++)
+	{
+		const TimedBlock& block = profile.getBlock(i);
+
+		if (block.getHits() == 0 && block.getTime() == 0)
+		{
+			continue;
+		}
+
+		unsigned int segment = map.findSegment(block.getAddress());
+
+		unsigned int node;
+
+		if (segment == ProfileMap::NO_SEGMENT)
+		{
+			node = tree.getChild(RollupTree::SEGMENTS, NO_SEGMENT_NAME);
+		}
+		else
+		{
+			if (segmentNodes[segment] == RollupTree::NO_NODE)
+			{
+				segmentNodes[segment] = tree.getChild(RollupTree::SEGMENTS, map.getSegment(segment).getName());
+			}
+
+			node = segmentNodes[segment];
+		}
+
+		tree.add(node, block.getTime(), block.getHits());
+
+		// Time outside of functions does not show up in any function
+		if (block.getFunction() == ProfileMap::NO_FUNCTION)
+		{
+			tree.add(tree.getChild(RollupTree::NAMESPACES, NO_FUNCTION_NAME), block.getTime(), block.getHits());
+		}
+	}
+
+	// Functions are grouped by module and namespace
+	std::string fileModule = getBaseName(map.getInputFile());
+
+	for (unsigned int i = 0; i < profile.getNumberOfFunctions(); i++)
+	{
+		const TimedBlock& statistics = profile.getFunction(i);
+
+		if (statistics.getHits() == 0 && statistics.getTime() == 0)
+		{
+			continue;
+		}
+
+		const ProfileFunction& function = map.getFunction(i);
+
+		tree.add(tree.getChild(RollupTree::MODULES, function.getModule().empty() ? fileModule : function.getModule()), statistics.getTime(), statistics.getHits());
+
+		std::vector<std::string> namespaces = getNamespaces(function);
+
+		unsigned int node = RollupTree::NAMESPACES;
+
+		if (namespaces.empty())
+		{
+			node = tree.getChild(node, GLOBAL_NAMESPACE);
+		}
+
+		for (std::vector<std::string>::const_iterator Iter = namespaces.begin(); Iter != namespaces.end(); ++Iter)
+		{
+			node = tree.getChild(node, *Iter);
+		}
+
+		tree.add(node, statistics.getTime(), statistics.getHits());
+	}
+}
+
+void writeRollups(std::ostream& stream, const RollupTree& tree)
+{
+	stream << "group,time_ms,hits,items\n";
+
+	for (unsigned int i = 0; i < tree.getNumberOfNodes(); i++)
+	{
+		const RollupNode& node = tree.getNode(i);
+
+		if (node.items == 0)
+		{
+			continue;
+		}
+
+		std::string path = node.name;
+
+		for (unsigned int parent = node.parent; parent != RollupTree::NO_NODE; parent = tree.getNode(parent).parent)
+		{
+			path = tree.getNode(parent).name + "/" + path;
+		}
+
+		replaceString(path, "\"", "\"\"");
+
+		stream << "\"" << path << "\"," << node.time << "," << node.hits << "," << node.items << "\n";
+	}
+}
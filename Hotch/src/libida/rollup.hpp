@@ -0,0 +1,87 @@
+#ifndef ROLLUP_HPP
+#define ROLLUP_HPP
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "analysis.hpp"
+#include "profilemap.hpp"
+
+/**
+* A group of blocks or functions, for example a segment or a namespace. The time
+* and hits of a node include those of all nodes below it.
+**/
+struct RollupNode
+{
+	std::string name;
+	unsigned int parent;
+
+	unsigned long long time;
+	unsigned long long hits;
+
+	// Number of blocks or functions in the group
+	unsigned int items;
+};
+
+/**
+* Groups the results of a profiling run into three hierarchies below the roots
+* SEGMENTS (blocks by segment), MODULES (functions by the module of their import
+* thunk or the profiled file) and NAMESPACES (functions by the namespaces of their
+* demangled names or the prefix of their plain names).
+**/
+class RollupTree
+{
+private:
+	std::vector<RollupNode> nodes;
+
+	std::map<std::pair<unsigned int, std::string>, unsigned int> children;
+
+	unsigned int addNode(unsigned int parent, const std::string& name);
+
+public:
+	static const unsigned int NO_NODE = 0xFFFFFFFF;
+
+	static const unsigned int SEGMENTS = 0;
+	static const unsigned int MODULES = 1;
+	static const unsigned int NAMESPACES = 2;
+
+	RollupTree();
+
+	/**
+	* Returns the child of a node with the given name and creates it if it does
+	* not exist yet.
+	**/
+	unsigned int getChild(unsigned int parent, const std::string& name);
+
+	/**
+	* Adds a block or function to a group and all groups above it.
+	**/
+	void add(unsigned int node, unsigned long long time, unsigned long long hits);
+
+	const RollupNode& getNode(unsigned int node) const { return nodes[node]; }
+
+	unsigned int getNumberOfNodes() const { return nodes.size(); }
+};
+
+/**
+* Returns the namespaces of a function from the outermost to the innermost one.
+* Demangled names are split at their scope operators; plain names like
+* png_read_row are grouped by the part before their first underscore.
+**/
+std::vector<std::string> getNamespaces(const ProfileFunction& function);
+
+/**
+* Groups the blocks and functions of a profile in a single pass over each.
+**/
+void createRollups(const ProfileMap& map, Profile& profile, RollupTree& tree);
+
+/**
+* Writes the groups that were hit as CSV, one line per group with the path of the
+* group from its root.
+**/
+void writeRollups(std::ostream& stream, const RollupTree& tree);
+
+#endif
@@ -0,0 +1,144 @@
+#include "sampling.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	/**
+	* Takes the samples from the samples record of a trace.
+	**/
+	class SampleReader : public TraceRecordListener
+	{
+	private:
+		SampleCounter& samples;
+		unsigned long long& interval;
+
+		bool found;
+
+	public:
+		SampleReader(SampleCounter& samples, unsigned long long& interval) : samples(samples), interval(interval), found(false) { }
+
+		void addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+		{
+			if (type != Trace::EXTENDED_SAMPLES)
+			{
+				return;
+			}
+
+			unsigned int position = 0;
+			unsigned long long unknownSamples;
+
+			if (!Trace::readVarint(payload, position, interval) || !Trace::readVarint(payload, position, unknownSamples))
+			{
+				return;
+			}
+
+			BlockRanges ranges;
+			std::vector<unsigned long long> counts;
+
+			unsigned long long start;
+			unsigned long long end;
+			unsigned long long count;
+
+			while (Trace::readVarint(payload, position, start) && Trace::readVarint(payload, position, end) && Trace::readVarint(payload, position, count))
+			{
+				ranges.add(static_cast<address_t>(start), static_cast<address_t>(end));
+				counts.push_back(count);
+			}
+
+			samples.setRanges(ranges);
+
+			for (unsigned int i = 0; i < counts.size(); i++)
+			{
+				samples.addSamples(i, counts[i]);
+			}
+
+			samples.addSamples(BlockRanges::NO_RANGE, unknownSamples);
+
+			found = true;
+		}
+
+		bool hasSamples() const { return found; }
+	};
+}
+
+unsigned int BlockRanges::find(address_t address) const
+{
+	std::vector<address_t>::const_iterator Iter = std::upper_bound(starts.begin(), starts.end(), address);
+
+	if (Iter == starts.begin())
+	{
+		return NO_RANGE;
+	}
+
+	unsigned int range = (Iter - starts.begin()) - 1;
+
+	return address < ends[range] ? range : NO_RANGE;
+}
+
+void analyzeSamples(const SampleCounter& samples, const ProfileMap& map, Profile& profile, unsigned long long interval)
+{
+	const BlockRanges& ranges = samples.getRanges();
+
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		unsigned long long count = samples.getCount(i);
+		unsigned int block = map.findBlock(ranges.getStart(i));
+
+		if (count == 0 || block == BlockIndex::INVALID_INDEX)
+		{
+			continue;
+		}
+
+		profile.getBlock(block).addHits(count);
+		profile.getBlock(block).addTime(count * interval);
+
+		unsigned int function = map.getBlock(block).getFunction();
+
+		if (function != ProfileMap::NO_FUNCTION)
+		{
+			profile.getFunction(function).addHits(count);
+			profile.getFunction(function).addTime(count * interval);
+		}
+	}
+}
+
+std::vector<unsigned char> encodeSamples(const SampleCounter& samples, unsigned long long interval)
+{
+	std::vector<unsigned char> payload;
+
+	Trace::appendVarint(payload, interval);
+	Trace::appendVarint(payload, samples.getNumberOfUnknownSamples());
+
+	const BlockRanges& ranges = samples.getRanges();
+
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		if (samples.getCount(i) == 0)
+		{
+			continue;
+		}
+
+		Trace::appendVarint(payload, ranges.getStart(i));
+		Trace::appendVarint(payload, ranges.getEnd(i));
+		Trace::appendVarint(payload, samples.getCount(i));
+	}
+
+	return payload;
+}
+
+bool readSamples(TraceDecoder& decoder, SampleCounter& samples, unsigned long long& interval)
+{
+	SampleReader reader(samples, interval);
+
+	decoder.setRecordListener(&reader);
+
+	// Sampling sessions record no events, so decoding stops at the first one
+	TraceEvent event;
+
+	bool hasEvents = decoder.next(event);
+
+	decoder.setRecordListener(0);
+
+	return !hasEvents && reader.hasSamples();
+}
@@ -0,0 +1,127 @@
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <vector>
+
+#include "types.hpp"
+#include "analysis.hpp"
+#include "profilemap.hpp"
+
+/**
+* Finds the block that contains an address. Blocks are kept as sorted address
+* ranges, so a lookup is a binary search and does not need the IDB.
+**/
+class BlockRanges
+{
+private:
+	std::vector<address_t> starts;
+	std::vector<address_t> ends;
+
+public:
+	static const unsigned int NO_RANGE = 0xFFFFFFFF;
+
+	/**
+	* Adds the range [start, end) of a block. Ranges must be added in ascending
+	* order and must not overlap.
+	**/
+	void add(address_t start, address_t end)
+	{
+		starts.push_back(start);
+		ends.push_back(end);
+	}
+
+	/**
+	* Returns the index of the range that contains an address or NO_RANGE.
+	**/
+	unsigned int find(address_t address) const;
+
+	address_t getStart(unsigned int range) const { return starts[range]; }
+
+	address_t getEnd(unsigned int range) const { return ends[range]; }
+
+	unsigned int size() const { return starts.size(); }
+};
+
+/**
+* Counts the samples of the instruction pointers of a sampled process by block.
+**/
+class SampleCounter
+{
+private:
+	BlockRanges ranges;
+
+	// Number of samples in each block range
+	std::vector<unsigned long long> counts;
+
+	unsigned long long samples;
+	unsigned long long unknownSamples;
+
+public:
+	SampleCounter() : samples(0), unknownSamples(0) { }
+
+	/**
+	* Sets the blocks that samples are attributed to.
+	**/
+	void setRanges(const BlockRanges& ranges)
+	{
+		this->ranges = ranges;
+
+		counts.assign(ranges.size(), 0);
+	}
+
+	const BlockRanges& getRanges() const { return ranges; }
+
+	void addSample(address_t address) { addSamples(ranges.find(address), 1); }
+
+	/**
+	* Adds samples of a range at once.
+	* @param range The index of the range or NO_RANGE for samples outside of all ranges
+	**/
+	void addSamples(unsigned int range, unsigned long long count)
+	{
+		samples += count;
+
+		if (range == BlockRanges::NO_RANGE)
+		{
+			unknownSamples += count;
+		}
+		else
+		{
+			counts[range] += count;
+		}
+	}
+
+	unsigned long long getCount(unsigned int range) const { return counts[range]; }
+
+	unsigned long long getNumberOfSamples() const { return samples; }
+
+	/**
+	* Returns the number of samples outside of all blocks, for example in
+	* system libraries.
+	**/
+	unsigned long long getNumberOfUnknownSamples() const { return unknownSamples; }
+};
+
+/**
+* Fills a profile from the samples of a sampling run. Every sample counts as a hit
+* of its block and function and adds one sampling interval to their time, so the
+* times estimate the time spent in each block and function, excluding callees.
+* @param interval The time between two samples in milliseconds
+**/
+void analyzeSamples(const SampleCounter& samples, const ProfileMap& map, Profile& profile, unsigned long long interval);
+
+/**
+* Encodes the samples of a sampling run as the payload of a trace record, so that
+* the run can be analyzed again from its trace.
+* @param interval The time between two samples in milliseconds
+**/
+std::vector<unsigned char> encodeSamples(const SampleCounter& samples, unsigned long long interval);
+
+/**
+* Reads the samples of a sampling run from its trace.
+* @param interval Receives the time between two samples in milliseconds
+* @return False if the trace has events or no samples
+**/
+bool readSamples(TraceDecoder& decoder, SampleCounter& samples, unsigned long long& interval);
+
+#endif
@@ -0,0 +1,134 @@
+#include "sketch.hpp"
+
+#include <cmath>
+
+unsigned int LatencySketch::getBucket(unsigned long long value)
+{
+	const unsigned long long SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+
+	if (value < SUB_BUCKETS)
+	{
+		return static_cast<unsigned int>(value);
+	}
+
+	if (value >= (1ULL << MAXIMUM_BITS))
+	{
+		value = (1ULL << MAXIMUM_BITS) - 1;
+	}
+
+	unsigned int octave = SUB_BUCKET_BITS;
+
+	while ((value >> (octave + 1)) != 0)
+	{
+		++octave;
+	}
+
+	unsigned int subBucket = static_cast<unsigned int>((value >> (octave - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+
+	return ((octave - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) + subBucket;
+}
+
+unsigned long long LatencySketch::getBucketValue(unsigned int bucket)
+{
+	const unsigned int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+	if (bucket < SUB_BUCKETS)
+	{
+		return bucket;
+	}
+
+	unsigned int octave = (bucket >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+	unsigned long long subBucket = bucket & (SUB_BUCKETS - 1);
+
+	unsigned long long low = (SUB_BUCKETS + subBucket) << (octave - SUB_BUCKET_BITS);
+	unsigned long long width = 1ULL << (octave - SUB_BUCKET_BITS);
+
+	// The middle of the bucket keeps the relative error symmetric
+	return low + width / 2;
+}
+
+void LatencySketch::add(unsigned long long value)
+{
+	if (buckets.empty())
+	{
+		buckets.resize(BUCKETS);
+
+		minimum = value;
+		maximum = value;
+	}
+
+	++buckets[getBucket(value)];
+	++count;
+
+	if (value < minimum)
+	{
+		minimum = value;
+	}
+
+	if (value > maximum)
+	{
+		maximum = value;
+	}
+}
+
+void LatencySketch::merge(const LatencySketch& other)
+{
+	if (other.count == 0)
+	{
+		return;
+	}
+
+	if (count == 0)
+	{
+		*this = other;
+		return;
+	}
+
+	for (unsigned int i = 0; i < BUCKETS; i++)
+	{
+		buckets[i] += other.buckets[i];
+	}
+
+	count += other.count;
+
+	if (other.minimum < minimum)
+	{
+		minimum = other.minimum;
+	}
+
+	if (other.maximum > maximum)
+	{
+		maximum = other.maximum;
+	}
+}
+
+unsigned long long LatencySketch::getQuantile(double quantile) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	unsigned long long rank = static_cast<unsigned long long>(std::ceil(quantile * count));
+
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+
+	unsigned long long seen = 0;
+
+	for (unsigned int i = 0; i < BUCKETS; i++)
+	{
+		seen += buckets[i];
+
+		if (seen >= rank)
+		{
+			unsigned long long value = getBucketValue(i);
+
+			return value < minimum ? minimum : (value > maximum ? maximum : value);
+		}
+	}
+
+	return maximum;
+}
@@ -0,0 +1,48 @@
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include <vector>
+
+/**
+* Mergeable histogram of durations that answers quantile queries with a relative
+* error of at most 1/16.
+*
+* Durations below 8 ms get their own bucket. Larger durations are grouped into 8
+* buckets per power of two up to 2^32 ms, so a sketch never uses more than
+* BUCKETS counters, no matter how many samples are added. The counters are only
+* allocated once the first sample arrives because most blocks of a file are never hit.
+**/
+class LatencySketch
+{
+private:
+	std::vector<unsigned int> buckets;
+
+	unsigned long long count;
+	unsigned long long minimum;
+	unsigned long long maximum;
+
+	static unsigned int getBucket(unsigned long long value);
+	static unsigned long long getBucketValue(unsigned int bucket);
+
+public:
+	static const unsigned int SUB_BUCKET_BITS = 3;
+	static const unsigned int MAXIMUM_BITS = 32;
+	static const unsigned int BUCKETS = (MAXIMUM_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+	LatencySketch() : count(0), minimum(0), maximum(0) { }
+
+	void add(unsigned long long value);
+
+	void merge(const LatencySketch& other);
+
+	unsigned long long getCount() const { return count; }
+
+	unsigned long long getMaximum() const { return maximum; }
+
+	/**
+	* Returns the estimated value below which the given fraction of the samples lies.
+	**/
+	unsigned long long getQuantile(double quantile) const;
+};
+
+#endif
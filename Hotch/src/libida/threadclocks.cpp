@@ -0,0 +1,130 @@
+#include "threadclocks.hpp"
+
+#include <intrin.h>
+
+namespace
+{
+	// FILETIME values count in units of 100 ns
+	const unsigned long long FILETIME_UNITS_PER_MILLISECOND = 10000;
+
+	// Time over which the rate of the cycle counter is measured in milliseconds
+	const DWORD CALIBRATION_TIME = 20;
+
+	unsigned long long toUnits(const FILETIME& time)
+	{
+		return (static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	}
+
+	/**
+	* Measures the rate of the time stamp counter, in whose cycles Windows counts
+	* the cycle times of threads.
+	* @return 0 if the rate could not be measured
+	**/
+	unsigned long long measureCyclesPerMillisecond()
+	{
+		LARGE_INTEGER frequency;
+		LARGE_INTEGER start;
+		LARGE_INTEGER end;
+
+		if (!QueryPerformanceFrequency(&frequency) || !QueryPerformanceCounter(&start))
+		{
+			return 0;
+		}
+
+		unsigned long long startCycles = __rdtsc();
+
+		Sleep(CALIBRATION_TIME);
+
+		QueryPerformanceCounter(&end);
+
+		unsigned long long cycles = __rdtsc() - startCycles;
+		unsigned long long ticks = end.QuadPart - start.QuadPart;
+
+		return ticks == 0 ? 0 : cycles * frequency.QuadPart / (ticks * 1000);
+	}
+}
+
+ThreadClocks::ThreadClocks() : queryThreadCycleTime(0), cyclesPerMillisecond(0)
+{
+	HMODULE kernel = GetModuleHandle("kernel32.dll");
+
+	if (kernel)
+	{
+		queryThreadCycleTime = reinterpret_cast<QueryThreadCycleTimeFunction>(GetProcAddress(kernel, "QueryThreadCycleTime"));
+	}
+
+	if (queryThreadCycleTime)
+	{
+		cyclesPerMillisecond = measureCyclesPerMillisecond();
+	}
+}
+
+bool ThreadClocks::getCpuTime(unsigned int thread, unsigned long long& time)
+{
+	std::map<unsigned int, HANDLE>::iterator handle = handles.find(thread);
+
+	if (handle == handles.end())
+	{
+		handle = handles.insert(std::make_pair(thread, OpenThread(THREAD_QUERY_INFORMATION, FALSE, thread))).first;
+	}
+
+	if (!handle->second)
+	{
+		return false;
+	}
+
+	if (queryThreadCycleTime && cyclesPerMillisecond != 0)
+	{
+		ULONG64 cycles;
+
+		if (!queryThreadCycleTime(handle->second, &cycles))
+		{
+			return false;
+		}
+
+		time = cycles / cyclesPerMillisecond;
+
+		return true;
+	}
+
+	FILETIME creation, exit, kernel, user;
+
+	if (!GetThreadTimes(handle->second, &creation, &exit, &kernel, &user))
+	{
+		return false;
+	}
+
+	time = (toUnits(kernel) + toUnits(user)) / FILETIME_UNITS_PER_MILLISECOND;
+
+	return true;
+}
+
+void ThreadClocks::removeThread(unsigned int thread)
+{
+	std::map<unsigned int, HANDLE>::iterator handle = handles.find(thread);
+
+	if (handle == handles.end())
+	{
+		return;
+	}
+
+	if (handle->second)
+	{
+		CloseHandle(handle->second);
+	}
+
+	handles.erase(handle);
+}
+
+void ThreadClocks::close()
+{
+	for (std::map<unsigned int, HANDLE>::iterator Iter = handles.begin(); Iter != handles.end(); ++Iter)
+	{
+		if (Iter->second)
+		{
+			CloseHandle(Iter->second);
+		}
+	}
+
+	handles.clear();
+}
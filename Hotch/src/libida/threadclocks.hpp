@@ -0,0 +1,56 @@
+#ifndef THREADCLOCKS_HPP
+#define THREADCLOCKS_HPP
+
+#include <windows.h>
+
+#include <map>
+
+/**
+* Reads the CPU time the threads of the target process used so far. The handle of
+* a thread is opened at its first read and kept until the thread exits.
+*
+* The time comes from the cycle counter of the thread, which resolves the short
+* times between two breakpoint hits. Before Windows Vista only the user and kernel
+* time of a thread is available, which Windows updates once per scheduler tick.
+**/
+class ThreadClocks
+{
+private:
+	typedef BOOL (WINAPI* QueryThreadCycleTimeFunction)(HANDLE, PULONG64);
+
+	// Threads that could not be opened have a handle of 0
+	std::map<unsigned int, HANDLE> handles;
+
+	// QueryThreadCycleTime or 0 if Windows does not have it
+	QueryThreadCycleTimeFunction queryThreadCycleTime;
+
+	unsigned long long cyclesPerMillisecond;
+
+	// The handles are owned by the clocks
+	ThreadClocks(const ThreadClocks&);
+	ThreadClocks& operator=(const ThreadClocks&);
+
+public:
+	ThreadClocks();
+
+	~ThreadClocks() { close(); }
+
+	/**
+	* Reads the CPU time of a thread in milliseconds.
+	* @return False if the CPU time of the thread can not be read
+	**/
+	bool getCpuTime(unsigned int thread, unsigned long long& time);
+
+	/**
+	* Closes the handle of a thread that exited, so that a new thread with the
+	* same ID is opened again.
+	**/
+	void removeThread(unsigned int thread);
+
+	/**
+	* Closes the handles of all threads.
+	**/
+	void close();
+};
+
+#endif
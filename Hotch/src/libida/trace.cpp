@@ -0,0 +1,435 @@
+#include "trace.hpp"
+
+namespace
+{
+	// Size of the window that is read from trace streams at once
+	const unsigned int CHUNK_SIZE = 64 * 1024;
+}
+
+const char Trace::MAGIC[4] = { 'H', 'T', 'R', 'C' };
+
+void Trace::appendVarint(std::vector<unsigned char>& data, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back(static_cast<unsigned char>(value | 0x80));
+		value >>= 7;
+	}
+
+	data.push_back(static_cast<unsigned char>(value));
+}
+
+bool Trace::readVarint(const std::vector<unsigned char>& data, unsigned int& position, unsigned long long& value)
+{
+	value = 0;
+
+	for (unsigned int shift = 0; shift < 64 && position < data.size(); shift += 7)
+	{
+		unsigned char byte = data[position++];
+
+		value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Trace::isBreak(unsigned int type, const std::vector<unsigned char>& payload, unsigned long long& time)
+{
+	if (type == EXTENDED_RESUME)
+	{
+		return true;
+	}
+
+	if (type != EXTENDED_SCOPE_EXIT)
+	{
+		return false;
+	}
+
+	unsigned int position = 0;
+	unsigned long long exitTime;
+
+	if (readVarint(payload, position, exitTime) && exitTime > time)
+	{
+		time = exitTime;
+	}
+
+	return true;
+}
+
+TraceEncoder::TraceEncoder() : lastBlock(0), lastThread(0), lastTime(0), pendingRepeats(0), events(0), hasLastEvent(false)
+{
+	buffer.insert(buffer.end(), Trace::MAGIC, Trace::MAGIC + sizeof(Trace::MAGIC));
+
+	writeVarint(Trace::VERSION);
+}
+
+void TraceEncoder::addRecord(unsigned int type, const std::vector<unsigned char>& payload)
+{
+	flushRepeats();
+
+	writeRecord(Trace::RECORD_EXTENDED, type);
+	writeVarint(payload.size());
+
+	buffer.insert(buffer.end(), payload.begin(), payload.end());
+}
+
+void TraceEncoder::addScopeExit(unsigned long long time)
+{
+	std::vector<unsigned char> payload;
+
+	Trace::appendVarint(payload, time);
+
+	addRecord(Trace::EXTENDED_SCOPE_EXIT, payload);
+
+	// The next hit is never a repeat of a hit in the scope that was left
+	hasLastEvent = false;
+}
+
+void TraceEncoder::setCpuTime(unsigned int thread, unsigned long long time)
+{
+	std::map<unsigned int, unsigned long long>::iterator last = cpuTimes.find(thread);
+
+	if (last != cpuTimes.end() && last->second == time)
+	{
+		return;
+	}
+
+	cpuTimes[thread] = time;
+
+	std::vector<unsigned char> payload;
+
+	Trace::appendVarint(payload, thread);
+	Trace::appendVarint(payload, time);
+
+	addRecord(Trace::EXTENDED_CPU_TIME, payload);
+}
+
+void TraceEncoder::drain(std::ostream& stream)
+{
+	if (!buffer.empty())
+	{
+		stream.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size());
+	}
+
+	buffer.clear();
+}
+
+TraceEncoderState TraceEncoder::getState() const
+{
+	TraceEncoderState state;
+
+	state.lastBlock = lastBlock;
+	state.lastThread = lastThread;
+	state.lastTime = lastTime;
+	state.events = events;
+	state.hasLastEvent = hasLastEvent;
+
+	return state;
+}
+
+void TraceEncoder::resume(const TraceEncoderState& state)
+{
+	buffer.clear();
+
+	lastBlock = state.lastBlock;
+	lastThread = state.lastThread;
+	lastTime = state.lastTime;
+	events = state.events;
+	pendingRepeats = 0;
+
+	// The events behind the interruption are never repeats of the events before it
+	hasLastEvent = false;
+
+	// The CPU times of the continued trace are written again
+	cpuTimes.clear();
+
+	addRecord(Trace::EXTENDED_RESUME, std::vector<unsigned char>());
+}
+
+TraceDecoder::TraceDecoder(std::istream& stream) : stream(&stream), chunk(CHUNK_SIZE), base(0), baseOffset(0), position(0), end(0), valid(false), ended(false), block(0), thread(0), time(0), repeats(0), events(0), windowStart(0), windowEnd(~0ULL), listener(0)
+{
+	readHeader();
+}
+
+TraceDecoder::TraceDecoder(const std::vector<unsigned char>& data) : stream(0), base(0), baseOffset(0), position(0), end(0), valid(false), ended(false), block(0), thread(0), time(0), repeats(0), events(0), windowStart(0), windowEnd(~0ULL), listener(0)
+{
+	if (!data.empty())
+	{
+		base = &data[0];
+		position = base;
+		end = position + data.size();
+	}
+
+	readHeader();
+}
+
+/**
+* Reads the next window of the trace stream. Returns false if the
+* end of the trace was reached.
+**/
+bool TraceDecoder::refill()
+{
+	if (!stream || !*stream)
+	{
+		return false;
+	}
+
+	stream->read(reinterpret_cast<char*>(&chunk[0]), chunk.size());
+
+	std::streamsize read = stream->gcount();
+
+	if (read <= 0)
+	{
+		return false;
+	}
+
+	baseOffset += end - base;
+
+	base = &chunk[0];
+	position = base;
+	end = position + read;
+
+	return true;
+}
+
+bool TraceDecoder::readByte(unsigned char& value)
+{
+	if (position == end && !refill())
+	{
+		return false;
+	}
+
+	value = *position++;
+
+	return true;
+}
+
+bool TraceDecoder::readVarint(unsigned long long& value)
+{
+	value = 0;
+
+	// Fast path for varints that are completely inside the current window
+	if (end - position >= 10)
+	{
+		for (unsigned int shift = 0; shift < 64; shift += 7)
+		{
+			unsigned char byte = *position++;
+
+			value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	for (unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		unsigned char byte;
+
+		if (!readByte(byte))
+		{
+			return false;
+		}
+
+		value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TraceDecoder::skip(unsigned long long length)
+{
+	while (length != 0)
+	{
+		if (position == end && !refill())
+		{
+			return false;
+		}
+
+		unsigned long long available = end - position;
+		unsigned long long skipped = length < available ? length : available;
+
+		position += skipped;
+		length -= skipped;
+	}
+
+	return true;
+}
+
+void TraceDecoder::readHeader()
+{
+	for (unsigned int i = 0; i < sizeof(Trace::MAGIC); i++)
+	{
+		unsigned char byte;
+
+		if (!readByte(byte) || byte != static_cast<unsigned char>(Trace::MAGIC[i]))
+		{
+			return;
+		}
+	}
+
+	unsigned long long version;
+
+	valid = readVarint(version) && version == Trace::VERSION;
+}
+
+TraceDecoderState TraceDecoder::getState() const
+{
+	TraceDecoderState state;
+
+	state.offset = baseOffset + (position - base);
+	state.thread = thread;
+	state.time = time;
+	state.events = events;
+
+	return state;
+}
+
+bool TraceDecoder::seek(const TraceDecoderState& state)
+{
+	if (!valid)
+	{
+		return false;
+	}
+
+	if (stream)
+	{
+		stream->clear();
+		stream->seekg(static_cast<std::streamoff>(state.offset));
+
+		if (!*stream)
+		{
+			return false;
+		}
+
+		base = 0;
+		baseOffset = state.offset;
+		position = 0;
+		end = 0;
+	}
+	else
+	{
+		if (state.offset > baseOffset + (end - base))
+		{
+			return false;
+		}
+
+		position = base + (state.offset - baseOffset);
+	}
+
+	thread = state.thread;
+	time = state.time;
+	events = state.events;
+	repeats = 0;
+	ended = false;
+
+	return true;
+}
+
+/**
+* Decodes the next event of the trace, no matter if it is in the time window.
+**/
+bool TraceDecoder::decode(TraceEvent& event)
+{
+	if (!valid)
+	{
+		return false;
+	}
+
+	while (repeats == 0)
+	{
+		unsigned long long record;
+
+		if (!readVarint(record))
+		{
+			return false;
+		}
+
+		unsigned long long value = record >> 2;
+
+		switch (record & 3)
+		{
+			case Trace::RECORD_HIT:
+			{
+				unsigned long long delta;
+
+				if (!readVarint(delta))
+				{
+					return false;
+				}
+
+				block = static_cast<unsigned int>(value);
+				time += static_cast<unsigned long long>(static_cast<long long>(delta >> 1) ^ -static_cast<long long>(delta & 1));
+				repeats = 1;
+
+				break;
+			}
+			case Trace::RECORD_REPEAT:
+				repeats = value;
+				break;
+			case Trace::RECORD_THREAD:
+				thread = static_cast<unsigned int>(value);
+				break;
+			case Trace::RECORD_EXTENDED:
+			{
+				unsigned long long length;
+
+				if (!readVarint(length))
+				{
+					return false;
+				}
+
+				if (!listener)
+				{
+					if (!skip(length))
+					{
+						return false;
+					}
+
+					break;
+				}
+
+				std::vector<unsigned char> payload;
+
+				while (payload.size() < length)
+				{
+					unsigned char byte;
+
+					if (!readByte(byte))
+					{
+						return false;
+					}
+
+					payload.push_back(byte);
+				}
+
+				listener->addRecord(static_cast<unsigned int>(value), payload);
+
+				break;
+			}
+		}
+	}
+
+	--repeats;
+	++events;
+
+	event.block = block;
+	event.thread = thread;
+	event.time = time;
+
+	return true;
+}
@@ -0,0 +1,377 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <vector>
+
+/**
+* A single breakpoint hit as it is stored in a trace.
+**/
+struct TraceEvent
+{
+	// Index of the hit block in the block index
+	unsigned int block;
+
+	// ID of the thread that hit the block
+	unsigned int thread;
+
+	// Time of the hit in milliseconds
+	unsigned long long time;
+};
+
+/**
+* Compact encoding of the breakpoint hits of a profiling run.
+*
+* A trace is a header followed by a sequence of records. Every record starts with
+* a varint whose lowest two bits give the record type and whose remaining bits
+* give the record value.
+*
+* - HIT: the value is the block index, followed by the zigzag encoded time delta
+*   to the previous hit.
+* - REPEAT: the previous block was hit another value times at the same time.
+*   Tight loops on the same block collapse into a single record like this.
+* - THREAD: all following hits come from the thread with the given ID.
+* - EXTENDED: the value is a record subtype, followed by the payload length and
+*   the payload. Decoders skip subtypes they do not know.
+**/
+namespace Trace
+{
+	const unsigned int RECORD_HIT = 0;
+	const unsigned int RECORD_REPEAT = 1;
+	const unsigned int RECORD_THREAD = 2;
+	const unsigned int RECORD_EXTENDED = 3;
+
+	const unsigned int VERSION = 1;
+
+	// Extended record with the hits of blocks that were counted without events,
+	// as pairs of block index and hits
+	const unsigned int EXTENDED_BLOCK_HITS = 1;
+
+	// Extended record with the CPU time a thread used so far in milliseconds, as
+	// thread ID and time. It comes before the first hit at that time, which ends
+	// the time of the last hit of the thread. Times that did not change since the
+	// last record of the thread are left out.
+	const unsigned int EXTENDED_CPU_TIME = 2;
+
+	// Extended record without payload where an interrupted trace was continued.
+	// The calls, loops and CPU times before it do not continue behind it.
+	const unsigned int EXTENDED_RESUME = 3;
+
+	// Extended record with the samples of a sampling session: the sampling interval
+	// in milliseconds, the number of samples outside of all blocks and a triple of
+	// start, end and samples for every sampled block range. Sampling traces have no
+	// hits.
+	const unsigned int EXTENDED_SAMPLES = 4;
+
+	// Extended record where a triggered session left its scope, with the time of
+	// the return of the trigger function. Like a resume record it separates the
+	// calls before it from those behind it.
+	const unsigned int EXTENDED_SCOPE_EXIT = 5;
+
+	extern const char MAGIC[4];
+
+	/**
+	* Appends a varint to the payload of an extended record.
+	**/
+	void appendVarint(std::vector<unsigned char>& data, unsigned long long value);
+
+	/**
+	* Reads a varint from the payload of an extended record.
+	* @param position The position of the varint; receives the position behind it
+	* @return False if the payload ends before the varint
+	**/
+	bool readVarint(const std::vector<unsigned char>& data, unsigned int& position, unsigned long long& value);
+
+	/**
+	* Checks whether an extended record separates two parts of a trace that do not
+	* belong together. The calls that run before the record end there and the time
+	* up to the next hit is not profiled.
+	* @param time The time of the last hit; receives the time at which the calls
+	* end if the record has a later one
+	**/
+	bool isBreak(unsigned int type, const std::vector<unsigned char>& payload, unsigned long long& time);
+}
+
+/**
+* The state of a trace encoder that the records of later events depend on. Saving
+* it together with the data encoded so far allows continuing a trace later.
+**/
+struct TraceEncoderState
+{
+	unsigned int lastBlock;
+	unsigned int lastThread;
+	unsigned long long lastTime;
+	unsigned long long events;
+	bool hasLastEvent;
+};
+
+/**
+* Encodes breakpoint hits into the trace format. Adding an event only appends a few
+* bytes to a buffer so it can be called straight from the debugger callback.
+**/
+class TraceEncoder
+{
+private:
+	std::vector<unsigned char> buffer;
+
+	unsigned int lastBlock;
+	unsigned int lastThread;
+	unsigned long long lastTime;
+
+	unsigned long long pendingRepeats;
+	unsigned long long events;
+
+	bool hasLastEvent;
+
+	// Last CPU time written for each thread
+	std::map<unsigned int, unsigned long long> cpuTimes;
+
+	void writeVarint(unsigned long long value)
+	{
+		while (value >= 0x80)
+		{
+			buffer.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+
+		buffer.push_back(static_cast<unsigned char>(value));
+	}
+
+	void writeRecord(unsigned int type, unsigned long long value)
+	{
+		writeVarint((value << 2) | type);
+	}
+
+	void flushRepeats()
+	{
+		if (pendingRepeats != 0)
+		{
+			writeRecord(Trace::RECORD_REPEAT, pendingRepeats);
+			pendingRepeats = 0;
+		}
+	}
+
+public:
+	TraceEncoder();
+
+	/**
+	* Adds a breakpoint hit to the trace.
+	**/
+	void addEvent(unsigned int block, unsigned int thread, unsigned long long time)
+	{
+		++events;
+
+		if (hasLastEvent && block == lastBlock && thread == lastThread && time == lastTime)
+		{
+			++pendingRepeats;
+			return;
+		}
+
+		flushRepeats();
+
+		if (thread != lastThread)
+		{
+			writeRecord(Trace::RECORD_THREAD, thread);
+			lastThread = thread;
+		}
+
+		long long delta = static_cast<long long>(time - lastTime);
+
+		writeRecord(Trace::RECORD_HIT, block);
+		writeVarint((static_cast<unsigned long long>(delta) << 1) ^ static_cast<unsigned long long>(delta >> 63));
+
+		lastBlock = block;
+		lastTime = time;
+		hasLastEvent = true;
+	}
+
+	/**
+	* Records the CPU time a thread used so far. Must be called before the hit
+	* the time belongs to; nothing is written if the time did not change.
+	**/
+	void setCpuTime(unsigned int thread, unsigned long long time);
+
+	/**
+	* Adds an extended record.
+	* @param type The subtype of the record
+	**/
+	void addRecord(unsigned int type, const std::vector<unsigned char>& payload);
+
+	/**
+	* Records that a triggered session left its scope at the given time.
+	**/
+	void addScopeExit(unsigned long long time);
+
+	/**
+	* Writes all records that are still pending. Must be called before the
+	* encoded data is used.
+	**/
+	void finish() { flushRepeats(); }
+
+	/**
+	* Writes the data encoded so far to a stream and releases it from memory.
+	**/
+	void drain(std::ostream& stream);
+
+	/**
+	* Returns the state of the encoder. Must only be called after finish().
+	**/
+	TraceEncoderState getState() const;
+
+	/**
+	* Continues a trace whose data up to the given state was already drained.
+	* The data of the encoder is discarded and a resume record is written.
+	**/
+	void resume(const TraceEncoderState& state);
+
+	const std::vector<unsigned char>& getData() const { return buffer; }
+
+	unsigned long long getNumberOfEvents() const { return events; }
+};
+
+/**
+* Receives the extended records a TraceDecoder comes across.
+**/
+class TraceRecordListener
+{
+public:
+	virtual ~TraceRecordListener() { }
+
+	/**
+	* @param type The subtype of the record
+	**/
+	virtual void addRecord(unsigned int type, const std::vector<unsigned char>& payload) = 0;
+};
+
+/**
+* The state of a trace decoder between two records. Decoding can continue at such
+* a position without decoding the records before it.
+**/
+struct TraceDecoderState
+{
+	// Position of the next record in the trace data
+	unsigned long long offset;
+
+	unsigned int thread;
+	unsigned long long time;
+
+	// Number of events decoded before the position
+	unsigned long long events;
+};
+
+/**
+* Streaming decoder for traces. Traces can be decoded from memory or from a stream,
+* in which case only a small window of the trace is held in memory at any time.
+*
+* A decoder can be limited to the events of a time window. Together with a
+* TraceIndex this decodes only the part of the trace around the window.
+**/
+class TraceDecoder
+{
+private:
+	std::istream* stream;
+	std::vector<unsigned char> chunk;
+
+	// Start of the data in memory and its offset in the trace
+	const unsigned char* base;
+	unsigned long long baseOffset;
+
+	const unsigned char* position;
+	const unsigned char* end;
+
+	bool valid;
+	bool ended;
+
+	unsigned int block;
+	unsigned int thread;
+	unsigned long long time;
+	unsigned long long repeats;
+	unsigned long long events;
+
+	unsigned long long windowStart;
+	unsigned long long windowEnd;
+
+	TraceRecordListener* listener;
+
+	// Decoders that read from a stream point into their own window
+	TraceDecoder(const TraceDecoder&);
+	TraceDecoder& operator=(const TraceDecoder&);
+
+	bool refill();
+	bool readByte(unsigned char& value);
+	bool readVarint(unsigned long long& value);
+	bool skip(unsigned long long length);
+	void readHeader();
+	bool decode(TraceEvent& event);
+
+public:
+	TraceDecoder(std::istream& stream);
+	TraceDecoder(const std::vector<unsigned char>& data);
+
+	/**
+	* Returns false if the data does not start with a trace header.
+	**/
+	bool isValid() const { return valid; }
+
+	/**
+	* Decodes the next event. Returns false at the end of the trace or of the
+	* time window.
+	**/
+	bool next(TraceEvent& event)
+	{
+		while (!ended && decode(event))
+		{
+			if (event.time < windowStart)
+			{
+				continue;
+			}
+
+			if (event.time > windowEnd)
+			{
+				ended = true;
+
+				return false;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	/**
+	* Returns true if the decoder is between two records, which is the case
+	* whenever the events of the last record were all returned.
+	**/
+	bool isAtRecord() const { return repeats == 0; }
+
+	/**
+	* Returns the state of the decoder. Must only be called between two records.
+	**/
+	TraceDecoderState getState() const;
+
+	/**
+	* Continues decoding at a state that an earlier decoder of the same trace
+	* returned.
+	**/
+	bool seek(const TraceDecoderState& state);
+
+	/**
+	* Passes the extended records to a listener instead of skipping them.
+	**/
+	void setRecordListener(TraceRecordListener* listener) { this->listener = listener; }
+
+	/**
+	* Limits the decoder to events with a time in [start, end]. Events before the
+	* start are skipped; the first event after the end ends the trace.
+	**/
+	void setWindow(unsigned long long start, unsigned long long end)
+	{
+		windowStart = start;
+		windowEnd = end;
+	}
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "traceindex.hpp"
+
+#include <fstream>
+#include <sstream>
+
+/**
+* Trace indices are stored as text files with one record per line. The first
+* word of a line is the record type:
+*
+* HOTCHINDEX <version>
+* S <events> <start time> <end time> <trace length>
+* I <offset> <thread> <time> <events> <maximum time>   (in trace order)
+*
+* Lines of unknown record types are ignored.
+**/
+namespace
+{
+	const char* MAGIC = "HOTCHINDEX";
+	const unsigned int VERSION = 2;
+
+	TraceIndexEntry createEntry(const TraceDecoder& decoder, unsigned long long maximumTime)
+	{
+		TraceIndexEntry entry;
+
+		entry.state = decoder.getState();
+		entry.maximumTime = maximumTime;
+
+		return entry;
+	}
+}
+
+void TraceIndex::build(TraceDecoder& decoder, unsigned int interval)
+{
+	entries.clear();
+
+	events = 0;
+	startTime = 0;
+	endTime = 0;
+	length = 0;
+
+	entries.push_back(createEntry(decoder, 0));
+
+	unsigned long long lastEntry = 0;
+
+	TraceEvent event;
+
+	while (decoder.next(event))
+	{
+		if (events++ == 0)
+		{
+			startTime = event.time;
+		}
+
+		if (event.time > endTime)
+		{
+			endTime = event.time;
+		}
+
+		// Indexed positions must be between two records
+		if (events - lastEntry >= interval && decoder.isAtRecord())
+		{
+			entries.push_back(createEntry(decoder, endTime));
+
+			lastEntry = events;
+		}
+	}
+
+	length = decoder.getState().offset;
+}
+
+bool TraceIndex::matches(std::istream& trace) const
+{
+	trace.clear();
+	trace.seekg(0, std::ios::end);
+
+	std::streamoff size = trace.tellg();
+
+	trace.clear();
+	trace.seekg(0);
+
+	return size >= 0 && static_cast<unsigned long long>(size) == length;
+}
+
+bool TraceIndex::seek(TraceDecoder& decoder, unsigned long long start, unsigned long long end) const
+{
+	if (entries.empty())
+	{
+		return false;
+	}
+
+	// The latest times grow with the position, so all events before the found
+	// entry are earlier than the window
+	unsigned int low = 0;
+	unsigned int high = entries.size();
+
+	while (high - low > 1)
+	{
+		unsigned int middle = (low + high) / 2;
+
+		if (entries[middle].maximumTime < start)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	if (!decoder.seek(entries[low].state))
+	{
+		return false;
+	}
+
+	decoder.setWindow(start, end);
+
+	return true;
+}
+
+bool writeTraceIndex(const std::string& filename, const TraceIndex& index)
+{
+	std::ofstream file(filename.c_str());
+
+	file << MAGIC << " " << VERSION << "\n";
+	file << "S " << index.getNumberOfEvents() << " " << index.getStartTime() << " " << index.getEndTime() << " " << index.getTraceLength() << "\n";
+
+	for (unsigned int i = 0; i < index.getNumberOfEntries(); i++)
+	{
+		const TraceIndexEntry& entry = index.getEntry(i);
+
+		file << "I " << entry.state.offset << " " << entry.state.thread << " " << entry.state.time << " ";
+		file << entry.state.events << " " << entry.maximumTime << "\n";
+	}
+
+	file.close();
+
+	return file.good();
+}
+
+bool readTraceIndex(const std::string& filename, TraceIndex& index)
+{
+	std::ifstream file(filename.c_str());
+
+	std::string line;
+
+	if (!std::getline(file, line))
+	{
+		return false;
+	}
+
+	std::istringstream header(line);
+	std::string magic;
+	unsigned int version = 0;
+
+	if (!(header >> magic >> version) || magic != MAGIC || version != VERSION)
+	{
+		return false;
+	}
+
+	index = TraceIndex();
+
+	while (std::getline(file, line))
+	{
+		std::istringstream ss(line);
+		std::string type;
+
+		if (!(ss >> type))
+		{
+			continue;
+		}
+
+		if (type == "S")
+		{
+			if (!(ss >> index.events >> index.startTime >> index.endTime >> index.length))
+			{
+				return false;
+			}
+		}
+		else if (type == "I")
+		{
+			TraceIndexEntry entry;
+
+			if (!(ss >> entry.state.offset >> entry.state.thread >> entry.state.time >> entry.state.events >> entry.maximumTime))
+			{
+				return false;
+			}
+
+			index.entries.push_back(entry);
+		}
+	}
+
+	return !index.entries.empty();
+}
@@ -0,0 +1,99 @@
+#ifndef TRACEINDEX_HPP
+#define TRACEINDEX_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+/**
+* A position in a trace from which decoding can start.
+**/
+struct TraceIndexEntry
+{
+	TraceDecoderState state;
+
+	// Latest time of all events before the position
+	unsigned long long maximumTime;
+};
+
+/**
+* Sparse index of a trace by time. Every few thousand events the index keeps the
+* decoder state together with the number of events and the latest time seen so
+* far, so the events of a time window can be decoded without decoding the events
+* before the window. The index takes a few bytes per indexed position and is
+* stored in its own file next to the trace.
+*
+* Indexed positions do not keep the call stacks or the CPU times of the threads.
+* The events between an indexed position and the start of a window are skipped,
+* so stacks from the position would be out of date at the window start anyway.
+* A window is analyzed like a trace that starts at the window: calls that are
+* running at its start begin at their first event in the window, and the time
+* of a thread is split from its first CPU time record in the window on. All
+* results then only count time inside the window.
+**/
+class TraceIndex
+{
+private:
+	std::vector<TraceIndexEntry> entries;
+
+	unsigned long long events;
+	unsigned long long startTime;
+	unsigned long long endTime;
+
+	// Number of bytes of the indexed trace
+	unsigned long long length;
+
+public:
+	static const unsigned int DEFAULT_INTERVAL = 16 * 1024;
+
+	TraceIndex() : events(0), startTime(0), endTime(0), length(0) { }
+
+	/**
+	* Indexes a trace. The decoder must not have decoded any events yet.
+	* @param interval The minimum number of events between two indexed positions
+	**/
+	void build(TraceDecoder& decoder, unsigned int interval = DEFAULT_INTERVAL);
+
+	/**
+	* Moves a decoder to the last indexed position before the first event at or
+	* after the start of a time window and limits it to the window.
+	**/
+	bool seek(TraceDecoder& decoder, unsigned long long start, unsigned long long end) const;
+
+	unsigned long long getNumberOfEvents() const { return events; }
+
+	/**
+	* Returns the time of the first event of the trace.
+	**/
+	unsigned long long getStartTime() const { return startTime; }
+
+	/**
+	* Returns the latest time of all events of the trace.
+	**/
+	unsigned long long getEndTime() const { return endTime; }
+
+	/**
+	* Returns the number of bytes of the indexed trace.
+	**/
+	unsigned long long getTraceLength() const { return length; }
+
+	/**
+	* Checks whether the index belongs to a trace. An index of a trace that was
+	* written again or continued after indexing does not match it.
+	**/
+	bool matches(std::istream& trace) const;
+
+	unsigned int getNumberOfEntries() const { return entries.size(); }
+
+	const TraceIndexEntry& getEntry(unsigned int index) const { return entries[index]; }
+
+	friend bool readTraceIndex(const std::string& filename, TraceIndex& index);
+};
+
+bool writeTraceIndex(const std::string& filename, const TraceIndex& index);
+
+bool readTraceIndex(const std::string& filename, TraceIndex& index);
+
+#endif
@@ -0,0 +1,102 @@
+#include "trampoline.hpp"
+
+namespace
+{
+	const unsigned char PUSHFD = 0x9C;
+	const unsigned char POPFD = 0x9D;
+	const unsigned char NOP = 0x90;
+	const unsigned char JMP = 0xE9;
+
+	// lock add dword ptr [address], 1
+	const unsigned char LOCK_ADD[] = { 0xF0, 0x83, 0x05 };
+
+	// lock adc dword ptr [address], 0
+	const unsigned char LOCK_ADC[] = { 0xF0, 0x83, 0x15 };
+}
+
+void CounterTrampolines::create(address_t area, unsigned int capacity)
+{
+	this->area = area;
+	this->capacity = capacity;
+
+	blocks.clear();
+	originalBytes.clear();
+	code.clear();
+	counts.clear();
+}
+
+/**
+* Appends a 32-bit little-endian address to the code.
+**/
+void CounterTrampolines::appendAddress(address_t address)
+{
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		code.push_back(static_cast<unsigned char>(address >> (8 * i)));
+	}
+}
+
+/**
+* Appends a jump from the end of the code to the target.
+**/
+void CounterTrampolines::appendJump(address_t target)
+{
+	address_t next = getCodeAddress() + code.size() + JUMP_SIZE;
+
+	code.push_back(JMP);
+
+	appendAddress(target - next);
+}
+
+std::vector<unsigned char> CounterTrampolines::addBlock(address_t block, const std::vector<unsigned char>& original)
+{
+	address_t counter = area + blocks.size() * COUNTER_SIZE;
+	address_t trampoline = getCodeAddress() + code.size();
+
+	blocks.push_back(block);
+	originalBytes.push_back(original);
+
+	code.push_back(PUSHFD);
+
+	code.insert(code.end(), LOCK_ADD, LOCK_ADD + sizeof(LOCK_ADD));
+	appendAddress(counter);
+	code.push_back(1);
+
+	code.insert(code.end(), LOCK_ADC, LOCK_ADC + sizeof(LOCK_ADC));
+	appendAddress(counter + 4);
+	code.push_back(0);
+
+	code.push_back(POPFD);
+
+	code.insert(code.end(), original.begin(), original.end());
+
+	appendJump(block + original.size());
+
+	std::vector<unsigned char> patch;
+
+	address_t displacement = trampoline - (block + JUMP_SIZE);
+
+	patch.push_back(JMP);
+
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		patch.push_back(static_cast<unsigned char>(displacement >> (8 * i)));
+	}
+
+	patch.resize(original.size(), NOP);
+
+	return patch;
+}
+
+void CounterTrampolines::setCounts(const std::vector<unsigned char>& counters)
+{
+	counts.assign(blocks.size(), 0);
+
+	for (unsigned int i = 0; i < blocks.size() && (i + 1) * COUNTER_SIZE <= counters.size(); i++)
+	{
+		for (unsigned int j = COUNTER_SIZE; j-- != 0; )
+		{
+			counts[i] = (counts[i] << 8) | counters[i * COUNTER_SIZE + j];
+		}
+	}
+}
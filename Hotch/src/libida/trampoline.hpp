@@ -0,0 +1,107 @@
+#ifndef TRAMPOLINE_HPP
+#define TRAMPOLINE_HPP
+
+#include <vector>
+
+#include "types.hpp"
+
+/**
+* The counter trampolines of a session that counts the hits of blocks inside the
+* target process instead of with breakpoints.
+*
+* The trampolines live in an area of the target process that starts with a 64-bit
+* counter for each instrumented block, followed by the code. The first instructions
+* of a block are replaced by a jump to its trampoline, which increments the counter,
+* runs the replaced instructions and jumps back behind them:
+*
+*   pushfd
+*   lock add dword ptr [counter], 1
+*   lock adc dword ptr [counter + 4], 0
+*   popfd
+*   <replaced instructions>
+*   jmp <block + size of the replaced instructions>
+*
+* The code is 32-bit x86. The replaced instructions must not depend on their
+* address, which rules out relative jumps and calls.
+**/
+class CounterTrampolines
+{
+private:
+	address_t area;
+	unsigned int capacity;
+
+	std::vector<address_t> blocks;
+	std::vector<std::vector<unsigned char> > originalBytes;
+
+	std::vector<unsigned char> code;
+
+	std::vector<unsigned long long> counts;
+
+	void appendJump(address_t target);
+	void appendAddress(address_t address);
+
+public:
+	// Size of the jump that replaces the first instructions of a block
+	static const unsigned int JUMP_SIZE = 5;
+
+	// Largest size of the code of a trampoline in bytes
+	static const unsigned int MAXIMUM_TRAMPOLINE_SIZE = 48;
+
+	static const unsigned int COUNTER_SIZE = 8;
+
+	CounterTrampolines() : area(0), capacity(0) { }
+
+	/**
+	* Returns the size of the area that holds the trampolines of the given number
+	* of blocks.
+	**/
+	static unsigned int getAreaSize(unsigned int blocks) { return blocks * (COUNTER_SIZE + MAXIMUM_TRAMPOLINE_SIZE); }
+
+	/**
+	* Starts laying out the trampolines of up to capacity blocks in an area of
+	* getAreaSize(capacity) bytes at the given address. Earlier trampolines are
+	* discarded.
+	**/
+	void create(address_t area, unsigned int capacity);
+
+	bool isCreated() const { return area != 0; }
+
+	/**
+	* Checks whether another block can get a trampoline.
+	**/
+	bool isFull() const { return blocks.size() == capacity; }
+
+	/**
+	* Adds the trampoline of a block.
+	* @param original The replaced instructions, at least JUMP_SIZE bytes
+	* @return The bytes that replace the instructions: the jump to the trampoline,
+	* padded with nops
+	**/
+	std::vector<unsigned char> addBlock(address_t block, const std::vector<unsigned char>& original);
+
+	address_t getCounterArea() const { return area; }
+
+	unsigned int getCounterAreaSize() const { return capacity * COUNTER_SIZE; }
+
+	address_t getCodeAddress() const { return area + getCounterAreaSize(); }
+
+	/**
+	* Returns the code of all trampolines, which belongs at getCodeAddress().
+	**/
+	const std::vector<unsigned char>& getCode() const { return code; }
+
+	unsigned int getNumberOfBlocks() const { return blocks.size(); }
+
+	address_t getBlock(unsigned int index) const { return blocks[index]; }
+
+	const std::vector<unsigned char>& getOriginalBytes(unsigned int index) const { return originalBytes[index]; }
+
+	/**
+	* Takes the counts of the blocks from a copy of the counter area.
+	**/
+	void setCounts(const std::vector<unsigned char>& counters);
+
+	unsigned long long getCount(unsigned int index) const { return counts[index]; }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TRIGGER_HPP
+#define TRIGGER_HPP
+
+#include "types.hpp"
+
+/**
+* The state of a triggered session, which only profiles the calls of one function
+* and everything they call. Outside of such a call only the breakpoint at the
+* start of the trigger function is enabled. A call of the trigger function enters
+* the scope: Hotch enables the breakpoints of the call-graph closure of the
+* function and sets a breakpoint at the return address. The scope is left when
+* the calling thread reaches the return address with a stack pointer above the
+* one of the call, which skips the returns of recursive calls.
+**/
+class TriggerScope
+{
+private:
+	address_t trigger;
+
+	bool inside;
+
+	unsigned int thread;
+	address_t returnAddress;
+	address_t stackPointer;
+
+	// True if the breakpoint at the return address was set for the scope
+	bool ownsReturnBreakpoint;
+
+	unsigned int entries;
+
+public:
+	TriggerScope() : trigger(0), inside(false), thread(0), returnAddress(0), stackPointer(0), ownsReturnBreakpoint(false), entries(0) { }
+
+	void setTrigger(address_t trigger) { this->trigger = trigger; }
+
+	/**
+	* Returns the start of the trigger function or 0 if the session is not triggered.
+	**/
+	address_t getTrigger() const { return trigger; }
+
+	bool isTriggered() const { return trigger != 0; }
+
+	/**
+	* Enters the scope at a call of the trigger function.
+	* @param stackPointer The stack pointer at the start of the trigger function,
+	* which points to the return address
+	* @param ownsReturnBreakpoint True if the breakpoint at the return address must
+	* be removed when the scope is left
+	**/
+	void enter(unsigned int thread, address_t returnAddress, address_t stackPointer, bool ownsReturnBreakpoint)
+	{
+		inside = true;
+
+		this->thread = thread;
+		this->returnAddress = returnAddress;
+		this->stackPointer = stackPointer;
+		this->ownsReturnBreakpoint = ownsReturnBreakpoint;
+
+		++entries;
+	}
+
+	void leave() { inside = false; }
+
+	bool isInside() const { return inside; }
+
+	/**
+	* Returns the thread of the call that entered the scope.
+	**/
+	unsigned int getThread() const { return thread; }
+
+	address_t getReturnAddress() const { return returnAddress; }
+
+	bool ownsBreakpoint() const { return ownsReturnBreakpoint; }
+
+	/**
+	* Checks whether a hit of the return address ends the call that entered the
+	* scope rather than a recursive call.
+	**/
+	bool isReturn(unsigned int thread, address_t address, address_t stackPointer) const
+	{
+		return inside && thread == this->thread && address == returnAddress && stackPointer > this->stackPointer;
+	}
+
+	/**
+	* Returns the number of calls of the trigger function that were profiled.
+	**/
+	unsigned int getNumberOfEntries() const { return entries; }
+};
+
+#endif
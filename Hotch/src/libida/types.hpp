@@ -0,0 +1,10 @@
+#ifndef TYPES_HPP
+#define TYPES_HPP
+
+/**
+* Addresses of the profiled file. The profiling data does not depend on the IDA SDK
+* so it can be processed outside of IDA too.
+**/
+typedef unsigned long long address_t;
+
+#endif